@@ -0,0 +1,111 @@
+#!/usr/bin/env bash
+# ============================================================
+# make bench 的執行腳本：可重現的基準測試與回歸比較。
+# server 與量測端各自以 taskset 綁在固定 CPU，依序執行
+#   1. bin/microbench：libutils 熱路徑的微基準 (send/recv_frame、header 驗證、sysinfo、log…)
+#   2. bin/bench：端到端情境 (連線 churn、64B/4KB/1MB pipelined echo、sysinfo storm)
+# 結果彙整成一個 JSON 檔 (含 commit、kernel 與 CPU 配置)，用來比較兩個 commit：
+#   make bench BENCH_OUT=before.json   # 修改前
+#   make bench BENCH_OUT=after.json    # 修改後
+#   ./bench.sh compare before.json after.json
+# 環境變數：BENCH_OUT (預設 bench.json)、BENCH_PORT (19090)、BENCH_DURATION (每個情境秒數，預設 3)、
+#   BENCH_MIN_TIME (微基準每項毫秒，預設 300)、BENCH_SERVER_CPU / BENCH_CLIENT_CPU
+#   (預設 0 / 1；只有一顆 CPU 時兩者都用 0，數字仍可比較，但 server 與量測端會互搶 CPU)
+# ============================================================
+set -eu
+cd "$(dirname "$0")"
+
+if [ "${1:-}" = "compare" ]; then
+    [ $# -eq 3 ] || { echo "usage: $0 compare OLD.json NEW.json" >&2; exit 2; }
+    exec python3 - "$2" "$3" <<'EOF'
+import json, sys
+a, b = (json.load(open(p)) for p in sys.argv[1:3])
+print("old: %s (%s)  new: %s (%s)" % (a["commit"], a["date"], b["commit"], b["date"]))
+def pct(o, n): return (n - o) / o * 100 if o else 0.0
+om = {r["name"]: r for r in a["micro"]["results"]}
+print("\n%-26s %12s %12s %8s" % ("micro (ns/op)", "old", "new", "delta"))
+for r in b["micro"]["results"]:
+    o = om.get(r["name"])
+    if o: print("%-26s %12.1f %12.1f %+7.1f%%" % (r["name"], o["ns_per_op"], r["ns_per_op"], pct(o["ns_per_op"], r["ns_per_op"])))
+oe = {r["name"]: r for r in a["e2e"]}
+print("\n%-22s %12s %12s %8s %10s %10s %8s" % ("e2e", "old req/s", "new req/s", "delta", "old p99us", "new p99us", "delta"))
+for r in b["e2e"]:
+    o = oe.get(r["name"])
+    if not o: continue
+    op, np_ = o["latency"]["all"]["p99_us"], r["latency"]["all"]["p99_us"]
+    print("%-22s %12.0f %12.0f %+7.1f%% %10.1f %10.1f %+7.1f%%" % (r["name"], o["throughput"], r["throughput"],
+          pct(o["throughput"], r["throughput"]), op, np_, pct(op, np_)))
+EOF
+fi
+
+OUT=${BENCH_OUT:-bench.json}
+PORT=${BENCH_PORT:-19090}
+DUR=${BENCH_DURATION:-3}
+MIN_TIME=${BENCH_MIN_TIME:-300}
+NCPU=$(nproc)
+SCPU=${BENCH_SERVER_CPU:-0}
+if [ "$NCPU" -gt 1 ]; then CCPU=${BENCH_CLIENT_CPU:-1}; else CCPU=${BENCH_CLIENT_CPU:-0}; fi
+for b in server client bench microbench; do
+    [ -x "bin/$b" ] || { echo "bin/$b not built (run make)" >&2; exit 1; }
+done
+
+TMP=$(mktemp -d)
+SRV_PID=
+stop_server() {
+    if [ -n "$SRV_PID" ]; then kill "$SRV_PID" 2>/dev/null || true; wait "$SRV_PID" 2>/dev/null || true; SRV_PID=; fi
+}
+trap 'stop_server; rm -rf "$TMP"' EXIT
+
+start_server() {
+    stop_server
+    taskset -c "$SCPU" bin/server -p "$PORT" -v 1 "$@" >>"$TMP/server.log" 2>&1 &
+    SRV_PID=$!
+    for _ in $(seq 50); do
+        bin/client -p "$PORT" ping >/dev/null 2>&1 && return 0
+        sleep 0.1
+    done
+    echo "server did not start ($*), see log:" >&2; cat "$TMP/server.log" >&2; exit 1
+}
+
+# name | server 參數 | bench 參數
+SCENARIOS=(
+    "conn_churn_fork||--churn -c 4 --mix ping"
+    "conn_churn_prefork|--prefork 2|--churn -c 4 --mix ping"
+    "echo_pipelined_64|--prefork 1 --event|-c 8 --pipeline 16 --mix echo -s 64"
+    "echo_pipelined_4k|--prefork 1 --event|-c 8 --pipeline 16 --mix echo -s 4096"
+    "echo_pipelined_1m|--prefork 1 --event|-c 2 --pipeline 2 --mix echo -s 1048576"
+    "sysinfo_storm|--prefork 2 --event|-c 64 --pipeline 4 --mix sysinfo"
+)
+
+echo "microbench (cpu $CCPU)..." >&2
+taskset -c "$CCPU" bin/microbench --json --min-time "$MIN_TIME" >"$TMP/micro.json"
+
+: >"$TMP/e2e.json"
+last_srv=unset
+for s in "${SCENARIOS[@]}"; do
+    IFS='|' read -r name srv args <<<"$s"
+    if [ "$srv" != "$last_srv" ]; then
+        # shellcheck disable=SC2086
+        start_server $srv
+        last_srv=$srv
+    fi
+    echo "e2e $name (server cpu $SCPU, load cpu $CCPU, ${DUR}s)..." >&2
+    # shellcheck disable=SC2086
+    taskset -c "$CCPU" bin/bench -p "$PORT" -d "$DUR" $args --json --label "$name" >>"$TMP/e2e.json" \
+        || echo "warning: $name reported no successful requests" >&2
+done
+stop_server
+
+COMMIT=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+DIRTY=false
+git diff --quiet HEAD -- src include Makefile 2>/dev/null || DIRTY=true
+{
+    printf '{"commit":"%s","dirty":%s,"date":"%s","host":"%s","kernel":"%s","ncpu":%d,' \
+        "$COMMIT" "$DIRTY" "$(date -u +%Y-%m-%dT%H:%M:%SZ)" "$(uname -n)" "$(uname -r)" "$NCPU"
+    printf '"server_cpu":%s,"client_cpu":%s,"duration_s":%s,"micro":' "$SCPU" "$CCPU" "$DUR"
+    cat "$TMP/micro.json"
+    printf ',"e2e":['
+    paste -sd, "$TMP/e2e.json" | tr -d '\n'
+    printf ']}\n'
+} >"$OUT"
+echo "wrote $OUT" >&2
@@ -24,8 +24,12 @@ enum msg_type {
     RESP_PING     = 2,
     REQ_SYSINFO   = 10,
     RESP_SYSINFO  = 11,
+    REQ_SYSINFO_BIN  = 12,   // 回應為固定格式的二進位 struct (見 sysinfo_bin_hdr)
+    RESP_SYSINFO_BIN = 13,
     REQ_ECHO      = 20,
     RESP_ECHO     = 21,
+    REQ_STATS     = 30,   // 回應為 server 共享記憶體統計的文字彙總
+    RESP_STATS    = 31,
     RESP_ERROR    = 255
 };
 
@@ -34,11 +38,41 @@ enum msg_type {
 struct msg_hdr {
     uint32_t magic;   // MSG_MAGIC, network order
     uint16_t type;    // enum msg_type, network order
-    uint16_t flags;   // reserved, network order
+    uint16_t flags;   // MSG_F_*, network order
     uint32_t length;  // payload bytes, network order
 };
 #pragma pack(pop)
 
+// 封包旗標 (msg_hdr.flags)
+// Chunked 訊息：同一型別的多個 frame，除了最後一個以外都設 MSG_F_MORE；
+// 每個 frame 仍受 32MiB 上限，但整個訊息的總長度不受限制。
+#define MSG_F_MORE   0x0001u
+// 壓縮協商：請求帶 MSG_F_ACCEPT_* 表示 client 能解開該格式，回應端 (dispatch_reply) 就可以壓縮；
+// 設 MSG_F_LZ4 / MSG_F_ZSTD 的 frame，payload 為 4 bytes 原始長度 (network order) + 壓縮資料。
+// 壓縮與解壓由 send_frame / recv_frame(_pooled) / frd_next / frame_writer 處理，handler 看到的一律是原始資料
+// (旗標已清除)；傳入的壓縮位元只代表「允許壓縮」，payload 小於門檻或壓縮後沒變小時照原樣送出。
+// 這些位元屬於傳輸層，所有型別都允許。
+#define MSG_F_LZ4          0x0002u
+#define MSG_F_ZSTD         0x0004u
+#define MSG_F_ACCEPT_LZ4   0x0008u
+#define MSG_F_ACCEPT_ZSTD  0x0010u
+#define MSG_F_COMP   (MSG_F_LZ4 | MSG_F_ZSTD)
+#define MSG_F_XPORT  (MSG_F_COMP | MSG_F_ACCEPT_LZ4 | MSG_F_ACCEPT_ZSTD)
+#define MSG_F_KNOWN  (MSG_F_MORE | MSG_F_XPORT)  // 目前定義的所有旗標位元 (各型別允許哪些見型別表)
+#define FRAME_CHUNK_DEFAULT (256*1024)  // 建議的 chunk 大小
+#define FRAME_MAX_LEN (32u*1024*1024)   // 單一 frame 的 payload 上限 (更大的資料請用 chunked 訊息)
+
+// 型別表：frame_validate_hdr 以 type 為索引查一次表 (是否已定義、允許的旗標、payload 上限)，
+// 不必逐一比對。內建型別預先登錄 (只有 ECHO 允許 MSG_F_MORE)；新型別以 msg_type_register
+// 加入，server 端由 dispatch_register (dispatch.h) 一併登錄。型別值限 0 ~ MSG_TYPE_MAX-1。
+#define MSG_TYPE_MAX 256
+// 回傳 0 成功，-1 = 型別超出範圍、max_len 超過 FRAME_MAX_LEN 或含未定義旗標 (errno = EINVAL)
+int  msg_type_register(uint16_t type, uint32_t max_len, uint16_t allowed_flags);
+int  msg_type_known(uint16_t type);
+// 保存 / 還原整張型別表 (plugin 重新載入時退回只有內建型別的狀態)
+void msg_types_checkpoint(void);
+void msg_types_rollback(void);
+
 // ===== Logging (雙層除錯控制) =====
 // 編譯期：由 ENABLE_DEBUG 控制
 // 執行期：透過 -v 參數或 LOG_LEVEL 環境變數控制
@@ -47,6 +81,10 @@ enum log_level { LOG_ERROR=0, LOG_WARN=1, LOG_INFO=2, LOG_DEBUG=3 };
 void log_set_level(int lvl);
 void log_set_prog(const char *name);
 void log_msg(int lvl, const char *fmt, ...) __attribute__((format(printf,2,3)));
+// 非同步模式：log_msg 只記錄參數，格式化與寫出延後到 log_flush()
+// (緩衝區過半、ERROR、間隔 100ms、fork 前與程式結束時也會自動 flush)
+void log_set_async(int on);
+void log_flush(void);
 
 // Macros: debug compiled out unless ENABLE_DEBUG
 #define LOGE(...) log_msg(LOG_ERROR, __VA_ARGS__)
@@ -61,16 +99,145 @@ void log_msg(int lvl, const char *fmt, ...) __attribute__((format(printf,2,3)));
 // ===== Sockets/helpers =====
 int  tcp_listen(const char *host, const char *port, int backlog);
 int  tcp_connect(const char *host, const char *port, int timeout_ms);
+int  tcp_connect_addr(const struct sockaddr *sa, socklen_t salen, int timeout_ms);  // 已解析的位址 (session.c 的位址快取)
+// 同主機的 AF_UNIX stream socket：帶同樣的 msg_hdr frame，省掉 loopback 的 TCP 處理。
+// path 為 socket 檔路徑，或 "@name" 表示 abstract namespace
+int  unix_listen(const char *path, int backlog);
+int  unix_connect(const char *path, int timeout_ms);
 int  set_nonblock(int fd, int nb);
 int  set_cloexec(int fd);
 int  set_timeouts(int fd, int rcv_ms, int snd_ms);
 
+// Socket 選項設定檔：tcp_listen / tcp_connect 會自動套用；
+// 已 accept 的連線需呼叫 sockopt_apply_conn (TCP_QUICKACK 不會被繼承)。
+// 0 = 不設定 (保留 kernel 預設值)
+struct sock_opts {
+    int nodelay;        // TCP_NODELAY
+    int quickack;       // TCP_QUICKACK
+    int rcvbuf;         // SO_RCVBUF (bytes)
+    int sndbuf;         // SO_SNDBUF (bytes)
+    int defer_accept;   // TCP_DEFER_ACCEPT (秒，listener)
+    int fastopen;       // TCP_FASTOPEN：listener 為佇列長度，client 端非 0 即啟用 TCP_FASTOPEN_CONNECT
+    int busy_poll;      // SO_BUSY_POLL (微秒)
+    int backlog;        // listen() backlog (預設 128)
+    int reuseport;      // SO_REUSEPORT：多個 listener 綁同一個 port，各自有 accept queue
+};
+extern struct sock_opts g_sockopt;
+// 解析 "nodelay,quickack,rcvbuf=262144,busy_poll=50,..." 或預設組合 "lowlat"；回傳 0 成功，-1 格式錯誤
+int  sockopt_parse(const char *spec);
+int  sockopt_apply_conn(int fd);
+// 在 SO_REUSEPORT 群組上掛 classic BPF：連線交給「處理該封包的 CPU % n」號 listener
+// (群組內依建立順序編號)；只需掛在其中一個 socket 上
+int  reuseport_attach_cpu_bpf(int lfd, int n);
+
+// 批次 accept：一次把 accept queue 中最多 max 條連線取出 (accept4 + flags)，
+// 回傳取得的數量 (0 = 佇列已空)，-1 = 錯誤且一條都沒取到。
+// 醒來時的佇列深度記錄在 st (取滿 max 時另以 TCP_INFO 讀取剩餘深度)。
+struct accept_stats {
+    uint64_t accepted;       // 累計 accept 的連線數
+    uint64_t batches;        // 有取到連線的批次數
+    uint32_t max_batch;      // 單一批次最多取到幾條
+    uint32_t max_qlen;       // 觀察到的最大佇列深度
+    uint32_t backlog;        // listener 的 backlog 上限 (kernel 回報)
+    uint64_t near_full;      // 佇列深度 >= 3/4 backlog 的次數
+};
+int  accept_batch(int lfd, int *fds, int max, int flags, struct accept_stats *st);
+// 讀取 listener 的 accept queue 目前長度與上限；回傳 0 成功
+int  listen_queue_depth(int lfd, uint32_t *qlen, uint32_t *backlog);
+
+// 時間/deadline：單調時鐘毫秒；deadline = -1 代表不限時 (未啟用逾時)
+int64_t mono_now_ms(void);
+int64_t mono_now_ns(void);
+int64_t deadline_after(int timeout_ms);
+
+// 先嘗試 non-blocking I/O，EAGAIN 時才以 poll 等待 (無 FD_SETSIZE 限制)
 ssize_t readn_timeout(int fd, void *buf, size_t n, int timeout_ms);
 ssize_t writen_timeout(int fd, const void *buf, size_t n, int timeout_ms);
+ssize_t readn_deadline(int fd, void *buf, size_t n, int64_t deadline);
+ssize_t writen_deadline(int fd, const void *buf, size_t n, int64_t deadline);
 
-// Framed I/O 封包傳輸函式
+// Framed I/O 封包傳輸函式 (send_frame 以單次 writev/sendmsg 送出 header+payload)
 int  send_frame(int fd, uint16_t type, const void *payload, uint32_t len, int timeout_ms);
+// recv_frame 的 payload 以 malloc 配置，使用完以 free() 釋放；
+// recv_frame_pooled 改由緩衝區池配置 (熱路徑用，省掉 malloc)，使用完需以 frame_free() 歸還。
+// 兩者的記憶體不可混用：free() 池緩衝區或 frame_free() malloc 的指標都會讓程式中止
 int  recv_frame(int fd, struct msg_hdr *hdr_out, void **payload_out, uint32_t *len_out, int timeout_ms);
+int  recv_frame_pooled(int fd, struct msg_hdr *hdr_out, void **payload_out, uint32_t *len_out, int timeout_ms);
+int  send_frame_flags(int fd, uint16_t type, uint16_t flags, const void *payload, uint32_t len, int timeout_ms);
+// 串流接收：讀一個 chunk 到呼叫端提供的緩衝區 (不配置記憶體)；
+// 回傳 1 = 後面還有 chunk，0 = 最後一個，-1 = 錯誤 (chunk 大於 cap 時 errno = EMSGSIZE)
+int  recv_chunk(int fd, struct msg_hdr *hdr_out, void *buf, uint32_t cap, uint32_t *len_out, int timeout_ms);
+void frame_free(void *payload);
+// 驗證 header (magic / 型別表：type、flags 與該型別的長度上限)；回傳 1 合法、0 不合法
+int  frame_validate_hdr(const struct msg_hdr *h);
+// MSG_ZEROCOPY：payload >= bytes 時由 kernel 直接引用使用者頁面 (0 = 停用)；
+// socket 須先 sock_enable_zerocopy()，send_frame 會等完成通知後才返回
+void frame_set_zerocopy_min(uint32_t bytes);
+int  sock_enable_zerocopy(int fd);
+// 壓縮門檻：payload 小於 bytes 時不壓縮 (預設 512，ping 之類的小訊息不受影響)；zstd 壓縮等級預設 3
+void frame_set_comp_min(uint32_t bytes);
+void frame_set_zstd_level(int level);
+uint16_t frame_comp_accept(void);             // 這個 build 能解開的格式 (MSG_F_ACCEPT_* 位元)
+uint16_t frame_comp_choose(uint16_t req_flags);  // 依請求的 ACCEPT 位元挑回應的壓縮格式 (0 = 不壓縮)
+// flags 含壓縮位元且值得壓縮時，把 payload 壓縮到 *tmp (緩衝區池，送出後以 frame_free 歸還) 並改寫
+// *payload / *len；否則清除壓縮位元、*tmp = NULL。自行組 frame 的呼叫端 (event loop、session) 使用
+void frame_compress(uint16_t *flags, const void **payload, uint32_t *len, void **tmp);
+
+// ===== 緩衝區池 (size class: 64B ~ 64KiB) =====
+// 每個行程各自的 free list，借用/歸還不經過 malloc；超過 64KiB 直接 malloc。
+// pool_get 回傳至少 len bytes 的緩衝區，cap_out (可為 NULL) 取得實際容量。
+// pool_grow 類似 realloc：保留前 used bytes，p 為 NULL 時等同 pool_get。
+struct pool_stats {
+    uint64_t hits, misses;     // 由 free list 取得 / 需要 malloc 的次數
+    uint64_t in_use;           // 目前借出中的區塊數
+    uint64_t cached_bytes;     // free list 中保留的 bytes
+};
+void *pool_get(size_t len, size_t *cap_out);
+void *pool_grow(void *p, size_t used, size_t len, size_t *cap_out);
+void  pool_put(void *p);
+void  pool_trim(void);         // 釋放所有 free list 中的區塊
+// 預先配置 n 塊可容納 len bytes 的區塊放進 free list (不超過該 class 的保留上限)；
+// 在 fork 前呼叫，子行程第一次借用就命中；回傳實際放入的塊數，-1 = 記憶體不足
+int   pool_prefill(size_t len, unsigned n);
+void  pool_get_stats(struct pool_stats *st);
+
+// Buffered framed I/O：每條連線一個接收緩衝區，一次 recv 解析多個 pipelined frame
+// frd_next 一次掃過緩衝區內所有已到齊的 frame 並驗證 header，之後逐一取出時不必再驗證
+struct frame_reader {
+    char  *buf;
+    size_t cap, start, end;   // [start, end) 為尚未消化的資料
+    size_t valid;             // [start, valid) 內的 frame 都已到齊且 header 已驗證
+    char  *zbuf;              // 解壓縮用 (第一次收到壓縮 frame 時由緩衝區池配置)
+    size_t zcap;
+};
+void    frd_init(struct frame_reader *r);
+void    frd_free(struct frame_reader *r);
+// 一次 recv 盡量填滿緩衝區；回傳讀到的 bytes，0 = 對方關閉，-1 = 錯誤/逾時
+// deadline = -1 時直接 recv (non-blocking socket 會回傳 EAGAIN)
+ssize_t frd_fill(struct frame_reader *r, int fd, int64_t deadline);
+// 把已由其他途徑收到的資料 (如 io_uring provided buffer) 附加到緩衝區尾端；回傳 0 成功
+int     frd_append(struct frame_reader *r, const void *p, size_t n);
+// 取出下一個完整 frame：1 = 取得 (payload 指向緩衝區，下一次 frd_fill / frd_next 前有效；
+// 壓縮的 frame 解開到 zbuf)，0 = 資料不足，-1 = header 或壓縮資料不合法 (errno = EPROTO)
+int     frd_next(struct frame_reader *r, struct msg_hdr *h, const void **payload, uint32_t *len);
+size_t  frd_buffered(const struct frame_reader *r);
+// 只查看緩衝區開頭的 header (不消化)：1 = 取得，0 = 不足 12 bytes，-1 = 不合法 (EPROTO)
+int     frd_peek(const struct frame_reader *r, struct msg_hdr *h);
+// 零複製轉送：消化開頭的 frame，回送 resp_type header (沿用請求的 flags)，payload 中已在緩衝區的部分
+// 直接寫出，其餘以 splice() 經 pipe 從 in_fd 搬到 out_fd，不經過使用者空間。
+// 失敗時連線的資料流已不完整，呼叫端應關閉連線。
+int     frd_splice(struct frame_reader *r, int in_fd, int out_fd, uint16_t resp_type, int64_t deadline);
+
+// 回應批次送出：小 frame 先累積，fwr_flush 一次寫出
+struct frame_writer {
+    char  *buf;
+    size_t len, cap;
+};
+void fwr_init(struct frame_writer *w);
+void fwr_free(struct frame_writer *w);
+int  fwr_frame(struct frame_writer *w, int fd, uint16_t type, const void *payload, uint32_t len, int64_t deadline);
+int  fwr_frame_flags(struct frame_writer *w, int fd, uint16_t type, uint16_t flags, const void *payload, uint32_t len, int64_t deadline);
+int  fwr_flush(struct frame_writer *w, int fd, int64_t deadline);
 
 // Error helpers (信號處理函式)
 int  set_signal_handler(int signum, void (*handler)(int));
@@ -78,20 +245,68 @@ int  set_signal_handler(int signum, void (*handler)(int));
 // System info
 // Returns malloc'd string with a human-readable summary; caller free()
 char *get_system_info(void);
+// Same, but the string comes from the buffer pool; caller frame_free()
+char *get_system_info_pooled(void);
+// 快取：靜態欄位 (uname、DMI 機型) 只擷取一次，動態欄位 (記憶體、負載、uptime)
+// 最多每 refresh_ms 更新一次。需在 fork 前呼叫，快取放在 MAP_SHARED 區域供所有子行程共用。
+int  sysinfo_cache_init(int refresh_ms);
+// 不使用快取時在 fork 前呼叫：靜態欄位先在父行程擷取，子行程繼承後不必各自重讀
+void sysinfo_prepare(void);
+// 把目前的系統資訊文字寫入 buf (含結尾 NUL)；回傳長度，-1 失敗。
+// 快取命中時只需讀共享記憶體，不需要任何 syscall。
+int  sysinfo_format(char *buf, size_t cap);
+
+// RESP_SYSINFO_BIN payload：固定 36 bytes 標頭 (network order) +
+// 6 個長度前綴字串 (uint16 長度 + bytes)：nodename, sysname, release, version, machine, model
+#define SYSINFO_BIN_VERSION 1
+#define SYSINFO_BIN_MAX     512
+#pragma pack(push, 1)
+struct sysinfo_bin_hdr {
+    uint16_t version;        // SYSINFO_BIN_VERSION
+    uint16_t ncpu;           // 線上 CPU 數
+    uint32_t uptime_s;
+    uint64_t mem_total;      // bytes
+    uint64_t mem_free;       // bytes
+    uint32_t load_milli[3];  // loadavg x 1000 (1/5/15 分鐘)
+};
+#pragma pack(pop)
+
+// 解碼後的系統資訊 (host order)
+struct sysinfo_snapshot {
+    uint16_t ncpu;
+    uint32_t uptime_s;
+    uint64_t mem_total, mem_free;
+    double   load[3];
+    char nodename[65], sysname[65], release[65], version[65], machine[65], model[128];
+};
+// 編碼目前的系統資訊 (快取命中時同樣不需 syscall)；回傳長度，-1 失敗
+int  sysinfo_encode_bin(void *buf, size_t cap);
+// 解碼 RESP_SYSINFO_BIN payload；回傳 0 成功，-1 格式錯誤 (errno = EPROTO)
+int  sysinfo_decode_bin(const void *buf, size_t len, struct sysinfo_snapshot *out);
 
 // Robustness toggles exposed to both sides
 struct robust_opts {
     int enable_timeouts;         // 是否啟用 I/O 逾時
-    int io_timeout_ms;           // 逾時時間 default 5000
+    int io_timeout_ms;           // 逾時時間 default 5000 (請求進行中沒有進展的上限)
+    int idle_timeout_ms;         // keep-alive：兩個請求之間最多閒置多久 (0 = 不限)，default 30000
     int validate_headers;        // 是否驗證封包標頭
     int ignore_sigpipe;          // 是否忽略 SIGPIPE
-    int child_guard_secs;        // per-connection alarm() in server child
-    int max_reqs_per_conn;       // 每連線最大請求數 (0 = unlimited)
+    int child_guard_secs;        // 單一請求 (讀完到回應送出) 的硬上限，server 子行程以 alarm() 實作
+    int max_reqs_per_conn;       // 每連線最大請求數 (0 = unlimited，default)
 };
 
 extern struct robust_opts g_robust;
 void robust_set_defaults(int server_side);
 
+// 編譯期特化 (make lib-robust / lib-no-robust 以 -DROBUST_FIXED=1/0 編譯 libutils)：
+// validate_headers、enable_timeouts、ignore_sigpipe 在函式庫內成為常數，熱路徑不再讀取 g_robust，
+// 執行期對這三個旗標的設定 (--no-robust) 也不再生效。一般版本照常讀取 g_robust。
+#ifdef ROBUST_FIXED
+# define ROBUST_ON(flag) (ROBUST_FIXED)
+#else
+# define ROBUST_ON(flag) (g_robust.flag)
+#endif
+
 #ifdef __cplusplus
 }
 #endif
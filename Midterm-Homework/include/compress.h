@@ -0,0 +1,33 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+// ============================================================
+// 這個標頭檔定義 libutils 的 payload 壓縮 (frame 的 MSG_F_LZ4 / MSG_F_ZSTD)。
+// LZ4 為內建實作，輸出為 LZ4 block 格式 (沒有 frame header)，
+// 可與 liblz4 的 LZ4_compress_default / LZ4_decompress_safe 互通；
+// zstd 需以 ZSTD=1 編譯 (連結 libzstd)，否則 comp_supported 回報不支援。
+// 一般不需直接呼叫：send_frame / frd_next 等 frame 函式會自動處理 (見 common.h)。
+// ============================================================
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+size_t lz4_bound(size_t n);   // n bytes 壓縮後的最大長度
+// 回傳壓縮後長度，0 = cap 不足
+size_t lz4_compress(const void *src, size_t n, void *dst, size_t cap);
+// 回傳解開後長度，-1 = 資料損毀或超過 cap
+long   lz4_decompress(const void *src, size_t n, void *dst, size_t cap);
+
+// 依 codec (MSG_F_LZ4 / MSG_F_ZSTD) 分派；level 只有 zstd 使用
+int    comp_supported(uint16_t codec);
+size_t comp_bound(uint16_t codec, size_t n);
+size_t comp_encode(uint16_t codec, int level, const void *src, size_t n, void *dst, size_t cap);
+long   comp_decode(uint16_t codec, const void *src, size_t n, void *dst, size_t cap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COMPRESS_H */
@@ -0,0 +1,52 @@
+#ifndef DISPATCH_H
+#define DISPATCH_H
+// ============================================================
+// 這個標頭檔定義 libutils 的請求分派表。
+// 每個請求型別對應一個 handler，以型別值為索引的 256 格陣列查表呼叫，
+// 分派成本不隨協定型別數量增加。登錄時同時把請求/回應型別與其
+// payload 上限、允許的旗標寫進型別表 (frame_validate_hdr 使用)。
+// 回應一律經由 reply_fn 送出，blocking 與事件模式的寫出方式由呼叫端決定。
+// ============================================================
+#include "common.h"
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+// 回應函式：送出 (或排入) 一個 frame；回傳 0 成功，-1 失敗
+typedef int (*reply_fn)(void *sink, uint16_t type, uint16_t flags, const void *payload, uint32_t len);
+
+// 一個待處理的請求；payload 只在 handler 執行期間有效
+struct dispatch_req {
+    uint16_t type, flags;       // 請求型別與旗標 (host order)
+    uint16_t resp_type;         // 登錄時指定的回應型別
+    const void *payload;
+    uint32_t len;
+    reply_fn reply;
+    void *sink;
+};
+typedef void (*msg_handler)(const struct dispatch_req *rq);
+
+// 登錄 req 型別的 handler；req_max_len / allowed_flags 為請求的限制，
+// 回應型別允許相同旗標、長度上限為 FRAME_MAX_LEN。重複登錄會覆蓋舊的 handler。
+// 回傳 0 成功，-1 參數不合法 (errno = EINVAL)
+int  dispatch_register(uint16_t req, uint16_t resp, uint32_t req_max_len, uint16_t allowed_flags, msg_handler fn);
+void dispatch_unregister(uint16_t req);
+// 保存 / 還原分派表與型別表：server 登錄完內建 handler 後 checkpoint，
+// plugin 重新載入前 rollback，舊 plugin 的 handler 與型別一併移除
+void dispatch_checkpoint(void);
+void dispatch_rollback(void);
+// 呼叫 type 對應的 handler；回傳 0 已處理，-1 沒有 handler (errno = ENOENT，尚未回應)
+int  dispatch_request(uint16_t type, uint16_t flags, const void *payload, uint32_t len, reply_fn reply, void *sink);
+
+// handler 常用的回應方式；請求帶 MSG_F_ACCEPT_* 時回應自動允許壓縮 (見 common.h)
+static inline int dispatch_reply(const struct dispatch_req *rq, uint16_t flags, const void *payload, uint32_t len) {
+    return rq->reply(rq->sink, rq->resp_type, (uint16_t)(flags | frame_comp_choose(rq->flags)), payload, len);
+}
+int  dispatch_error(const struct dispatch_req *rq, const char *msg);   // RESP_ERROR + 文字訊息
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DISPATCH_H */
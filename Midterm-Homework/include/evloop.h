@@ -0,0 +1,56 @@
+#ifndef EVLOOP_H
+#define EVLOOP_H
+// ============================================================
+// 這個標頭檔定義 libutils 的事件驅動連線引擎 (epoll，或以 IOURING=1 編譯時可選 io_uring)。
+// 每個 worker 行程建立一個 ev_loop，在同一個行程中以
+// non-blocking socket 多工處理上千條連線；每條連線各自有
+// 讀取狀態機 (header → payload) 與寫出緩衝區。
+// ============================================================
+#include "common.h"
+#include <signal.h>
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+struct ev_loop;
+struct ev_conn;
+
+// 收到一個完整 frame 時呼叫；payload 只在 callback 期間有效
+typedef void (*ev_frame_cb)(struct ev_conn *c, const struct msg_hdr *h, const void *payload, uint32_t len);
+
+// 之後 ev_loop_new 建立的迴圈使用的後端。EV_BACKEND_URING 需要以 IOURING=1 編譯
+// (否則回傳 -1，errno = ENOTSUP) 且 kernel >= 6.0；執行時初始化失敗會記 log 並退回 epoll
+enum ev_backend { EV_BACKEND_EPOLL = 0, EV_BACKEND_URING = 1 };
+int  ev_set_backend(int backend);
+int  ev_loop_backend(const struct ev_loop *L);   // 實際使用的後端
+
+// 建立/釋放事件迴圈；max_conns = 每個行程最多同時連線數 (0 = 不限)
+struct ev_loop *ev_loop_new(ev_frame_cb on_frame, int max_conns);
+void ev_loop_free(struct ev_loop *L);
+// 加入監聽 socket (會被設為 non-blocking)
+int  ev_loop_add_listener(struct ev_loop *L, int lfd);
+// 執行事件迴圈直到 ev_loop_stop()；回傳 0 正常結束，-1 錯誤
+int  ev_loop_run(struct ev_loop *L);
+void ev_loop_stop(struct ev_loop *L);
+// 優雅結束：不再 accept，現有連線全部結束後 ev_loop_run 才返回 (可在 signal handler 中呼叫)
+void ev_loop_drain(struct ev_loop *L);
+// epoll_wait 期間暫時套用的 signal mask (同 epoll_pwait)：呼叫端平時 block 住 stop/drain 用的訊號，
+// 只在等待時解除，訊號不會落在檢查旗標與進入等待之間而被漏掉；NULL = 不更換
+void ev_loop_set_sigmask(struct ev_loop *L, const sigset_t *mask);
+int  ev_loop_nconns(const struct ev_loop *L);
+const struct accept_stats *ev_loop_accept_stats(const struct ev_loop *L);
+
+// 連線操作：送出 frame (先嘗試直接寫，寫不完才排入緩衝區等 EPOLLOUT)
+int  ev_conn_send(struct ev_conn *c, uint16_t type, const void *payload, uint32_t len);
+int  ev_conn_send_flags(struct ev_conn *c, uint16_t type, uint16_t flags, const void *payload, uint32_t len);
+// 標記關閉：寫出緩衝區送完後才真正 close
+void ev_conn_close(struct ev_conn *c);
+int  ev_conn_fd(const struct ev_conn *c);
+unsigned long ev_conn_nframes(const struct ev_conn *c); // 目前連線已收到的完整訊息數 (chunked 訊息只算一次)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EVLOOP_H */
@@ -0,0 +1,37 @@
+#ifndef HIST_H
+#define HIST_H
+// ============================================================
+// 這個標頭檔定義 HDR 風格的延遲直方圖 (log-linear buckets)。
+// 每個 2 的次方區間再切成 32 個子區間，相對誤差約 3%，
+// 固定大小、不需配置記憶體，可直接放在共享記憶體中合併。
+// ============================================================
+#include <stdint.h>
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+#define HIST_SUB_BITS 6
+#define HIST_BUCKETS  (64 + 58*32)
+
+struct hist {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total;
+    uint64_t min, max;
+    double   sum;
+};
+
+void     hist_init(struct hist *h);
+// 值 v 所在的 bucket 編號 (0 ~ HIST_BUCKETS-1)，可供外部以 atomic 方式自行累加
+int      hist_bucket(uint64_t v);
+void     hist_record(struct hist *h, uint64_t v);
+void     hist_merge(struct hist *dst, const struct hist *src);
+// p 介於 0~100；回傳該百分位所在 bucket 的上界
+uint64_t hist_percentile(const struct hist *h, double p);
+double   hist_mean(const struct hist *h);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HIST_H */
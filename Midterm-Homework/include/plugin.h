@@ -0,0 +1,35 @@
+#ifndef PLUGIN_H
+#define PLUGIN_H
+// ============================================================
+// 這個標頭檔定義 handler plugin 的介面 (libutils)。
+// plugin 是一般的 .so (連結 libutils.so)，載入時以 dispatch_register 登錄
+// 新的請求型別。server 在 fork 前載入，收到 SIGHUP 時重新載入並換上
+// 新一代 worker；舊 worker 不再 accept，服務完手上的連線才結束。
+//
+// plugin 需匯出：
+//   const int csb_plugin_abi = PLUGIN_ABI;   // 與 server 編譯時的版本相同才會載入
+//   int  csb_plugin_init(void);              // 登錄 handler；回傳 0 成功
+//   void csb_plugin_fini(void);              // (選用) 卸載前呼叫
+// 更新 plugin 請以 rename (mv) 換檔，不要直接覆寫：舊一代 worker 仍映射著舊檔案。
+// ============================================================
+#include "dispatch.h"
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+#define PLUGIN_ABI 1
+
+// 加入要載入的 plugin：.so 檔，或目錄 (載入其中所有 *.so，依檔名排序)；回傳 0 成功
+int  plugin_add_path(const char *path);
+// 卸載目前載入的 plugin、分派表退回 dispatch_checkpoint() 時的狀態，再依序載入所有路徑；
+// 回傳成功載入的數量 (個別失敗只記 log 並略過)
+int  plugin_reload(void);
+void plugin_unload_all(void);
+int  plugin_generation(void);   // 每次 plugin_reload 加一 (尚未載入過為 0)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PLUGIN_H */
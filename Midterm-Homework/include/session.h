@@ -0,0 +1,64 @@
+#ifndef SESSION_H
+#define SESSION_H
+// ============================================================
+// 這個標頭檔定義 client 端的 session API (libutils)。
+// 每個 host:port 一個連線池：解析結果快取 dns_ttl 毫秒，連線用完放回池中重用，
+// 同一條連線上可以有多個 pipelined 請求 (server 依序回應)。
+// server 因 max_reqs_per_conn 或閒置逾時關閉連線時，尚未收到回應的請求
+// 自動改送到新的連線；池也會記下 server 的每連線請求上限，之後不再超送。
+// 單一行程使用 (不可跨執行緒)；fork 出來的子行程會捨棄繼承的連線重新建立。
+// ============================================================
+#include "common.h"
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+#define SESS_MAX_CONNS     8     // 每個 host:port 最多幾條連線
+#define SESS_MAX_INFLIGHT  64    // 每條連線最多幾個在途請求
+#define SESS_UNIX_PREFIX   "unix:"  // host 為 "unix:/path" 或 "unix:@name" 時改走 AF_UNIX (port 忽略)
+
+struct sess_pool;
+
+struct sess_stats {
+    uint64_t calls;          // 送出的請求數
+    uint64_t completed;      // 收到回應的請求數
+    uint64_t failed;         // 以錯誤結束的請求數
+    uint64_t connects;       // 建立的連線數
+    uint64_t retries;        // 連線被關閉後改送到新連線的請求數
+    uint64_t resolves;       // getaddrinfo 次數
+    uint32_t conn_cap;       // 觀察到的 server 每連線請求上限 (0 = 未知/不限)
+};
+
+// 回應 callback：err = 0 時 h/payload/len 為回應 (payload 只在 callback 期間有效)，
+// 否則 err 為 errno 值 (ETIMEDOUT、ECONNRESET、EPROTO…)。
+// callback 中可以再呼叫 sess_call_async，但不能呼叫 sess_call / sess_poll / sess_wait / sess_close_all。
+typedef void (*sess_cb)(void *arg, int err, const struct msg_hdr *h, const void *payload, uint32_t len);
+
+// 取得 (第一次時建立) host:port 的連線池；回傳 NULL 表示記憶體不足
+struct sess_pool *sess_pool_get(const char *host, const char *port);
+// 關閉並釋放所有連線池；尚未完成的請求以 ECANCELED 結束
+void sess_close_all(void);
+void sess_set_dns_ttl(int ms);   // 預設 60000；0 = 每次建立連線都重新解析
+// MSG_F_LZ4 / MSG_F_ZSTD：之後的請求接受壓縮的回應，大的請求也以此格式壓縮送出；0 = 停用 (預設)
+void sess_set_compression(uint16_t codec);
+
+// 同步呼叫：回傳 0 時 *payload_out 由緩衝區池配置，使用完以 frame_free() 歸還。
+// 收到 RESP_ERROR 也算成功 (由呼叫端檢查 h_out->type)；-1 時 errno 為失敗原因。
+int  sess_call(struct sess_pool *p, uint16_t type, const void *payload, uint32_t len,
+               struct msg_hdr *h_out, void **payload_out, uint32_t *len_out);
+// 非同步呼叫：排入一條連線後立即回傳請求編號 (> 0)，回應到達時由 sess_poll 呼叫 cb。
+// -1 = 無法送出 (連線失敗、EAGAIN = 所有連線的在途請求都已滿)，此時不會呼叫 cb。
+long sess_call_async(struct sess_pool *p, uint16_t type, const void *payload, uint32_t len, sess_cb cb, void *arg);
+// 驅動所有連線池的 I/O 最多 timeout_ms (-1 = 直到有請求完成)；回傳這次完成 (含失敗) 的請求數
+int  sess_poll(int timeout_ms);
+// future：等到請求 id 完成 (callback 已被呼叫)；回傳 0，逾時 -1 (ETIMEDOUT)
+int  sess_wait(long id, int timeout_ms);
+size_t sess_pending(void);       // 所有連線池尚未完成的請求數
+void sess_get_stats(const struct sess_pool *p, struct sess_stats *st);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SESSION_H */
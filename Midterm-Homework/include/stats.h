@@ -0,0 +1,50 @@
+#ifndef STATS_H
+#define STATS_H
+// ============================================================
+// 這個標頭檔定義 server 的共享記憶體統計區 (libutils)。
+// 父行程在 fork 前以 stats_init() 建立 MAP_SHARED 區域，每個 worker /
+// 子行程寫入自己的 slot (只用 relaxed atomic 累加，不需要鎖)，
+// 子行程結束後數字仍留在共享區，REQ_STATS 時再把所有 slot 彙總。
+// ============================================================
+#include "common.h"
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+// 依請求型別分類的統計 (未列出的型別歸到 ST_OTHER)
+enum stats_type { ST_PING = 0, ST_ECHO, ST_SYSINFO, ST_SYSINFO_BIN, ST_STATS, ST_OTHER, ST_NTYPES };
+
+#define STATS_SLOTS 64   // worker 數超過時多個行程共用一個 slot (atomic 累加仍正確)
+
+// 建立統計區；需在 fork 前呼叫。回傳 0 成功，-1 失敗
+int  stats_init(void);
+// 選擇目前行程寫入的 slot：prefork worker 傳入 slot 編號，-1 = 依 pid 雜湊 (fork-per-accept 子行程)
+void stats_attach(int slot);
+
+void stats_conn_open(void);
+void stats_conn_close(void);
+void stats_timeout(void);
+void stats_error(void);            // 協定錯誤、RESP_ERROR 回應
+// 一個請求處理完成：in_bytes = header + payload，ns = 伺服器端處理時間
+void stats_request(uint16_t type, uint32_t in_bytes, int64_t ns);
+void stats_bytes_out(uint32_t n);
+// 記錄 accept queue 觀察值 (批次 accept 後呼叫)
+void stats_note_accept(const struct accept_stats *a);
+
+// 記錄一條因 admission control 被拒絕 (未 fork) 的連線 (父行程呼叫)
+void stats_note_reject(void);
+// 連線從 accept 到送出第一個回應的時間 (含 accept 佇列後的 fork 與排程等待)
+void stats_first_response(int64_t ns);
+// 自上一次呼叫以來 stats_first_response 樣本的百分位 p (0~100) 寫入 *ns_out；
+// 回傳這段期間的樣本數，-1 = 統計未啟用。只供單一行程 (父行程的 admission control) 使用
+long stats_window_percentile(double p, uint64_t *ns_out);
+
+// 把所有 slot 彙總成文字報告寫入 buf；回傳長度，-1 = 統計未啟用或空間不足
+int  stats_format(char *buf, size_t cap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STATS_H */
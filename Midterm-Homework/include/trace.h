@@ -0,0 +1,86 @@
+#ifndef TRACE_H
+#define TRACE_H
+// ============================================================
+// 這個標頭檔定義熱路徑上的結構化追蹤點 (libutils)。
+// 兩層開關，與 LOGD 的雙層除錯控制相同概念：
+//   編譯期：沒有 ENABLE_TRACE (make TRACE=1) 時 TRACE() 完全展開為空；
+//   執行期：trace_start() 之前每個追蹤點只多一個預測為不成立的分支。
+// 啟用後每筆事件以 32 bytes 二進位記錄寫進行程內的 ring，批次 write()
+// 到追蹤檔 (不經過 stderr 與格式化)，再以 bin/tracedump 解讀。
+// 另可加上 USDT=1 (需要 <sys/sdt.h>)，同一組追蹤點也成為 SystemTap/bpftrace 的 USDT probe。
+// ============================================================
+#include <stdint.h>
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+// 事件列表：名稱與兩個參數 (a, b) 的意義
+#define TRACE_EVENTS(X) \
+    X(ACCEPT)        /* a = 連線 fd, b = 同一批次取得的連線數 */ \
+    X(FORK)          /* a = 子行程 pid, b = worker slot (-1 = fork-per-accept) */ \
+    X(RECV)          /* a = 請求型別, b = payload 長度 (frame 解析完成) */ \
+    X(DISPATCH)      /* a = 請求型別, b = payload 長度 (開始處理) */ \
+    X(DISPATCH_END)  /* a = 請求型別, b = 處理時間 (ns) */ \
+    X(SEND)          /* a = 回應型別, b = payload 長度 (排入或送出) */ \
+    X(FLUSH)         /* a = 實際寫出的 bytes */ \
+    X(SYSINFO)       /* a = 0 文字 / 1 二進位, b = 1 快取命中 */
+
+enum trace_event {
+#define TRACE_ENUM_(name) TR_##name,
+    TRACE_EVENTS(TRACE_ENUM_)
+#undef TRACE_ENUM_
+    TR_NEVENTS
+};
+
+// 追蹤檔格式：trace_file_hdr 之後接連續的 trace_rec (host order，只在同一台機器上解讀)
+#define TRACE_MAGIC "CSBTRC1"
+struct trace_file_hdr {
+    char     magic[8];
+    uint32_t rec_size;     // sizeof(struct trace_rec)
+    uint32_t nevents;      // TR_NEVENTS
+};
+struct trace_rec {
+    uint64_t ts_ns;        // CLOCK_MONOTONIC
+    uint32_t pid;
+    uint16_t ev;           // enum trace_event
+    uint16_t pad;
+    uint64_t a, b;
+};
+
+extern int g_trace_on;
+
+// 開始追蹤並寫入 path (截斷舊檔)；需在 fork 前呼叫，子行程共用同一個檔案 (O_APPEND)。
+// 回傳 0 成功，-1 失敗；編譯時沒有 ENABLE_TRACE 時回傳 -1 (errno = ENOTSUP)
+int  trace_start(const char *path);
+void trace_stop(void);
+void trace_emit(int ev, uint64_t a, uint64_t b);
+void trace_flush(void);
+void trace_idle(void);                 // 閒置點呼叫：距上次寫出超過 100ms 才 flush
+const char *trace_event_name(int ev);
+
+#if defined(ENABLE_TRACE) && defined(ENABLE_USDT)
+# include <sys/sdt.h>
+# define TRACE_USDT_(name, a, b) DTRACE_PROBE2(csb, name, a, b)
+#else
+# define TRACE_USDT_(name, a, b) do { } while (0)
+#endif
+
+#ifdef ENABLE_TRACE
+# define TRACE(name, a, b) do { \
+        TRACE_USDT_(name, (uint64_t)(a), (uint64_t)(b)); \
+        if (__builtin_expect(g_trace_on, 0)) trace_emit(TR_##name, (uint64_t)(a), (uint64_t)(b)); \
+    } while (0)
+# define TRACE_IDLE()  do { if (__builtin_expect(g_trace_on, 0)) trace_idle(); } while (0)
+# define TRACE_FLUSH() do { if (__builtin_expect(g_trace_on, 0)) trace_flush(); } while (0)
+#else
+# define TRACE(name, a, b) do { } while (0)
+# define TRACE_IDLE()  do { } while (0)
+# define TRACE_FLUSH() do { } while (0)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TRACE_H */
@@ -0,0 +1,51 @@
+#ifndef TWHEEL_H
+#define TWHEEL_H
+// ============================================================
+// 這個標頭檔定義階層式 timer wheel (libutils)。
+// 4 層、每層 64 格；第 0 層每格一個 tick，上一層每格涵蓋下一層一整圈，
+// 加入/刪除 O(1)，到期時只處理當格的 timer，上層的 timer 在下層轉完一圈時
+// 才往下搬 (cascade)。tick 為 10ms 時可表示約 46 小時，更遠的到期時間會被截到最大值。
+// timer 節點嵌在使用者的結構中，wheel 本身不配置記憶體。
+// ============================================================
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+#define TW_BITS   6
+#define TW_SLOTS  (1u << TW_BITS)
+#define TW_LEVELS 4
+
+struct tw_timer {
+    struct tw_timer *next, *prev;   // 未排入時 next == NULL
+    uint64_t expires;               // 到期 tick
+    void (*fn)(void *arg);
+    void *arg;
+};
+
+struct twheel {
+    uint64_t now;                   // 下一個要處理的 tick
+    int64_t  origin_ms;             // tick 0 對應的時間
+    unsigned tick_ms;
+    size_t   count;                 // 排入中的 timer 數
+    struct tw_timer slot[TW_LEVELS][TW_SLOTS];   // 各格的串列頭 (環狀)
+};
+
+void tw_init(struct twheel *w, unsigned tick_ms, int64_t now_ms);
+void tw_timer_init(struct tw_timer *t, void (*fn)(void *arg), void *arg);
+// 排入 (已排入時先移除)；expire_ms 已過時在下一次 tw_advance 觸發
+void tw_add(struct twheel *w, struct tw_timer *t, int64_t expire_ms);
+void tw_del(struct twheel *w, struct tw_timer *t);
+static inline int tw_pending(const struct tw_timer *t) { return t->next != NULL; }
+// 觸發所有在 now_ms 之前到期的 timer (callback 中可以 add/del 任何 timer)；回傳觸發數
+int  tw_advance(struct twheel *w, int64_t now_ms);
+// 距離下一次需要 tw_advance 的毫秒數 (上界，可能提早醒來做 cascade)；沒有 timer 時回傳 -1
+int  tw_next_ms(const struct twheel *w, int64_t now_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TWHEEL_H */
@@ -0,0 +1,302 @@
+// ============================================================
+// 這支程式為負載產生器 / 延遲量測工具 (bin/bench)。
+// 父行程 fork 出 W 個 worker 行程，每個 worker 以 poll 同時驅動
+// 多條 non-blocking 連線，依權重混合送出 ping / echo / sysinfo。
+// 延遲記錄在共享記憶體中的直方圖，結束後由父行程合併輸出。
+// -r RATE：open-loop，依排程時間送出，延遲從「預定送出時間」起算
+//          (避免 coordinated omission)；未指定則為 closed-loop。
+// --churn：每條連線只送一個請求，收到回應就關閉，下一個請求重新連線 (延遲含 connect)，
+//          量測 accept/fork 的成本。--json 以單一 JSON 物件輸出結果 (make bench 彙整用)。
+// ============================================================
+#include "common.h"
+#include "hist.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+enum { K_PING = 0, K_ECHO = 1, K_SYSINFO = 2, K_NKIND = 3 };
+static const char *kind_name[K_NKIND] = { "ping", "echo", "sysinfo" };
+static const uint16_t kind_req[K_NKIND] = { REQ_PING, REQ_ECHO, REQ_SYSINFO };
+static const uint16_t kind_resp[K_NKIND] = { RESP_PING, RESP_ECHO, RESP_SYSINFO };
+
+// 每個 worker 在共享記憶體中的結果區
+struct bench_result {
+    struct hist all;
+    struct hist per[K_NKIND];
+    uint64_t sent, ok, errors, reconnects, late, connects;
+};
+
+struct bench_opts {
+    const char *host, *port;
+    int conns, workers, depth;
+    double duration_s;
+    double rate;            // 全部 worker 合計 req/s；0 = closed-loop
+    int weight[K_NKIND];
+    uint32_t echo_size;
+    int churn;              // 每個請求一條新連線
+};
+
+struct inflight { uint64_t t_ns; int kind; };
+
+struct bconn {
+    int fd;
+    struct frame_reader rd;
+    struct inflight *q;     // 在途請求 FIFO (server 依序回應)
+    int qhead, qlen;
+};
+
+static uint64_t now_ns(void) {
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t g_rng = 88172645463325252ull;
+static uint32_t xorshift(void) {
+    g_rng ^= g_rng << 13; g_rng ^= g_rng >> 7; g_rng ^= g_rng << 17;
+    return (uint32_t)(g_rng >> 32);
+}
+
+static int pick_kind(const struct bench_opts *o) {
+    int sum = o->weight[0] + o->weight[1] + o->weight[2];
+    int r = (int)(xorshift() % (uint32_t)sum);
+    for (int k=0;k<K_NKIND;k++) { if (r < o->weight[k]) return k; r -= o->weight[k]; }
+    return K_PING;
+}
+
+static int bconn_open(struct bconn *c, const struct bench_opts *o) {
+    c->fd = tcp_connect(o->host, o->port, g_robust.io_timeout_ms);
+    if (c->fd < 0) return -1;
+    set_nonblock(c->fd, 1);
+    frd_init(&c->rd);
+    c->qhead = c->qlen = 0;
+    return 0;
+}
+
+// 連線中斷 (例如 server 的 max_reqs_per_conn)：在途請求記為錯誤並重新連線
+static int bconn_reopen(struct bconn *c, const struct bench_opts *o, struct bench_result *res) {
+    res->errors += (uint64_t)c->qlen;
+    res->reconnects++;
+    if (c->fd >= 0) { close(c->fd); frd_free(&c->rd); }
+    return bconn_open(c, o);
+}
+
+static int bconn_send(struct bconn *c, const struct bench_opts *o, const char *echo_buf, uint64_t t_ns, struct bench_result *res) {
+    if (c->fd < 0) {   // churn：上一個請求完成後已關閉
+        if (bconn_open(c, o) < 0) return -1;
+        res->connects++;
+    }
+    int k = pick_kind(o);
+    uint32_t len = k == K_ECHO ? o->echo_size : (k == K_PING ? 4 : 0);
+    const void *pl = k == K_ECHO ? echo_buf : (k == K_PING ? "ping" : NULL);
+    if (send_frame(c->fd, kind_req[k], pl, len, g_robust.io_timeout_ms) < 0) return -1;
+    int slot = (c->qhead + c->qlen) % o->depth;
+    c->q[slot].t_ns = t_ns; c->q[slot].kind = k;
+    c->qlen++;
+    res->sent++;
+    return 0;
+}
+
+// 讀取回應並記錄延遲；回傳 -1 表示連線需要重建
+static int bconn_recv(struct bconn *c, const struct bench_opts *o, struct bench_result *res) {
+    ssize_t n = frd_fill(&c->rd, c->fd, -1);
+    if (n == 0) return -1;
+    if (n < 0) return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+    uint64_t now = now_ns();
+    struct msg_hdr h; const void *pl; uint32_t len; int rc;
+    while ((rc = frd_next(&c->rd, &h, &pl, &len)) == 1) {
+        if (!c->qlen) { res->errors++; continue; } // 多出來的回應
+        struct inflight *f = &c->q[c->qhead];
+        c->qhead = (c->qhead + 1) % o->depth; c->qlen--;
+        if (ntohs(h.type) != kind_resp[f->kind]) { res->errors++; continue; }
+        uint64_t lat = now > f->t_ns ? now - f->t_ns : 0;
+        hist_record(&res->all, lat);
+        hist_record(&res->per[f->kind], lat);
+        res->ok++;
+    }
+    if (rc == 0 && o->churn && !c->qlen) { close(c->fd); frd_free(&c->rd); c->fd = -1; }
+    return rc < 0 ? -1 : 0;
+}
+
+static void worker_run(int wid, const struct bench_opts *o, struct bench_result *res) {
+    int nc = o->conns / o->workers + (wid < o->conns % o->workers ? 1 : 0);
+    if (nc <= 0) return;
+    g_rng ^= (uint64_t)(wid + 1) * 0x9E3779B97F4A7C15ull;
+    hist_init(&res->all);
+    for (int k=0;k<K_NKIND;k++) hist_init(&res->per[k]);
+    char *echo_buf = malloc(o->echo_size ? o->echo_size : 1);
+    struct bconn *cs = calloc((size_t)nc, sizeof *cs);
+    struct pollfd *pfds = calloc((size_t)nc, sizeof *pfds);
+    if (!echo_buf || !cs || !pfds) { LOGE("worker %d: out of memory", wid); return; }
+    memset(echo_buf, 'x', o->echo_size);
+    for (int i=0;i<nc;i++) {
+        cs[i].q = calloc((size_t)o->depth, sizeof *cs[i].q);
+        if (!cs[i].q || bconn_open(&cs[i], o) < 0) { LOGE("worker %d: connect: %s", wid, strerror(errno)); return; }
+    }
+    double wrate = o->rate / o->workers;                 // 本 worker 的排程速率
+    uint64_t interval = wrate > 0 ? (uint64_t)(1e9 / wrate) : 0;
+    uint64_t start = now_ns(), end = start + (uint64_t)(o->duration_s * 1e9);
+    uint64_t next_send = start;
+    int rr = 0;
+    for (;;) {
+        uint64_t now = now_ns();
+        int sending = now < end;
+        // 送出：closed-loop 補滿每條連線的在途數；open-loop 依排程時間送
+        if (sending && !interval) {
+            for (int i=0;i<nc;i++)
+                while (cs[i].qlen < o->depth && (!o->churn || !cs[i].qlen))
+                    if (bconn_send(&cs[i], o, echo_buf, now_ns(), res) < 0) { bconn_reopen(&cs[i], o, res); break; }
+        } else if (sending) {
+            while (next_send <= now) {
+                int i, tries = 0;
+                for (i = rr; tries < nc && (cs[i].qlen >= o->depth || (o->churn && cs[i].qlen)); i = (i + 1) % nc) tries++;
+                if (tries == nc) break;   // 所有連線在途已滿：晚送的請求延遲仍從預定時間計
+                rr = (i + 1) % nc;
+                if (now - next_send > 1000000ull) res->late++; // 比排程晚超過 1ms 才送出
+                if (bconn_send(&cs[i], o, echo_buf, next_send, res) < 0) bconn_reopen(&cs[i], o, res);
+                next_send += interval;
+            }
+        }
+        int pending = 0;
+        for (int i=0;i<nc;i++) { pfds[i].fd = cs[i].fd; pfds[i].events = POLLIN; pending += cs[i].qlen; }
+        if (!sending && !pending) break;
+        if (!sending && now > end + (uint64_t)g_robust.io_timeout_ms * 1000000ull) break; // 收尾逾時
+        struct timespec tmo = { 0, 100000000 };
+        if (sending && interval) {   // 睡到下一個排程時間 (ns 精度，避免忙等)
+            uint64_t until = next_send > now ? next_send - now : 0;
+            if (until < (uint64_t)tmo.tv_nsec) tmo.tv_nsec = (long)until;
+        }
+        int pr = ppoll(pfds, (nfds_t)nc, &tmo, NULL);
+        if (pr < 0 && errno != EINTR) break;
+        for (int i=0;i<nc && pr>0;i++) {
+            if (!pfds[i].revents) continue;
+            if (bconn_recv(&cs[i], o, res) < 0 && bconn_reopen(&cs[i], o, res) < 0) {
+                LOGE("worker %d: reconnect: %s", wid, strerror(errno));
+                return;
+            }
+        }
+    }
+    for (int i=0;i<nc;i++) {
+        res->errors += (uint64_t)cs[i].qlen;
+        if (cs[i].fd >= 0) { close(cs[i].fd); frd_free(&cs[i].rd); }
+        free(cs[i].q);
+    }
+    free(cs); free(pfds); free(echo_buf);
+}
+
+static int parse_mix(struct bench_opts *o, const char *spec) {
+    o->weight[0] = o->weight[1] = o->weight[2] = 0;
+    char buf[128]; snprintf(buf, sizeof buf, "%s", spec);
+    for (char *save = NULL, *tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        char *colon = strchr(tok, ':');
+        int w = colon ? atoi(colon + 1) : 1;
+        if (colon) *colon = '\0';
+        int k;
+        for (k=0;k<K_NKIND;k++) if (!strcmp(tok, kind_name[k])) break;
+        if (k == K_NKIND || w < 0) return -1;
+        o->weight[k] = w;
+    }
+    return (o->weight[0] + o->weight[1] + o->weight[2]) > 0 ? 0 : -1;
+}
+
+static void usage(const char *arg0) {
+    fprintf(stderr, "Usage: %s [-h host] [-p port] [-c conns] [-w workers] [-d seconds] [-r rate]\n"
+    "          [--pipeline depth] [--mix ping:8,echo:1,sysinfo:1] [-s echo_bytes] [--sockopt list] [-v level]\n"
+    "          [--churn] [--json] [--label name]\n", arg0);
+}
+
+static void print_hist_json(const char *name, const struct hist *h, int comma) {
+    printf("%s\"%s\":{\"n\":%llu,\"mean_us\":%.2f,\"p50_us\":%.2f,\"p99_us\":%.2f,\"p999_us\":%.2f,\"max_us\":%.2f}",
+        comma ? "," : "", name, (unsigned long long)h->total, h->total ? hist_mean(h) / 1e3 : 0.0,
+        (double)hist_percentile(h, 50) / 1e3, (double)hist_percentile(h, 99) / 1e3,
+        (double)hist_percentile(h, 99.9) / 1e3, (double)h->max / 1e3);
+}
+
+static void print_hist(const char *name, const struct hist *h) {
+    if (!h->total) return;
+    printf("  %-8s n=%-9llu mean=%8.1fus p50=%8.1fus p99=%8.1fus p999=%8.1fus max=%8.1fus\n", name,
+        (unsigned long long)h->total, hist_mean(h) / 1e3,
+        (double)hist_percentile(h, 50) / 1e3, (double)hist_percentile(h, 99) / 1e3,
+        (double)hist_percentile(h, 99.9) / 1e3, (double)h->max / 1e3);
+}
+
+int main(int argc, char **argv) {
+    log_set_prog("bench");
+    log_set_level(getenv("LOG_LEVEL")? atoi(getenv("LOG_LEVEL")) : LOG_WARN);
+    robust_set_defaults(0);
+    struct bench_opts o = { .host = "127.0.0.1", .port = "9090", .conns = 16, .workers = 1, .depth = 1,
+                            .duration_s = 5, .rate = 0, .weight = { 1, 0, 0 }, .echo_size = 64 };
+    int json = 0; const char *label = "bench";
+    for (int i=1;i<argc;i++) {
+        if (!strcmp(argv[i], "-h") && i+1<argc) o.host = argv[++i];
+        else if (!strcmp(argv[i], "-p") && i+1<argc) o.port = argv[++i];
+        else if (!strcmp(argv[i], "-c") && i+1<argc) o.conns = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-w") && i+1<argc) o.workers = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-d") && i+1<argc) o.duration_s = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-r") && i+1<argc) o.rate = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-s") && i+1<argc) o.echo_size = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "-v") && i+1<argc) log_set_level(atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--pipeline") && i+1<argc) o.depth = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--sockopt") && i+1<argc) { if (sockopt_parse(argv[++i]) < 0) { usage(argv[0]); return 2; } }
+        else if (!strcmp(argv[i], "--mix") && i+1<argc) { if (parse_mix(&o, argv[++i]) < 0) { usage(argv[0]); return 2; } }
+        else if (!strcmp(argv[i], "--churn")) o.churn = 1;
+        else if (!strcmp(argv[i], "--json")) json = 1;
+        else if (!strcmp(argv[i], "--label") && i+1<argc) label = argv[++i];
+        else { usage(argv[0]); return 2; }
+    }
+    if (o.conns < 1 || o.workers < 1 || o.depth < 1 || o.duration_s <= 0 || o.rate < 0) { usage(argv[0]); return 2; }
+    if (o.workers > o.conns) o.workers = o.conns;
+
+    // 結果區在 fork 前以 MAP_SHARED 建立，worker 結束後父行程仍可讀取
+    size_t rsz = sizeof(struct bench_result) * (size_t)o.workers;
+    struct bench_result *res = mmap(NULL, rsz, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    if (res == MAP_FAILED) { LOGE("mmap: %s", strerror(errno)); return 1; }
+    signal(SIGPIPE, SIG_IGN);
+
+    for (int w=0; w<o.workers; w++) {
+        pid_t pid = fork();
+        if (pid < 0) { LOGE("fork: %s", strerror(errno)); return 1; }
+        if (pid == 0) { worker_run(w, &o, &res[w]); _exit(0); }
+    }
+    while (wait(NULL) > 0) { }
+
+    struct bench_result tot; memset(&tot, 0, sizeof tot);
+    hist_init(&tot.all);
+    for (int k=0;k<K_NKIND;k++) hist_init(&tot.per[k]);
+    for (int w=0; w<o.workers; w++) {
+        hist_merge(&tot.all, &res[w].all);
+        for (int k=0;k<K_NKIND;k++) hist_merge(&tot.per[k], &res[w].per[k]);
+        tot.sent += res[w].sent; tot.ok += res[w].ok; tot.errors += res[w].errors;
+        tot.reconnects += res[w].reconnects; tot.late += res[w].late; tot.connects += res[w].connects;
+    }
+    if (json) {
+        printf("{\"name\":\"%s\",\"mode\":\"%s\",\"conns\":%d,\"workers\":%d,\"depth\":%d,\"echo_size\":%u,\"churn\":%d,"
+               "\"duration_s\":%.2f,\"target_rate\":%.0f,\"sent\":%llu,\"ok\":%llu,\"errors\":%llu,\"reconnects\":%llu,"
+               "\"connects\":%llu,\"late\":%llu,\"throughput\":%.1f,\"latency\":{",
+            label, o.rate > 0 ? "open-loop" : "closed-loop", o.conns, o.workers, o.depth, (unsigned)o.echo_size, o.churn,
+            o.duration_s, o.rate, (unsigned long long)tot.sent, (unsigned long long)tot.ok, (unsigned long long)tot.errors,
+            (unsigned long long)tot.reconnects, (unsigned long long)tot.connects, (unsigned long long)tot.late,
+            (double)tot.ok / o.duration_s);
+        print_hist_json("all", &tot.all, 0);
+        for (int k=0;k<K_NKIND;k++) if (tot.per[k].total) print_hist_json(kind_name[k], &tot.per[k], 1);
+        printf("}}\n");
+        munmap(res, rsz);
+        return tot.ok ? 0 : 1;
+    }
+    printf("bench %s:%s conns=%d workers=%d depth=%d duration=%.1fs mode=%s\n",
+        o.host, o.port, o.conns, o.workers, o.depth, o.duration_s, o.rate > 0 ? "open-loop" : "closed-loop");
+    if (o.rate > 0) printf("  target=%.0f req/s late(>1ms)=%llu\n", o.rate, (unsigned long long)tot.late);
+    printf("  sent=%llu ok=%llu errors=%llu reconnects=%llu throughput=%.0f req/s\n",
+        (unsigned long long)tot.sent, (unsigned long long)tot.ok, (unsigned long long)tot.errors,
+        (unsigned long long)tot.reconnects, (double)tot.ok / o.duration_s);
+    print_hist("all", &tot.all);
+    for (int k=0;k<K_NKIND;k++) print_hist(kind_name[k], &tot.per[k]);
+    munmap(res, rsz);
+    return tot.ok ? 0 : 1;
+}
@@ -1,85 +1,533 @@
 // ============================================================
 // 這支程式為 client 端，負責與 server 連線並傳送指令。
-// 支援三種命令：ping、echo、sysinfo。
+// 支援命令：ping、echo、sysinfo、sysinfo-bin (二進位格式，client 端解碼)、stats (server 統計)。
 // 使用 libutils.so 的共用函式進行封包封裝與傳輸。
+// -n COUNT / --pipeline DEPTH：在同一條連線上送出多個請求，
+// 最多 DEPTH 個同時在途，邊送邊收，用來量測 server 的單一請求成本。
+// echo-stream BYTES：以 chunked 訊息送出 BYTES bytes 並驗證回送內容，
+// 兩端記憶體用量只跟 --chunk 大小有關。
+// call TYPE [TEXT]：送出任意型別的請求 (例如 plugin 提供的型別)，回應型別慣例為 TYPE+1。
+// 單一請求與 --session 模式走 libutils 的 session API (連線池、位址快取、server 關閉連線時自動重送)；
+// --session 搭配 -n/--pipeline 時以非同步呼叫維持 DEPTH 個在途請求，可跨越 server 的 max_reqs_per_conn。
+// fanout FILE [bin]：向檔案 (- = stdin) 中每一行的 host[:port] 取得系統資訊，名稱解析 (getaddrinfo_a)
+// 與 non-blocking 連線同時進行 (最多 --concurrency 個)，每台 host 各自以 --host-timeout 為上限，
+// 結果依到達順序逐行輸出「host<TAB>內容」或「host<TAB>ERROR 原因」。
+// --compress lz4|zstd：請求帶 MSG_F_ACCEPT_* 讓 server 壓縮回應，大的請求 (echo) 也壓縮送出；
+// 壓縮與解壓都在 libutils 的 frame 層，輸出與未壓縮時相同。
 // ============================================================
 #include "common.h"
+#include "session.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
+static uint16_t g_req_flags = 0;   // --compress：每個請求都帶的壓縮旗標
 
 static void usage(const char *arg0) {
-    fprintf(stderr, "Usage: %s [-h host] [-p port] [-v level] cmd [args...]\n"
-    "Commands: ping | sysinfo | echo <text>\n", arg0);
+    fprintf(stderr, "Usage: %s [-h host] [-p port] [-u unix-path] [-v level] [--no-robust] [-n count] [--pipeline depth] [--chunk bytes] [--sockopt list] [--log-async] [--session] [--concurrency n] [--host-timeout ms] [--compress lz4|zstd] cmd [args...]\n"
+    "Commands: ping | sysinfo | sysinfo-bin | echo <text> | echo-stream <bytes> | stats | call <type> [text] | fanout <hostfile|-> [bin]\n", arg0);
 }
 
-int main(int argc, char **argv) {
-    log_set_prog("client");
-    log_set_level(getenv("LOG_LEVEL")? atoi(getenv("LOG_LEVEL")) : LOG_INFO);
-    robust_set_defaults(0);
-    const char *host="127.0.0.1", *port="9090";
-     // 解析命令列參數
-    // 支援 -h, -p, -v, --no-robust
-    for (int i=1;i<argc;i++) {
-        if (!strcmp(argv[i], "-h") && i+1<argc) host = argv[++i];
-        else if (!strcmp(argv[i], "-p") && i+1<argc) port = argv[++i];
-        else if (!strcmp(argv[i], "-v") && i+1<argc) log_set_level(atoi(argv[++i]));
-        else if (!strcmp(argv[i], "--no-robust")) { g_robust.enable_timeouts=0; g_robust.validate_headers=0; g_robust.ignore_sigpipe=0; }
-        else { // first non-flag is command
+static void print_sysinfo_bin(const char *prefix, const struct sysinfo_snapshot *si, uint32_t len) {
+    printf("%snode=%s sys=%s %s release=%s machine=%s model=%s | cpus=%u uptime=%us | mem_total=%lluMB free=%lluMB | load=%.2f %.2f %.2f (%u bytes)\n",
+        prefix, si->nodename, si->sysname, si->version, si->release, si->machine, si->model[0] ? si->model : "n/a",
+        (unsigned)si->ncpu, (unsigned)si->uptime_s,
+        (unsigned long long)(si->mem_total/1024/1024), (unsigned long long)(si->mem_free/1024/1024),
+        si->load[0], si->load[1], si->load[2], (unsigned)len);
+}
+
+#define PIPE_BATCH 64   // 一次最多把幾個請求 frame 串成一段送出
+
+// 批次模式：送出 count 個相同的請求，最多 depth 個在途；回傳 0 全部成功
+static int run_pipeline(int fd, uint16_t req, uint16_t resp, const void *payload, uint32_t plen, long count, int depth) {
+    uint16_t fl = g_req_flags; void *zb = NULL;
+    frame_compress(&fl, &payload, &plen, &zb);   // 每份 frame 內容相同，壓縮一次即可
+    size_t flen = sizeof(struct msg_hdr) + plen;
+    int k = depth < PIPE_BATCH ? depth : PIPE_BATCH;
+    char *batch = malloc(flen * (size_t)k);   // k 份相同 frame 連續排列
+    if (!batch) { frame_free(zb); return -1; }
+    for (int i=0;i<k;i++) {
+        struct msg_hdr h = { htonl(MSG_MAGIC), htons(req), htons(fl), htonl(plen) };
+        memcpy(batch + flen*(size_t)i, &h, sizeof h);
+        if (plen) memcpy(batch + flen*(size_t)i + sizeof h, payload, plen);
+    }
+    set_nonblock(fd, 1);
+    struct frame_reader rd; frd_init(&rd);
+    long issued = 0, recvd = 0, errors = 0;
+    size_t chunk_len = 0, chunk_off = 0; long chunk_n = 0; // 目前正在寫出的一段
+    int64_t t0 = mono_now_ms();
+    int rc = 0;
+    while (recvd < count) {
+        if (chunk_off == chunk_len) {   // 上一段寫完：依在途上限開新的一段
+            issued += chunk_n; chunk_n = 0; chunk_len = chunk_off = 0;
+            long n = count - issued;
+            if (n > depth - (issued - recvd)) n = depth - (issued - recvd);
+            if (n > k) n = k;
+            if (n > 0) { chunk_n = n; chunk_len = flen * (size_t)n; }
+        }
+        struct pollfd pfd = { .fd = fd, .events = POLLIN | (chunk_len > chunk_off ? POLLOUT : 0) };
+        int pr = poll(&pfd, 1, g_robust.enable_timeouts ? g_robust.io_timeout_ms : -1);
+        if (pr < 0) { if (errno == EINTR) continue; rc = -1; break; }
+        if (pr == 0) { errno = ETIMEDOUT; rc = -1; break; }
+        if (pfd.revents & POLLOUT) {
+            ssize_t w = send(fd, batch + chunk_off, chunk_len - chunk_off, 0);
+            if (w < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) { rc = -1; break; }
+            if (w > 0) chunk_off += (size_t)w;
+        }
+        if (pfd.revents & (POLLIN | POLLERR | POLLHUP)) {
+            ssize_t n = frd_fill(&rd, fd, -1);
+            if (n == 0) { errno = ECONNRESET; rc = -1; break; }
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) { rc = -1; break; }
+            struct msg_hdr h; const void *pl; uint32_t len; int fr;
+            while ((fr = frd_next(&rd, &h, &pl, &len)) == 1) {
+                recvd++;
+                if (ntohs(h.type) != resp) errors++;
+            }
+            if (fr < 0) { rc = -1; break; }
+        }
+    }
+    int64_t ms = mono_now_ms() - t0;
+    if (rc < 0) LOGE("pipeline stopped after %ld/%ld responses: %s%s", recvd, count, strerror(errno),
+        errno == ECONNRESET ? " (server max_reqs_per_conn?)" : "");
+    printf("requests=%ld responses=%ld errors=%ld depth=%d elapsed=%ldms rate=%.0f req/s\n",
+        count, recvd, errors, depth, (long)ms, ms > 0 ? recvd * 1000.0 / (double)ms : 0.0);
+    frd_free(&rd);
+    free(batch); frame_free(zb);
+    return (rc < 0 || errors) ? -1 : 0;
+}
+
+// --session：COUNT 個請求經由 session API 送出，最多 depth 個非同步請求在途
+struct sess_run { long recvd, errors; uint16_t resp; };
+static void session_cb(void *arg, int err, const struct msg_hdr *h, const void *payload, uint32_t len) {
+    struct sess_run *s = arg;
+    (void)payload; (void)len;
+    s->recvd++;
+    if (err) { if (!s->errors++) LOGE("session request failed: %s", strerror(err)); }
+    else if (ntohs(h->type) != s->resp) s->errors++;
+}
+static int run_session(struct sess_pool *sp, uint16_t req, uint16_t resp, const void *payload, uint32_t plen, long count, int depth) {
+    struct sess_run s = { 0, 0, resp };
+    long issued = 0; int rc = 0;
+    int64_t t0 = mono_now_ms();
+    while (s.recvd < issued || issued < count) {
+        while (rc == 0 && issued < count && issued - s.recvd < depth) {
+            if (sess_call_async(sp, req, payload, plen, session_cb, &s) < 0) {
+                if (errno != EAGAIN) { LOGE("session: %s", strerror(errno)); rc = -1; }
+                break;
+            }
+            issued++;
+        }
+        if (rc < 0 && !sess_pending()) break;
+        if (sess_poll(-1) < 0 && errno != EINTR) { rc = -1; break; }
+    }
+    int64_t ms = mono_now_ms() - t0;
+    struct sess_stats st; sess_get_stats(sp, &st);
+    printf("requests=%ld responses=%ld errors=%ld depth=%d elapsed=%ldms rate=%.0f req/s connects=%llu retries=%llu resolves=%llu conn_cap=%u\n",
+        count, s.recvd - s.errors, s.errors, depth, (long)ms, ms > 0 ? (double)s.recvd * 1000.0 / (double)ms : 0.0,
+        (unsigned long long)st.connects, (unsigned long long)st.retries, (unsigned long long)st.resolves, (unsigned)st.conn_cap);
+    return (rc < 0 || s.errors || s.recvd < count) ? -1 : 0;
+}
+
+// chunked ECHO：每送出一個 chunk 就收回對應的 chunk 並比對 (一次只有一個 chunk 在途，
+// 避免雙方 socket 緩衝區都塞滿而互相等待)
+static int run_echo_stream(int fd, unsigned long long total, uint32_t chunk) {
+    char *tx = malloc(chunk), *rx = malloc(chunk);
+    if (!tx || !rx) { free(tx); free(rx); return -1; }
+    unsigned long long sent = 0; unsigned long nchunks = 0; int rc = 0;
+    int64_t t0 = mono_now_ms();
+    do {
+        uint32_t n = total - sent < chunk ? (uint32_t)(total - sent) : chunk;
+        for (uint32_t i=0;i<n;i++) tx[i] = (char)((sent + i) * 131 >> 3);  // 依位置產生的內容，方便驗證
+        uint16_t fl = sent + n < total ? MSG_F_MORE : 0;
+        struct msg_hdr h; uint32_t len = 0;
+        if (send_frame_flags(fd, REQ_ECHO, fl | g_req_flags, tx, n, g_robust.io_timeout_ms) < 0 ||
+            recv_chunk(fd, &h, rx, chunk, &len, g_robust.io_timeout_ms) < 0) { rc = -1; break; }
+        if (ntohs(h.type) != RESP_ECHO || (ntohs(h.flags) & MSG_F_MORE) != fl || len != n || memcmp(tx, rx, n)) {
+            LOGE("echo-stream: mismatch at offset %llu", sent); errno = EPROTO; rc = -1; break;
+        }
+        sent += n; nchunks++;
+    } while (sent < total);
+    int64_t ms = mono_now_ms() - t0;
+    if (rc < 0) LOGE("echo-stream stopped after %llu/%llu bytes: %s", sent, total, strerror(errno));
+    printf("streamed=%llu bytes chunks=%lu chunk=%u elapsed=%ldms rate=%.1f MB/s\n", sent, nchunks, (unsigned)chunk,
+        (long)ms, ms > 0 ? (double)sent * 2 / 1e3 / (double)ms : 0.0);
+    free(tx); free(rx);
+    return rc;
+}
+
+// ===== fan-out：同時向多台 host 取得系統資訊 =====
+#define FANOUT_CONC_DEFAULT 256
+#define FANOUT_NAME_MAX     256
+
+enum { FO_RESOLVING, FO_CONNECTING, FO_READING, FO_DONE };
+
+struct fo_target {
+    char name[FANOUT_NAME_MAX];      // 輸出用的 host:port
+    char host[FANOUT_NAME_MAX], port[32];
+    struct addrinfo hints;
+    struct gaicb gcb;                // getaddrinfo_a 的請求/結果
+    struct addrinfo *ai;             // 目前嘗試的位址
+    int fd, state;
+    int stuck;                       // gai_cancel 取消不了：解析執行緒之後仍會寫 gcb，不能碰 ar_result
+    int64_t deadline;
+    struct frame_reader rd;
+};
+
+struct fanout {
+    uint16_t req, resp;
+    long ok, failed;
+};
+
+// 解析一行 host、host:port、[v6]:port 或不帶 port 的 IPv6 位址；回傳 0 = 有效，1 = 空行/註解
+static int fo_parse(struct fo_target *t, char *line, const char *defport) {
+    char *e = line + strcspn(line, "#\r\n");
+    while (e > line && (e[-1] == ' ' || e[-1] == '\t')) e--;
+    *e = 0;
+    while (*line == ' ' || *line == '\t') line++;
+    if (!*line) return 1;
+    const char *port = defport;
+    char *colon = strrchr(line, ':');
+    if (*line == '[') {
+        char *rb = strchr(line, ']');
+        if (!rb) return -1;
+        *rb = 0;
+        if (rb[1] == ':') port = rb + 2;
+        else if (rb[1]) return -1;
+        line++;
+    } else if (colon && colon == strchr(line, ':')) {
+        *colon = 0; port = colon + 1;
+    }
+    if (!*line || !*port || strlen(line) >= sizeof t->host || strlen(port) >= sizeof t->port) return -1;
+    strcpy(t->host, line); strcpy(t->port, port);
+    snprintf(t->name, sizeof t->name, strchr(t->host, ':') ? "[%s]:%s" : "%s:%s", t->host, t->port);
+    return 0;
+}
+
+static void fo_finish(struct fanout *fo, struct fo_target *t, const char *err) {
+    if (t->fd >= 0) { close(t->fd); t->fd = -1; }
+    frd_free(&t->rd);
+    t->state = FO_DONE;
+    if (err) { printf("%s\tERROR %s\n", t->name, err); fo->failed++; }
+    else fo->ok++;
+    fflush(stdout);   // 逐台輸出，不等整批結束
+}
+
+// 從 t->ai 開始嘗試 non-blocking connect；回傳 0 = 連線中，-1 = 所有位址都失敗
+static int fo_connect(struct fo_target *t) {
+    for (; t->ai; t->ai = t->ai->ai_next) {
+        int fd = socket(t->ai->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) continue;
+        if (connect(fd, t->ai->ai_addr, t->ai->ai_addrlen) == 0 || errno == EINPROGRESS) { t->fd = fd; return 0; }
+        int e = errno; close(fd); errno = e;
+    }
+    return -1;
+}
+
+static void fo_writable(struct fanout *fo, struct fo_target *t) {
+    int err = 0; socklen_t elen = sizeof err;
+    if (getsockopt(t->fd, SOL_SOCKET, SO_ERROR, &err, &elen) < 0) err = errno;
+    if (err) {   // 這個位址連不上：換下一個
+        close(t->fd); t->fd = -1;
+        t->ai = t->ai->ai_next;
+        if (fo_connect(t) < 0) fo_finish(fo, t, strerror(err));
+        return;
+    }
+    sockopt_apply_conn(t->fd);
+    struct msg_hdr h = { htonl(MSG_MAGIC), htons(fo->req), htons(0), htonl(0) };
+    if (send(t->fd, &h, sizeof h, MSG_NOSIGNAL) != (ssize_t)sizeof h) { fo_finish(fo, t, strerror(errno)); return; }
+    t->state = FO_READING;
+}
+
+static void fo_readable(struct fanout *fo, struct fo_target *t) {
+    ssize_t n = frd_fill(&t->rd, t->fd, -1);
+    if (n == 0) { fo_finish(fo, t, "connection closed"); return; }
+    if (n < 0) { if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) fo_finish(fo, t, strerror(errno)); return; }
+    struct msg_hdr h; const void *pl; uint32_t len;
+    int fr = frd_next(&t->rd, &h, &pl, &len);
+    if (fr == 0) return;
+    if (fr < 0) { fo_finish(fo, t, "bad response header"); return; }
+    uint16_t type = ntohs(h.type);
+    struct sysinfo_snapshot si;
+    if (type == RESP_SYSINFO && type == fo->resp) {
+        printf("%s\t%.*s\n", t->name, (int)len, (const char *)pl);
+    } else if (type == RESP_SYSINFO_BIN && type == fo->resp && sysinfo_decode_bin(pl, len, &si) == 0) {
+        char prefix[FANOUT_NAME_MAX + 1];
+        snprintf(prefix, sizeof prefix, "%s\t", t->name);
+        print_sysinfo_bin(prefix, &si, len);
+    } else {
+        char msg[160];
+        if (type == RESP_ERROR) snprintf(msg, sizeof msg, "server: %.*s", (int)(len < 120 ? len : 120), (const char *)pl);
+        else snprintf(msg, sizeof msg, "unexpected response type %u", (unsigned)type);
+        fo_finish(fo, t, msg);
+        return;
+    }
+    fo_finish(fo, t, NULL);
+}
+
+static int run_fanout(const char *file, const char *defport, int bin, int conc, int timeout_ms) {
+    FILE *in = strcmp(file, "-") ? fopen(file, "r") : stdin;
+    if (!in) { LOGE("fanout: %s: %s", file, strerror(errno)); return -1; }
+    struct fo_target *ts = NULL; size_t n = 0, cap = 0; char line[512]; int lineno = 0;
+    while (fgets(line, sizeof line, in)) {
+        lineno++;
+        if (n == cap) {
+            size_t ncap = cap ? cap * 2 : 64;
+            struct fo_target *nt = realloc(ts, ncap * sizeof *nt);
+            if (!nt) { LOGE("fanout: out of memory"); break; }
+            ts = nt; cap = ncap;
+        }
+        struct fo_target *t = &ts[n];
+        memset(t, 0, sizeof *t);
+        int pr = fo_parse(t, line, defport);
+        if (pr < 0) LOGW("fanout: %s:%d: bad host entry", file, lineno);
+        if (pr) continue;
+        t->fd = -1;
+        frd_init(&t->rd);
+        n++;
+    }
+    if (in != stdin) fclose(in);
+    if (!n) { LOGE("fanout: no hosts in %s", file); free(ts); return -1; }
+
+    struct fanout fo = { bin ? REQ_SYSINFO_BIN : REQ_SYSINFO, bin ? RESP_SYSINFO_BIN : RESP_SYSINFO, 0, 0 };
+    int64_t t0 = mono_now_ms();
+    // 名稱解析：全部一次交給 getaddrinfo_a 平行處理，最多等 timeout_ms
+    struct gaicb **list = malloc(n * sizeof *list);
+    if (!list) { free(ts); return -1; }
+    for (size_t i=0;i<n;i++) {
+        struct fo_target *t = &ts[i];
+        t->hints.ai_family = AF_UNSPEC; t->hints.ai_socktype = SOCK_STREAM;
+        t->gcb.ar_name = t->host; t->gcb.ar_service = t->port; t->gcb.ar_request = &t->hints;
+        list[i] = &t->gcb;
+    }
+    int grc = getaddrinfo_a(GAI_NOWAIT, list, (int)n, NULL);
+    if (grc) { LOGE("fanout: getaddrinfo_a: %s", gai_strerror(grc)); free(list); free(ts); return -1; }
+    size_t resolving = n, stuck = 0;
+    int64_t dns_dl = t0 + timeout_ms;
+    for (;;) {
+        for (size_t i=0;i<n;i++) {
+            if (!list[i]) continue;
+            int ge = gai_error(list[i]);
+            if (ge == EAI_INPROGRESS) continue;
+            list[i] = NULL; resolving--;
+            if (ge) fo_finish(&fo, &ts[i], gai_strerror(ge));
+            else ts[i].ai = ts[i].gcb.ar_result;
+        }
+        if (!resolving) break;
+        int64_t left = dns_dl - mono_now_ms();
+        if (left <= 0) {
+            for (size_t i=0;i<n;i++) {
+                if (!list[i]) continue;
+                if (gai_cancel(list[i]) != EAI_CANCELED) { ts[i].stuck = 1; stuck++; }   // 解析執行緒仍在使用 gcb：結束前不能釋放 ts
+                fo_finish(&fo, &ts[i], "resolve timeout");
+            }
             break;
         }
+        struct timespec ts_wait = { 0, (left < 5 ? left : 5) * 1000000L };
+        gai_suspend((const struct gaicb *const *)list, (int)n, &ts_wait);
     }
+    free(list);
+    LOGD("fanout: %zu hosts resolved in %ldms", n, (long)(mono_now_ms() - t0));
 
-    if (argc < 2) { usage(argv[0]); return 2; }
-    // find command start index
+    // 連線/請求：最多 conc 台同時進行，每台 host 自己的 deadline
+    struct pollfd *pfd = malloc((size_t)conc * sizeof *pfd);
+    struct fo_target **act = malloc((size_t)conc * sizeof *act);
+    if (!pfd || !act) { free(pfd); free(act); return -1; }
+    size_t next = 0; int nact = 0;
+    while (next < n || nact) {
+        int64_t now = mono_now_ms();
+        while (nact < conc && next < n) {
+            struct fo_target *t = &ts[next++];
+            if (t->state == FO_DONE) continue;
+            t->deadline = now + timeout_ms;
+            if (fo_connect(t) < 0) { fo_finish(&fo, t, strerror(errno)); continue; }
+            t->state = FO_CONNECTING;
+            act[nact++] = t;
+        }
+        int64_t wake = -1;
+        for (int i=0;i<nact;i++) {
+            struct fo_target *t = act[i];
+            if (t->deadline <= now) { fo_finish(&fo, t, t->state == FO_CONNECTING ? "connect timeout" : "timeout"); continue; }
+            if (wake < 0 || t->deadline < wake) wake = t->deadline;
+        }
+        int k = 0;
+        for (int i=0;i<nact;i++) if (act[i]->state != FO_DONE) act[k++] = act[i];
+        nact = k;
+        if (!nact) continue;
+        for (int i=0;i<nact;i++) {
+            pfd[i].fd = act[i]->fd;
+            pfd[i].events = act[i]->state == FO_CONNECTING ? POLLOUT : POLLIN;
+            pfd[i].revents = 0;
+        }
+        int pr = poll(pfd, (nfds_t)nact, (int)(wake - now));
+        if (pr < 0 && errno != EINTR) { LOGE("fanout: poll: %s", strerror(errno)); break; }
+        for (int i=0;pr>0 && i<nact;i++) {
+            struct fo_target *t = act[i];
+            if (!pfd[i].revents) continue;
+            if (t->state == FO_CONNECTING) fo_writable(&fo, t);
+            else fo_readable(&fo, t);
+        }
+        k = 0;
+        for (int i=0;i<nact;i++) if (act[i]->state != FO_DONE) act[k++] = act[i];
+        nact = k;
+    }
+    for (int i=0;i<nact;i++) fo_finish(&fo, act[i], "aborted");
+    free(pfd); free(act);
+    for (size_t i=0;i<n;i++) if (!ts[i].stuck && ts[i].gcb.ar_result) freeaddrinfo(ts[i].gcb.ar_result);   // stuck 的結果跟 ts 一起留著
+    LOGI("fanout: %zu hosts, %ld ok, %ld failed, %ldms", n, fo.ok, fo.failed, (long)(mono_now_ms() - t0));
+    if (!stuck) free(ts);
+    return fo.failed ? -1 : 0;
+}
+
+int main(int argc, char **argv) {
+    log_set_prog("client");
+    log_set_level(getenv("LOG_LEVEL")? atoi(getenv("LOG_LEVEL")) : LOG_INFO);
+    if (getenv("LOG_ASYNC")) log_set_async(atoi(getenv("LOG_ASYNC")));
+    robust_set_defaults(0);
+    const char *host="127.0.0.1", *port="9090", *upath=NULL;
+    long count = 1; int depth = 1, use_session = 0, conc = FANOUT_CONC_DEFAULT, host_timeout = -1; uint32_t chunk = FRAME_CHUNK_DEFAULT;
+    // 解析命令列參數
+    // 支援 -h, -p, -u, -v, --no-robust, -n, --pipeline, --chunk, --sockopt, --log-async, --session, --concurrency, --host-timeout, --compress；第一個非旗標參數即為命令
     int cmdi = 1;
-    while (cmdi<argc && argv[cmdi][0]=='-') {
-        if (!strcmp(argv[cmdi], "-h") || !strcmp(argv[cmdi], "-p") || !strcmp(argv[cmdi], "-v") || !strcmp(argv[cmdi], "--no-robust")) cmdi+= (argv[cmdi][1]=='-'?1:2);
+    for (; cmdi<argc; cmdi++) {
+        if (!strcmp(argv[cmdi], "-h") && cmdi+1<argc) host = argv[++cmdi];
+        else if (!strcmp(argv[cmdi], "-p") && cmdi+1<argc) port = argv[++cmdi];
+        else if (!strcmp(argv[cmdi], "-u") && cmdi+1<argc) upath = argv[++cmdi];   // 同主機：改走 AF_UNIX socket
+        else if (!strcmp(argv[cmdi], "-v") && cmdi+1<argc) log_set_level(atoi(argv[++cmdi]));
+        else if (!strcmp(argv[cmdi], "--no-robust")) { g_robust.enable_timeouts=0; g_robust.validate_headers=0; g_robust.ignore_sigpipe=0; }
+        else if (!strcmp(argv[cmdi], "-n") && cmdi+1<argc) count = atol(argv[++cmdi]);
+        else if (!strcmp(argv[cmdi], "--pipeline") && cmdi+1<argc) depth = atoi(argv[++cmdi]);
+        else if (!strcmp(argv[cmdi], "--chunk") && cmdi+1<argc) chunk = (uint32_t)strtoul(argv[++cmdi], NULL, 10);
+        else if (!strcmp(argv[cmdi], "--sockopt") && cmdi+1<argc) {
+            if (sockopt_parse(argv[++cmdi]) < 0) { fprintf(stderr, "bad --sockopt list: %s\n", argv[cmdi]); return 2; }
+        }
+        else if (!strcmp(argv[cmdi], "--log-async")) log_set_async(1);
+        else if (!strcmp(argv[cmdi], "--session")) use_session = 1;
+        else if (!strcmp(argv[cmdi], "--concurrency") && cmdi+1<argc) conc = atoi(argv[++cmdi]);
+        else if (!strcmp(argv[cmdi], "--host-timeout") && cmdi+1<argc) host_timeout = atoi(argv[++cmdi]);
+        else if (!strcmp(argv[cmdi], "--compress") && cmdi+1<argc) {
+            const char *c = argv[++cmdi];
+            uint16_t codec = !strcmp(c, "lz4") ? MSG_F_LZ4 : !strcmp(c, "zstd") ? MSG_F_ZSTD : 0;
+            if (!codec) { fprintf(stderr, "bad --compress codec: %s (lz4|zstd)\n", c); return 2; }
+            if (codec == MSG_F_ZSTD && !(frame_comp_accept() & MSG_F_ACCEPT_ZSTD)) { LOGW("zstd not built in (ZSTD=1), using lz4"); codec = MSG_F_LZ4; }
+            g_req_flags = (uint16_t)(codec | frame_comp_accept());
+            sess_set_compression(codec);
+        }
         else break;
     }
-    if (cmdi>=argc) { usage(argv[0]); return 2; }
+    if (cmdi>=argc || count < 1 || depth < 1 || conc < 1 || chunk < 1 || chunk > FRAME_MAX_LEN) { usage(argv[0]); return 2; }
     // 取得命令名稱
     const char *cmd = argv[cmdi];
-    // 建立 TCP 連線
-    int fd = tcp_connect(host, port, g_robust.io_timeout_ms);
-    if (fd<0) { LOGE("connect: %s", strerror(errno)); return 1; }
-    set_timeouts(fd, g_robust.io_timeout_ms, g_robust.io_timeout_ms);
+    if (strcmp(cmd, "ping") && strcmp(cmd, "sysinfo") && strcmp(cmd, "sysinfo-bin") && strcmp(cmd, "echo") && strcmp(cmd, "echo-stream") && strcmp(cmd, "stats") && strcmp(cmd, "call") && strcmp(cmd, "fanout")) { usage(argv[0]); return 2; }
+    if ((!strcmp(cmd, "echo") || !strcmp(cmd, "echo-stream") || !strcmp(cmd, "call") || !strcmp(cmd, "fanout")) && cmdi+1>=argc) { fprintf(stderr, "%s requires an argument\n", cmd); return 2; }
+    uint16_t call_type = 0;
+    if (!strcmp(cmd, "call")) {
+        long t = strtol(argv[cmdi+1], NULL, 0);
+        // 內建表不認得的型別先登錄，回應才能通過 header 驗證
+        if (t < 1 || t + 1 >= MSG_TYPE_MAX) { fprintf(stderr, "call: type must be 1..%d\n", MSG_TYPE_MAX - 2); return 2; }
+        call_type = (uint16_t)t;
+        if (!msg_type_known(call_type)) msg_type_register(call_type, FRAME_MAX_LEN, 0);
+        if (!msg_type_known((uint16_t)(call_type + 1))) msg_type_register((uint16_t)(call_type + 1), FRAME_MAX_LEN, 0);
+    }
+    if (!strcmp(cmd, "fanout")) {
+        int bin = cmdi+2 < argc && !strcmp(argv[cmdi+2], "bin");
+        int rc = run_fanout(argv[cmdi+1], port, bin, conc, host_timeout > 0 ? host_timeout : g_robust.io_timeout_ms);
+        return rc < 0 ? 1 : 0;
+    }
+    if (!strcmp(cmd, "echo-stream") || (!use_session && (count > 1 || depth > 1))) {
+        // chunked 與 pipeline 量測直接操作一條連線
+        int fd = upath ? unix_connect(upath, g_robust.io_timeout_ms) : tcp_connect(host, port, g_robust.io_timeout_ms);
+        if (fd<0) { LOGE("connect: %s", strerror(errno)); return 1; }
+        set_timeouts(fd, g_robust.io_timeout_ms, g_robust.io_timeout_ms);
+        int rc;
+        if (!strcmp(cmd, "echo-stream")) rc = run_echo_stream(fd, strtoull(argv[cmdi+1], NULL, 10), chunk);
+        else if (!strcmp(cmd, "ping")) rc = run_pipeline(fd, REQ_PING, RESP_PING, "ping", 4, count, depth);
+        else if (!strcmp(cmd, "sysinfo")) rc = run_pipeline(fd, REQ_SYSINFO, RESP_SYSINFO, NULL, 0, count, depth);
+        else if (!strcmp(cmd, "sysinfo-bin")) rc = run_pipeline(fd, REQ_SYSINFO_BIN, RESP_SYSINFO_BIN, NULL, 0, count, depth);
+        else if (!strcmp(cmd, "stats")) rc = run_pipeline(fd, REQ_STATS, RESP_STATS, NULL, 0, count, depth);
+        else if (call_type) {
+            const char *text = cmdi+2 < argc ? argv[cmdi+2] : "";
+            rc = run_pipeline(fd, call_type, (uint16_t)(call_type + 1), text, (uint32_t)strlen(text), count, depth);
+        }
+        else rc = run_pipeline(fd, REQ_ECHO, RESP_ECHO, argv[cmdi+1], (uint32_t)strlen(argv[cmdi+1]), count, depth);
+        close(fd);
+        return rc < 0 ? 1 : 0;
+    }
+    char uhost[sizeof(struct sockaddr_un) + sizeof SESS_UNIX_PREFIX];
+    if (upath) { snprintf(uhost, sizeof uhost, "%s%s", SESS_UNIX_PREFIX, upath); host = uhost; port = ""; }
+    struct sess_pool *sp = sess_pool_get(host, port);
+    if (!sp) { LOGE("session: %s", strerror(errno)); return 1; }
+    if (count > 1 || depth > 1) {
+        int rc;
+        if (!strcmp(cmd, "ping")) rc = run_session(sp, REQ_PING, RESP_PING, "ping", 4, count, depth);
+        else if (!strcmp(cmd, "sysinfo")) rc = run_session(sp, REQ_SYSINFO, RESP_SYSINFO, NULL, 0, count, depth);
+        else if (!strcmp(cmd, "sysinfo-bin")) rc = run_session(sp, REQ_SYSINFO_BIN, RESP_SYSINFO_BIN, NULL, 0, count, depth);
+        else if (!strcmp(cmd, "stats")) rc = run_session(sp, REQ_STATS, RESP_STATS, NULL, 0, count, depth);
+        else if (call_type) {
+            const char *text = cmdi+2 < argc ? argv[cmdi+2] : "";
+            rc = run_session(sp, call_type, (uint16_t)(call_type + 1), text, (uint32_t)strlen(text), count, depth);
+        }
+        else rc = run_session(sp, REQ_ECHO, RESP_ECHO, argv[cmdi+1], (uint32_t)strlen(argv[cmdi+1]), count, depth);
+        sess_close_all();
+        return rc < 0 ? 1 : 0;
+    }
 
     // 根據命令選擇封包類型
-    struct msg_hdr h; void *pl=NULL; uint32_t len=0;
+    struct msg_hdr h = {0}; void *pl=NULL; uint32_t len=0;   // sess_call 失敗時不會填 h
     if (!strcmp(cmd, "ping")) {
-        send_frame(fd, REQ_PING, "ping", 4, g_robust.io_timeout_ms);
-        // 接收 server 回應
-        if (recv_frame(fd, &h, &pl, &len, g_robust.io_timeout_ms)==0 && ntohs(h.type)==RESP_PING) {
+        if (sess_call(sp, REQ_PING, "ping", 4, &h, &pl, &len)==0 && ntohs(h.type)==RESP_PING) {
             fwrite(pl, 1, len, stdout); fputc('\n', stdout);
         } else {
             LOGE("ping failed");
         }
-        free(pl);
+        frame_free(pl);
     } else if (!strcmp(cmd, "sysinfo")) {
-        send_frame(fd, REQ_SYSINFO, NULL, 0, g_robust.io_timeout_ms);
-        if (recv_frame(fd, &h, &pl, &len, g_robust.io_timeout_ms)==0 && ntohs(h.type)==RESP_SYSINFO) {
+        if (sess_call(sp, REQ_SYSINFO, NULL, 0, &h, &pl, &len)==0 && ntohs(h.type)==RESP_SYSINFO) {
             fwrite(pl, 1, len, stdout); fputc('\n', stdout);
         } else {
             LOGE("sysinfo failed");
         }
-        free(pl);
+        frame_free(pl);
+    } else if (!strcmp(cmd, "sysinfo-bin")) {
+        struct sysinfo_snapshot si;
+        if (sess_call(sp, REQ_SYSINFO_BIN, NULL, 0, &h, &pl, &len)==0 && ntohs(h.type)==RESP_SYSINFO_BIN &&
+            sysinfo_decode_bin(pl, len, &si)==0) {
+            print_sysinfo_bin("", &si, len);
+        } else {
+            LOGE("sysinfo-bin failed");
+        }
+        frame_free(pl);
+    } else if (!strcmp(cmd, "stats")) {
+        if (sess_call(sp, REQ_STATS, NULL, 0, &h, &pl, &len)==0 && ntohs(h.type)==RESP_STATS) {
+            fwrite(pl, 1, len, stdout); fputc('\n', stdout);
+        } else {
+            LOGE("stats failed%s", ntohs(h.type)==RESP_ERROR ? " (server started with --no-stats?)" : "");
+        }
+        frame_free(pl);
+    } else if (call_type) {
+        const char *text = cmdi+2 < argc ? argv[cmdi+2] : "";
+        if (sess_call(sp, call_type, text, (uint32_t)strlen(text), &h, &pl, &len)==0) {
+            uint16_t rt = ntohs(h.type);
+            if (rt == RESP_ERROR) LOGE("call %u: server error: %.*s", (unsigned)call_type, (int)len, pl ? (const char*)pl : "");
+            else { fwrite(pl, 1, len, stdout); fputc('\n', stdout); }
+        } else {
+            LOGE("call %u failed", (unsigned)call_type);
+        }
+        frame_free(pl);
     } else if (!strcmp(cmd, "echo")) {
-        if (cmdi+1>=argc) { fprintf(stderr, "echo requires text\n"); close(fd); return 2; }
         const char *text = argv[cmdi+1];
-        send_frame(fd, REQ_ECHO, text, (uint32_t)strlen(text), g_robust.io_timeout_ms);
-        if (recv_frame(fd, &h, &pl, &len, g_robust.io_timeout_ms)==0 && ntohs(h.type)==RESP_ECHO) {
+        if (sess_call(sp, REQ_ECHO, text, (uint32_t)strlen(text), &h, &pl, &len)==0 && ntohs(h.type)==RESP_ECHO) {
             fwrite(pl, 1, len, stdout); fputc('\n', stdout);
         } else {
             LOGE("echo failed");
         }
-        free(pl);
-    } else {
-        usage(argv[0]);
+        frame_free(pl);
     }
-    close(fd);
+    sess_close_all();
     return 0;
-}
\ No newline at end of file
+}
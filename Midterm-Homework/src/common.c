@@ -1,9 +1,11 @@
 // ============================================================
 // 這支檔案實作 libutils.so 中的共用函式。
-// 包含 Logging、Robust設定、Socket 工具、封包傳輸、
-// 以及系統資訊擷取等核心邏輯。
+// 包含 Robust設定、Socket 工具與封包傳輸等核心邏輯。
+// (Logging 在 log.c，系統資訊擷取在 sysinfo.c)
 // ============================================================
 #include "common.h"
+#include "trace.h"
+#include "compress.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -13,45 +15,30 @@
 #include <time.h>
 #include <netdb.h>
 #include <sys/socket.h>
-#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <linux/filter.h>
+#include <poll.h>
 #include <sys/time.h>
+#include <sys/uio.h>
+#include <linux/errqueue.h>
 #include <signal.h>
-#include <sys/utsname.h>
-#include <sys/sysinfo.h>
 #include <stdarg.h>
 
-// ===== Runtime Logging 實作 =====
-// 透過 log_set_level / log_msg 控制輸出層級
-static int g_log_level = LOG_INFO;
-static const char *g_prog = "app";
-
-// 設定 log 層級與名稱
-void log_set_level(int lvl) { g_log_level = lvl; }
-void log_set_prog(const char *name) { g_prog = name ? name : g_prog; }
-
-// 輸出日誌訊息 (包含時間、PID、層級)
-void log_msg(int lvl, const char *fmt, ...) {
-    if (lvl > g_log_level) return; // 若訊息層級高於目前設定則不輸出
-    const char *tag = (lvl==LOG_ERROR?"ERROR": lvl==LOG_WARN?"WARN": lvl==LOG_INFO?"INFO":"DEBUG");
-    struct timeval tv; gettimeofday(&tv, NULL);  // 取得目前時間（含微秒）
-    struct tm tm; localtime_r(&tv.tv_sec, &tm);  // 轉成本地時間結構（thread-safe）
-    char ts[64]; strftime(ts, sizeof ts, "%F %T", &tm); // 格式化時間字串 YYYY-MM-DD HH:MM:SS
-    fprintf(stderr, "%s.%03ld %s[%d] %s: ", ts, tv.tv_usec/1000, g_prog, (int)getpid(), tag); // 印出前綴（時間.毫秒 程式名[PID] 等級: ）
-    va_list ap; va_start(ap, fmt); vfprintf(stderr, fmt, ap); va_end(ap);
-    fputc('\n', stderr);
-}
-
 // ===== robustness opts =====
 struct robust_opts g_robust;
 // 設定預設 robustness 參數
 void robust_set_defaults(int server_side) {
     g_robust.enable_timeouts = 1;  // 預設啟用 I/O 逾時
     g_robust.io_timeout_ms   = 5000; // I/O 逾時 5 秒
+    g_robust.idle_timeout_ms = 30000; // keep-alive 閒置 30 秒
     g_robust.validate_headers= 1; // 啟用封包標頭驗證
     g_robust.ignore_sigpipe  = 1;
     g_robust.child_guard_secs= server_side ? 60 : 0;
-    // 預設：server 每個連線最多 16 個請求；
-    g_robust.max_reqs_per_conn = server_side ? 16 : 0;
+    // 預設不限每連線請求數：連線保持 keep-alive，由閒置逾時回收 (可用 MAX_REQS_PER_CONN / --max-reqs 設定)
+    g_robust.max_reqs_per_conn = 0;
     const char *mrc = getenv("MAX_REQS_PER_CONN");
     if (mrc) {
         int v = atoi(mrc);
@@ -65,7 +52,7 @@ static void ignore_pipe(void) {
     #ifdef SIGPIPE
     #endif
     */
-    if (g_robust.ignore_sigpipe)
+    if (ROBUST_ON(ignore_sigpipe))
         signal(SIGPIPE, SIG_IGN);
 }
 
@@ -79,16 +66,44 @@ int set_signal_handler(int signum, void (*handler)(int)) {
 }
 
 // ===== Socket 實作 (listen/nonblock_connect/timeouts) =====
-// 非阻塞連線：搭配 select 實作連線逾時
+// ===== 時間與 deadline =====
+int64_t mono_now_ms(void) {
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts); // vDSO，不進 kernel
+    return (int64_t)ts.tv_sec*1000 + ts.tv_nsec/1000000;
+}
+int64_t mono_now_ns(void) {
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+int64_t deadline_after(int timeout_ms) {
+    if (!ROBUST_ON(enable_timeouts) || timeout_ms < 0) return -1; // 未啟用逾時：無 deadline
+    return mono_now_ms() + timeout_ms;
+}
+// 以 poll 等待 fd 事件直到 deadline；回傳 1 就緒、0 逾時或錯誤 (errno 已設定)
+// poll 沒有 FD_SETSIZE 限制，fd 編號超過 1023 也安全
+static int wait_fd(int fd, short events, int64_t deadline) {
+    for (;;) {
+        int tmo = -1;
+        if (deadline >= 0) {
+            int64_t left = deadline - mono_now_ms();
+            if (left <= 0) { errno = ETIMEDOUT; return 0; }
+            tmo = left > 0x7fffffff ? 0x7fffffff : (int)left;
+        }
+        struct pollfd pfd = { .fd = fd, .events = events };
+        int rc = poll(&pfd, 1, tmo);
+        if (rc > 0) return 1;   // 含 POLLERR/POLLHUP：交給接下來的 I/O 回報錯誤
+        if (rc == 0) { errno = ETIMEDOUT; return 0; }
+        if (errno != EINTR) return 0;
+    }
+}
+// 非阻塞連線：搭配 poll 實作連線逾時
 static int nonblock_connect(int fd, const struct sockaddr *sa, socklen_t salen, int timeout_ms) {
     int rc = connect(fd, sa, salen); // 嘗試立即連線
     if (rc == 0) return 0;           // 立刻成功則回傳 0
     if (errno != EINPROGRESS) return -1; // 若不是進行中錯誤則失敗
 
-    fd_set wfds; FD_ZERO(&wfds); FD_SET(fd, &wfds); // 設定寫入等待集合（連線完成會變可寫）
-    struct timeval tv = { .tv_sec = timeout_ms/1000, .tv_usec = (timeout_ms%1000)*1000 };
-    rc = select(fd+1, NULL, &wfds, NULL, &tv); // 等待可寫或逾時
-    if (rc <= 0) { errno = (rc==0) ? ETIMEDOUT : errno; return -1; } // 逾時或 select 出錯
+    // 等待可寫（連線完成會變可寫）或逾時；connect 逾時不受 enable_timeouts 影響
+    if (!wait_fd(fd, POLLOUT, mono_now_ms() + timeout_ms)) return -1;
     int err=0; socklen_t len=sizeof err; if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len)<0) return -1; // 取得 SO_ERROR
     if (err) { errno = err; return -1; }
     return 0;
@@ -114,6 +129,105 @@ int set_timeouts(int fd, int rcv_ms, int snd_ms) {
     if (setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &snd, sizeof snd) < 0) return -1; // 設定送出逾時
     return 0; // 成功
 }
+// ===== socket 選項設定檔 =====
+struct sock_opts g_sockopt = { .backlog = 128 };
+
+int sockopt_parse(const char *spec) {
+    char buf[256];
+    if (!spec || strlen(spec) >= sizeof buf) { errno = EINVAL; return -1; }
+    strcpy(buf, spec);
+    for (char *save = NULL, *tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        char *eq = strchr(tok, '=');
+        int v = 1;
+        if (eq) { *eq = '\0'; char *end; long l = strtol(eq+1, &end, 10); if (*end || l < 0 || l > 0x7fffffff) { errno = EINVAL; return -1; } v = (int)l; }
+        if (!strcmp(tok, "lowlat")) { g_sockopt.nodelay = 1; g_sockopt.quickack = 1; g_sockopt.busy_poll = 50; } // 低延遲預設組合
+        else if (!strcmp(tok, "nodelay")) g_sockopt.nodelay = v;
+        else if (!strcmp(tok, "quickack")) g_sockopt.quickack = v;
+        else if (!strcmp(tok, "rcvbuf")) g_sockopt.rcvbuf = v;
+        else if (!strcmp(tok, "sndbuf")) g_sockopt.sndbuf = v;
+        else if (!strcmp(tok, "defer_accept")) g_sockopt.defer_accept = v;
+        else if (!strcmp(tok, "fastopen")) g_sockopt.fastopen = eq ? v : 256;
+        else if (!strcmp(tok, "busy_poll")) g_sockopt.busy_poll = v;
+        else if (!strcmp(tok, "backlog") && v > 0) g_sockopt.backlog = v;
+        else if (!strcmp(tok, "reuseport")) g_sockopt.reuseport = v;
+        else { errno = EINVAL; return -1; }
+    }
+    return 0;
+}
+
+// 設定失敗 (例如 kernel 不支援、權限不足) 只警告，不影響連線
+static void try_opt(int fd, int level, int name, int val, const char *what) {
+    if (setsockopt(fd, level, name, &val, sizeof val) < 0) LOGW("setsockopt %s=%d: %s", what, val, strerror(errno));
+}
+// 緩衝區大小需在 listen()/connect() 之前設定，才會影響 TCP window scaling
+static void sockopt_apply_bufs(int fd) {
+    if (g_sockopt.rcvbuf) try_opt(fd, SOL_SOCKET, SO_RCVBUF, g_sockopt.rcvbuf, "SO_RCVBUF");
+    if (g_sockopt.sndbuf) try_opt(fd, SOL_SOCKET, SO_SNDBUF, g_sockopt.sndbuf, "SO_SNDBUF");
+    if (g_sockopt.busy_poll) try_opt(fd, SOL_SOCKET, SO_BUSY_POLL, g_sockopt.busy_poll, "SO_BUSY_POLL");
+}
+// AF_UNIX 連線沒有 TCP 層，TCP_* 選項會失敗；只在有設定時才多一次 getsockopt 確認
+static int sock_is_tcp(int fd) {
+    int dom = 0; socklen_t dl = sizeof dom;
+    if (getsockopt(fd, SOL_SOCKET, SO_DOMAIN, &dom, &dl) < 0) return 1;
+    return dom == AF_INET || dom == AF_INET6;
+}
+int sockopt_apply_conn(int fd) {
+    if ((g_sockopt.nodelay || g_sockopt.quickack) && !sock_is_tcp(fd)) return 0;
+    if (g_sockopt.nodelay) try_opt(fd, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+    if (g_sockopt.quickack) try_opt(fd, IPPROTO_TCP, TCP_QUICKACK, 1, "TCP_QUICKACK");
+    if (g_sockopt.busy_poll) try_opt(fd, SOL_SOCKET, SO_BUSY_POLL, g_sockopt.busy_poll, "SO_BUSY_POLL");
+    return 0;
+}
+
+int reuseport_attach_cpu_bpf(int lfd, int n) {
+    if (n <= 0) { errno = EINVAL; return -1; }
+    struct sock_filter code[] = {
+        { BPF_LD  | BPF_W | BPF_ABS, 0, 0, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU) }, // A = 目前處理封包的 CPU
+        { BPF_ALU | BPF_MOD | BPF_K, 0, 0, (uint32_t)n },                        // A %= n
+        { BPF_RET | BPF_A, 0, 0, 0 },                                             // 回傳 listener 編號
+    };
+    struct sock_fprog prog = { .len = sizeof code / sizeof code[0], .filter = code };
+    return setsockopt(lfd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof prog);
+}
+
+// ===== 批次 accept =====
+int listen_queue_depth(int lfd, uint32_t *qlen, uint32_t *backlog) {
+    struct tcp_info ti; socklen_t tl = sizeof ti;
+    if (getsockopt(lfd, IPPROTO_TCP, TCP_INFO, &ti, &tl) < 0) return -1;
+    // LISTEN 狀態的 socket：tcpi_unacked = 目前佇列長度，tcpi_sacked = backlog
+    if (qlen) *qlen = ti.tcpi_unacked;
+    if (backlog) *backlog = ti.tcpi_sacked;
+    return 0;
+}
+
+int accept_batch(int lfd, int *fds, int max, int flags, struct accept_stats *st) {
+    int n = 0;
+    while (n < max) {
+        int fd = accept4(lfd, NULL, NULL, flags);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            if (n == 0) return -1;
+            break;   // 已取到的先交給呼叫端，錯誤下一次再回報
+        }
+        fds[n++] = fd;
+    }
+    for (int i=0;i<n;i++) TRACE(ACCEPT, fds[i], n);
+    if (st && n > 0) {
+        st->accepted += (uint64_t)n; st->batches++;
+        if ((uint32_t)n > st->max_batch) st->max_batch = (uint32_t)n;
+        // 佇列已取空時醒來的深度就是 n；取滿 max 才需要多一次 syscall 看剩下多少
+        uint32_t q = (uint32_t)n, rest = 0, bl = st->backlog;
+        if ((n == max || !bl) && listen_queue_depth(lfd, &rest, &bl) == 0) {
+            st->backlog = bl;
+            if (n == max) q += rest;
+        }
+        if (q > st->max_qlen) st->max_qlen = q;
+        if (bl && q >= bl - bl/4) st->near_full++;
+    }
+    return n;
+}
+
 // 建立監聽 socket（支援 IPv4/IPv6，host 可為 NULL 代表 ANY）
 int tcp_listen(const char *host, const char *port, int backlog) {
     struct addrinfo hints = {0}, *res, *rp; int fd=-1;  // hints 初始化為 0；迭代位址結果
@@ -125,6 +239,11 @@ int tcp_listen(const char *host, const char *port, int backlog) {
         if (fd<0) continue; // 建立失敗換下一個
         int on=1; setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on); // 允許重用位址
         set_cloexec(fd);   // 設定 close-on-exec
+        if (g_sockopt.reuseport && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof on) < 0) { close(fd); fd=-1; continue; }
+        sockopt_apply_bufs(fd);   // accept 出來的連線會繼承緩衝區大小
+        if (g_sockopt.nodelay) try_opt(fd, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+        if (g_sockopt.defer_accept) try_opt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, g_sockopt.defer_accept, "TCP_DEFER_ACCEPT"); // 有資料才喚醒 accept
+        if (g_sockopt.fastopen) try_opt(fd, IPPROTO_TCP, TCP_FASTOPEN, g_sockopt.fastopen, "TCP_FASTOPEN");
         if (bind(fd, rp->ai_addr, rp->ai_addrlen)==0) { // 綁定成功
             if (listen(fd, backlog)==0) break;          // listen 成功則跳出
         }
@@ -135,134 +254,626 @@ int tcp_listen(const char *host, const char *port, int backlog) {
     ignore_pipe();
     return fd; // 回傳監聽 socket fd
 }
-// 連線到遠端（含連線逾時、回復阻塞模式）
+// 連線到一個已解析的位址（含連線逾時、回復阻塞模式）
+int tcp_connect_addr(const struct sockaddr *sa, socklen_t salen, int timeout_ms) {
+    int fd = socket(sa->sa_family, SOCK_STREAM, 0);  // 建立 socket
+    if (fd<0) return -1;
+    set_cloexec(fd);             // 設定 close-on-exec
+    sockopt_apply_bufs(fd);
+    if (g_sockopt.fastopen) try_opt(fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, 1, "TCP_FASTOPEN_CONNECT"); // SYN 隨第一筆資料送出
+    set_nonblock(fd, 1);         // 先設為非阻塞以便自訂逾時
+    if (nonblock_connect(fd, sa, salen, timeout_ms)<0) { int e=errno; close(fd); errno=e; return -1; }
+    set_nonblock(fd, 0);         // 回復阻塞模式
+    sockopt_apply_conn(fd);
+    ignore_pipe();
+    return fd;
+}
+// 連線到遠端：解析後逐一嘗試候選位址
 int tcp_connect(const char *host, const char *port, int timeout_ms) {
     struct addrinfo hints = {0}, *res, *rp; int fd=-1;           // 準備解析參數
     hints.ai_family = AF_UNSPEC; hints.ai_socktype = SOCK_STREAM;  // IPv4/IPv6、TCP
     int rc = getaddrinfo(host, port, &hints, &res);                // 解析位址/埠
     if (rc) { LOGE("getaddrinfo: %s", gai_strerror(rc)); return -1; }
-    for (rp=res; rp; rp=rp->ai_next) {                          // 逐一嘗試候選位址
-        fd = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);  // 建立 socket
-        if (fd<0) continue;          // 建立失敗換下一個     
-        set_cloexec(fd);             // 設定 close-on-exec  
-        set_nonblock(fd, 1);         // 先設為非阻塞以便自訂逾時
-        if (nonblock_connect(fd, rp->ai_addr, rp->ai_addrlen, timeout_ms)==0) { // 連線成功
-            set_nonblock(fd, 0);     // 回復阻塞模式
-            break;                   
-        }
-        close(fd); fd=-1;
-    }
+    for (rp=res; rp && fd<0; rp=rp->ai_next)                    // 逐一嘗試候選位址
+        fd = tcp_connect_addr(rp->ai_addr, rp->ai_addrlen, timeout_ms);
     freeaddrinfo(res);               // 釋放位址資訊
-    if (fd<0) return -1;
-    ignore_pipe();
     return fd;  // 回傳連線 socket fd
 }
+// ===== AF_UNIX (同主機) =====
+// path 以 '@' 開頭時使用 abstract namespace (不在檔案系統留下 socket 檔)
+static int unix_addr(const char *path, struct sockaddr_un *sa, socklen_t *len) {
+    size_t n = path ? strlen(path) : 0;
+    if (!n || n >= sizeof sa->sun_path) { errno = n ? ENAMETOOLONG : EINVAL; return -1; }
+    memset(sa, 0, sizeof *sa);
+    sa->sun_family = AF_UNIX;
+    memcpy(sa->sun_path, path, n);
+    if (path[0] == '@') sa->sun_path[0] = '\0';
+    *len = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + n + (path[0] != '@'));
+    return 0;
+}
+
+int unix_listen(const char *path, int backlog) {
+    struct sockaddr_un sa; socklen_t len;
+    if (unix_addr(path, &sa, &len) < 0) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    sockopt_apply_bufs(fd);
+    // 前一次執行留下的 socket 檔才刪除，不會誤刪同名的一般檔案
+    struct stat st;
+    if (path[0] != '@' && lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);
+    if (bind(fd, (struct sockaddr*)&sa, len) < 0 || listen(fd, backlog) < 0) {
+        int e = errno; close(fd); errno = e; return -1;
+    }
+    ignore_pipe();
+    return fd;
+}
+
+int unix_connect(const char *path, int timeout_ms) {
+    struct sockaddr_un sa; socklen_t len;
+    if (unix_addr(path, &sa, &len) < 0) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    sockopt_apply_bufs(fd);
+    // listener 的 backlog 滿時 connect 會阻塞，最多等 SO_SNDTIMEO
+    if (timeout_ms > 0) set_timeouts(fd, 0, timeout_ms);
+    int rc;
+    do rc = connect(fd, (struct sockaddr*)&sa, len); while (rc < 0 && errno == EINTR);
+    if (rc < 0) { int e = errno == EAGAIN ? ETIMEDOUT : errno; close(fd); errno = e; return -1; }
+    if (timeout_ms > 0) set_timeouts(fd, 0, 0);
+    ignore_pipe();
+    return fd;
+}
 // ===== robust I/O =====
-static int wait_io(int fd, int write_mode, int timeout_ms) {    // 依模式等待可讀/可寫
-    if (!g_robust.enable_timeouts) return 1; // 若未啟用逾時，直接回傳
-    fd_set rfds, wfds; FD_ZERO(&rfds); FD_ZERO(&wfds); // 清空集合
-    if (write_mode) FD_SET(fd, &wfds); else FD_SET(fd, &rfds); // 根據模式加入對應集合
-    struct timeval tv = { .tv_sec = timeout_ms/1000, .tv_usec = (timeout_ms%1000)*1000 }; // 準備逾時時間
-    int rc = select(fd+1, write_mode?NULL:&rfds, write_mode?&wfds:NULL, NULL, &tv); // 等待事件或逾時
-    if (rc <= 0) { errno = (rc==0)? ETIMEDOUT : errno; return 0; }  // 逾時或 select 出錯
-    return 1;   // 成功進行 I/O
-}
-// 讀取固定 n 位元組（含逾時與 EINTR 處理)  
-ssize_t readn_timeout(int fd, void *buf, size_t n, int timeout_ms) {
-    size_t off=0; char *p=(char*)buf;   // 已讀位移與緩衝區指標
+// 先直接嘗試 non-blocking I/O，只有在 EAGAIN 時才 poll 等待；
+// 整個 frame 共用同一個 deadline，不會每個 chunk 重新計時。
+// 非 socket (pipe/檔案) 無法用 MSG_DONTWAIT，改為先等待再讀寫。
+static ssize_t io_once(int fd, void *p, size_t n, int write_mode, int *notsock) {
+    if (!*notsock) {
+        ssize_t r = write_mode ? send(fd, p, n, MSG_DONTWAIT) : recv(fd, p, n, MSG_DONTWAIT);
+        if (r >= 0 || errno != ENOTSOCK) return r;
+        *notsock = 1;
+    }
+    errno = EAGAIN; // 交給呼叫端先 wait 再做阻塞 I/O
+    return -1;
+}
+
+// 讀取固定 n 位元組，直到 deadline（-1 = 不限時）
+ssize_t readn_deadline(int fd, void *buf, size_t n, int64_t deadline) {
+    size_t off=0; char *p=(char*)buf; int notsock=0;   // 已讀位移與緩衝區指標
     while (off < n) {                   // 直到讀滿 n 位元組
-        if (!wait_io(fd, 0, timeout_ms)) return -1; // 等待可讀（可能逾時）
-        ssize_t r = read(fd, p+off, n-off); // 讀取資料
+        ssize_t r;
+        if (deadline < 0) r = read(fd, p+off, n-off);  // 未啟用逾時：直接阻塞讀取
+        else {
+            r = io_once(fd, p+off, n-off, 0, &notsock);
+            if (r < 0 && (errno==EAGAIN || errno==EWOULDBLOCK)) {
+                if (!wait_fd(fd, POLLIN, deadline)) return -1; // 等待可讀（可能逾時）
+                if (notsock) r = read(fd, p+off, n-off);
+                else continue;
+            }
+        }
         if (r == 0) { errno = ECONNRESET; return -1; }
         if (r < 0) { if (errno==EINTR) continue; return -1; }
         off += (size_t)r;           // 累積已讀位移
     }
     return (ssize_t)off; // 回傳成功總讀取量
 }
-// 寫出固定 n 位元組（含逾時與 EINTR 處理）
-ssize_t writen_timeout(int fd, const void *buf, size_t n, int timeout_ms) {
-    size_t off=0; const char *p=(const char*)buf;
+// 寫出固定 n 位元組，直到 deadline（-1 = 不限時）
+ssize_t writen_deadline(int fd, const void *buf, size_t n, int64_t deadline) {
+    size_t off=0; char *p=(char*)(uintptr_t)buf; int notsock=0;
     while (off < n) {       // 直到寫完 n 位元組
-        if (!wait_io(fd, 1, timeout_ms)) return -1; // 等待可寫（可能逾時）
-        ssize_t r = write(fd, p+off, n-off);    // 寫出資料
+        ssize_t r;
+        if (deadline < 0) r = write(fd, p+off, n-off);
+        else {
+            r = io_once(fd, p+off, n-off, 1, &notsock);
+            if (r < 0 && (errno==EAGAIN || errno==EWOULDBLOCK)) {
+                if (!wait_fd(fd, POLLOUT, deadline)) return -1; // 等待可寫（可能逾時）
+                if (notsock) r = write(fd, p+off, n-off);
+                else continue;
+            }
+        }
         if (r <= 0) { if (r<0 && errno==EINTR) continue; return -1; }
         off += (size_t)r;        // 累積已寫位移
     }
     return (ssize_t)off;    // 回傳成功總寫出量
 }
-// 驗證 header 
-static int validate_hdr(const struct msg_hdr *h) {
-    if (!g_robust.validate_headers) return 1;
-    if (ntohl(h->magic) != MSG_MAGIC) return 0; // magic 不符
-    uint16_t t = ntohs(h->type);
-    if (!(t==REQ_PING || t==RESP_PING || t==REQ_SYSINFO || t==RESP_SYSINFO || t==REQ_ECHO || t==RESP_ECHO || t==RESP_ERROR))
-        return 0;
-    uint32_t len = ntohl(h->length); // 讀取 payload 長度
-    if (len > (32*1024*1024)) return 0; // 超過 32MiB 上限視為不合法
-    return 1;
+// 讀取/寫出固定 n 位元組（單次呼叫的逾時）
+ssize_t readn_timeout(int fd, void *buf, size_t n, int timeout_ms) {
+    return readn_deadline(fd, buf, n, deadline_after(timeout_ms));
 }
-// 傳送一個 frame（先送 header，再送 payload）
-int send_frame(int fd, uint16_t type, const void *payload, uint32_t len, int timeout_ms) {
-    struct msg_hdr h = { htonl(MSG_MAGIC), htons(type), htons(0), htonl(len) }; // 準備網路位元序標頭
-    if (writen_timeout(fd, &h, sizeof h, timeout_ms) < 0) return -1; // 送出標頭
-    if (len && payload) {   // 有 payload 再送出資料
-        if (writen_timeout(fd, payload, len, timeout_ms) < 0) return -1;
+ssize_t writen_timeout(int fd, const void *buf, size_t n, int timeout_ms) {
+    return writen_deadline(fd, buf, n, deadline_after(timeout_ms));
+}
+// ===== 訊息型別表 =====
+// header 前 8 bytes (magic / type / flags，網路位元序) 以一次 64 位元 load 讀入 w 後：
+//   (w & HDR_KEY_MASK) == HDR_KEY   magic 正確且 type < 256 (type 高位元組為 0)，一次比較
+//   HDR_TYPE(w)                     型別表索引
+//   w & HDR_TEST & ~accept          非 0 = 含該型別不允許的旗標，或型別未定義
+//                                   (未定義型別的 accept 為 0，HDR_TEST 中必定為 1 的 magic 位元使檢查失敗)
+// 之後只剩 length 與該型別上限的比較。
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+# define HDR_KEY_MASK      0x000000ffffffffffull
+# define HDR_KEY           ((uint64_t)__builtin_bswap32(MSG_MAGIC))
+# define HDR_TYPE(w)       ((unsigned)((w) >> 40) & 0xffu)
+# define HDR_FLAGS_RAW(f)  ((uint64_t)__builtin_bswap16((uint16_t)(f)) << 48)
+# define HDR_MAGIC_BIT     0x1ull            // magic 第 0 byte (0x43) 的最低位元
+#else
+# define HDR_KEY_MASK      0xffffffffff000000ull
+# define HDR_KEY           ((uint64_t)MSG_MAGIC << 32)
+# define HDR_TYPE(w)       ((unsigned)((w) >> 16) & 0xffu)
+# define HDR_FLAGS_RAW(f)  ((uint64_t)(uint16_t)(f))
+# define HDR_MAGIC_BIT     (1ull << 32)      // magic 第 3 byte (0x31) 的最低位元
+#endif
+#define HDR_TEST           (HDR_FLAGS_RAW(0xffffu) | HDR_MAGIC_BIT)
+#define HDR_ACCEPT(fl)     (HDR_FLAGS_RAW(fl) | HDR_MAGIC_BIT)
+
+struct msg_type_info {
+    uint64_t accept;     // w 中 HDR_TEST 範圍內允許為 1 的位元 (0 = 未定義)
+    uint32_t max_len;    // payload 上限
+    uint16_t flags;      // 允許的 MSG_F_* 位元
+    uint16_t defined;
+};
+#define MT(max, fl) { HDR_ACCEPT((fl) | MSG_F_XPORT), (max), (fl) | MSG_F_XPORT, 1 }   // 壓縮位元所有型別都允許
+static struct msg_type_info g_msg_types[MSG_TYPE_MAX] = {
+    [REQ_PING]         = MT(FRAME_MAX_LEN, 0), [RESP_PING]        = MT(FRAME_MAX_LEN, 0),
+    [REQ_SYSINFO]      = MT(FRAME_MAX_LEN, 0), [RESP_SYSINFO]     = MT(FRAME_MAX_LEN, 0),
+    [REQ_SYSINFO_BIN]  = MT(FRAME_MAX_LEN, 0), [RESP_SYSINFO_BIN] = MT(FRAME_MAX_LEN, 0),
+    [REQ_ECHO]         = MT(FRAME_MAX_LEN, MSG_F_MORE), [RESP_ECHO] = MT(FRAME_MAX_LEN, MSG_F_MORE),
+    [REQ_STATS]        = MT(FRAME_MAX_LEN, 0), [RESP_STATS]       = MT(FRAME_MAX_LEN, 0),
+    [RESP_ERROR]       = MT(FRAME_MAX_LEN, 0),
+};
+
+int msg_type_register(uint16_t type, uint32_t max_len, uint16_t allowed_flags) {
+    if (type >= MSG_TYPE_MAX || max_len > FRAME_MAX_LEN || (allowed_flags & ~MSG_F_KNOWN)) { errno = EINVAL; return -1; }
+    g_msg_types[type] = (struct msg_type_info)MT(max_len, allowed_flags);
+    return 0;
+}
+#undef MT
+int msg_type_known(uint16_t type) { return type < MSG_TYPE_MAX && g_msg_types[type].defined; }
+
+static struct msg_type_info g_msg_types_saved[MSG_TYPE_MAX];
+static int g_msg_types_have_saved = 0;
+void msg_types_checkpoint(void) { memcpy(g_msg_types_saved, g_msg_types, sizeof g_msg_types); g_msg_types_have_saved = 1; }
+void msg_types_rollback(void) { if (g_msg_types_have_saved) memcpy(g_msg_types, g_msg_types_saved, sizeof g_msg_types); }
+
+// 驗證 header (見型別表前的說明)；函式庫內部直接 inline，不經過 PLT
+static inline int hdr_valid(const struct msg_hdr *h) {
+    if (!ROBUST_ON(validate_headers)) return 1;
+    uint64_t w; memcpy(&w, h, sizeof w);
+    if ((w & HDR_KEY_MASK) != HDR_KEY) return 0;
+    const struct msg_type_info *mi = &g_msg_types[HDR_TYPE(w)];
+    return !(w & HDR_TEST & ~mi->accept) && ntohl(h->length) <= mi->max_len;
+}
+int frame_validate_hdr(const struct msg_hdr *h) { return hdr_valid(h); }
+// ===== 單一 syscall 送出 frame (writev/sendmsg) 與 MSG_ZEROCOPY =====
+static uint32_t g_zc_min = 0; // payload >= 此大小時走 MSG_ZEROCOPY (0 = 停用)
+
+void frame_set_zerocopy_min(uint32_t bytes) { g_zc_min = bytes; }
+
+int sock_enable_zerocopy(int fd) {
+    int on = 1;
+    return setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof on);
+}
+
+// 等待 MSG_ZEROCOPY 完成通知，直到累計 want 次 sendmsg 都已由 kernel 釋放 buffer；
+// 回傳 0 成功，-1 逾時或錯誤。完成前 caller 不可修改/釋放 payload。
+static int zc_wait_completions(int fd, unsigned want, int64_t deadline) {
+    unsigned done = 0;
+    while (done < want) {
+        char ctrl[128];
+        struct msghdr m = { .msg_control = ctrl, .msg_controllen = sizeof ctrl };
+        ssize_t r = recvmsg(fd, &m, MSG_ERRQUEUE | MSG_DONTWAIT);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) return -1;
+            if (!wait_fd(fd, 0, deadline)) return -1; // POLLERR 一定會回報，不需指定事件
+            continue;
+        }
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&m); cm; cm = CMSG_NXTHDR(&m, cm)) {
+            struct sock_extended_err *ee = (struct sock_extended_err*)CMSG_DATA(cm);
+            if (ee->ee_errno != 0 || ee->ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+            done += ee->ee_data - ee->ee_info + 1; // [ee_info, ee_data] 區間的 send 已完成
+            if (ee->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) LOGD("zerocopy fell back to copy on fd=%d", fd);
+        }
     }
     return 0;
 }
+
+// 以 sendmsg/writev 寫出整個 iovec（會修改 iov 內容），直到 deadline
+static ssize_t writev_deadline(int fd, struct iovec *iov, int cnt, int64_t deadline, int zerocopy) {
+    size_t total = 0; unsigned zc_sends = 0; int notsock = 0;
+    while (cnt > 0) {
+        ssize_t r;
+        if (notsock) {
+            if (deadline >= 0 && !wait_fd(fd, POLLOUT, deadline)) return -1;
+            r = writev(fd, iov, cnt);
+        } else {
+            struct msghdr m = { .msg_iov = iov, .msg_iovlen = (size_t)cnt };
+            r = sendmsg(fd, &m, (deadline >= 0 ? MSG_DONTWAIT : 0) | (zerocopy ? MSG_ZEROCOPY : 0));
+        }
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            if (errno == ENOTSOCK && !notsock) { notsock = 1; zerocopy = 0; continue; }
+            if (zerocopy && (errno == ENOBUFS || errno == EINVAL || errno == EOPNOTSUPP)) { zerocopy = 0; continue; } // 未啟用或超過 optmem：改走一般複製
+            if (deadline >= 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                if (!wait_fd(fd, POLLOUT, deadline)) return -1; // 等待可寫（可能逾時）
+                continue;
+            }
+            return -1;
+        }
+        if (zerocopy) zc_sends++;
+        total += (size_t)r;
+        while (cnt > 0 && (size_t)r >= iov->iov_len) { r -= (ssize_t)iov->iov_len; iov++; cnt--; } // 跳過已送完的片段
+        if (cnt > 0) { iov->iov_base = (char*)iov->iov_base + r; iov->iov_len -= (size_t)r; }
+    }
+    if (zc_sends && zc_wait_completions(fd, zc_sends, deadline) < 0) return -1;
+    return (ssize_t)total;
+}
+
+// ===== payload 壓縮 (MSG_F_LZ4 / MSG_F_ZSTD) =====
+// 壓縮後的 payload = 4 bytes 原始長度 + codec 輸出；暫存區都向緩衝區池借，送完/解完即歸還
+#define COMP_HDR 4
+static uint32_t g_comp_min = 512;   // payload 小於此大小時不壓縮
+static int g_zstd_level = 3;
+
+void frame_set_comp_min(uint32_t bytes) { g_comp_min = bytes; }
+void frame_set_zstd_level(int level) { g_zstd_level = level; }
+
+uint16_t frame_comp_accept(void) {
+    return (uint16_t)(MSG_F_ACCEPT_LZ4 | (comp_supported(MSG_F_ZSTD) ? MSG_F_ACCEPT_ZSTD : 0));
+}
+uint16_t frame_comp_choose(uint16_t req_flags) {
+    if ((req_flags & MSG_F_ACCEPT_ZSTD) && comp_supported(MSG_F_ZSTD)) return MSG_F_ZSTD;
+    return (req_flags & MSG_F_ACCEPT_LZ4) ? MSG_F_LZ4 : 0;
+}
+
+void frame_compress(uint16_t *flags, const void **payload, uint32_t *len, void **tmp) {
+    uint16_t want = *flags & MSG_F_COMP;
+    uint16_t codec = (want & MSG_F_ZSTD) && comp_supported(MSG_F_ZSTD) ? MSG_F_ZSTD : (want & MSG_F_LZ4);
+    *flags &= (uint16_t)~MSG_F_COMP;
+    *tmp = NULL;
+    if (!codec || !*payload || *len < g_comp_min || *len < COMP_HDR * 2) return;
+    size_t cap, bound = COMP_HDR + comp_bound(codec, *len);
+    char *zb = pool_get(bound, &cap);
+    if (!zb) return;   // 記憶體不足就不壓縮，照原樣送出
+    // 只接受壓縮後至少省下 1/16 的結果，否則接收端解壓的成本不值得
+    size_t lim = *len - *len / 16 - COMP_HDR;
+    size_t n = comp_encode(codec, g_zstd_level, *payload, *len, zb + COMP_HDR, cap - COMP_HDR < lim ? cap - COMP_HDR : lim);
+    if (!n) { pool_put(zb); return; }
+    uint32_t raw = htonl(*len);
+    memcpy(zb, &raw, COMP_HDR);
+    *flags |= codec;
+    *payload = zb; *len = (uint32_t)(COMP_HDR + n); *tmp = zb;
+}
+
+// 檢查壓縮 frame 開頭的原始長度 (不超過該型別的上限)；回傳原始長度，-1 = 不合法 (EPROTO)
+static long frame_raw_len(const struct msg_hdr *h, const void *p, uint32_t n) {
+    uint16_t codec = ntohs(h->flags) & MSG_F_COMP, type = ntohs(h->type);
+    uint32_t raw;
+    // 關閉 validate_headers 時 hdr_valid 不看 type，查型別表前要自己檢查範圍
+    if (!msg_type_known(type)) { errno = EPROTO; return -1; }
+    if (n < COMP_HDR || (codec != MSG_F_LZ4 && codec != MSG_F_ZSTD)) { errno = EPROTO; return -1; }
+    memcpy(&raw, p, COMP_HDR); raw = ntohl(raw);
+    if (raw > g_msg_types[type].max_len) { errno = EPROTO; return -1; }
+    return raw;
+}
+// 解開到 dst (至少 raw bytes)，成功時把 h 改寫成原始 frame 的 header
+static int frame_inflate(struct msg_hdr *h, const void *p, uint32_t n, void *dst, uint32_t raw) {
+    uint16_t fl = ntohs(h->flags);
+    long r = comp_decode(fl & MSG_F_COMP, (const char *)p + COMP_HDR, n - COMP_HDR, dst, raw);
+    if (r != (long)raw) { if (r >= 0) errno = EPROTO; return -1; }   // r < 0 時 comp_decode 已設 errno
+    h->flags = htons((uint16_t)(fl & ~MSG_F_COMP));
+    h->length = htonl(raw);
+    return 0;
+}
+
+// 傳送一個 frame：header 與 payload 合併成一次 writev/sendmsg，避免拆成兩個封包
+int send_frame(int fd, uint16_t type, const void *payload, uint32_t len, int timeout_ms) {
+    return send_frame_flags(fd, type, 0, payload, len, timeout_ms);
+}
+int send_frame_flags(int fd, uint16_t type, uint16_t flags, const void *payload, uint32_t len, int timeout_ms) {
+    void *zb = NULL;
+    if (flags & MSG_F_COMP) frame_compress(&flags, &payload, &len, &zb);
+    struct msg_hdr h = { htonl(MSG_MAGIC), htons(type), htons(flags), htonl(len) }; // 準備網路位元序標頭
+    int64_t dl = deadline_after(timeout_ms); // header 與 payload 共用 deadline
+    struct iovec iov[2] = { { &h, sizeof h }, { (void*)(uintptr_t)payload, len } };
+    int cnt = (len && payload) ? 2 : 1;   // 有 payload 才加入第二段
+    int zc = g_zc_min && cnt == 2 && len >= g_zc_min;
+    TRACE(SEND, type, len);
+    ssize_t r = writev_deadline(fd, iov, cnt, dl, zc);
+    pool_put(zb);   // zerocopy 時 writev_deadline 已等到完成通知
+    return r < 0 ? -1 : 0;
+}
 // 接收一個 frame（讀 header → 驗證 → 讀 payload）
-int recv_frame(int fd, struct msg_hdr *hdr_out, void **payload_out, uint32_t *len_out, int timeout_ms) {
+// pooled = 1 時 payload 由緩衝區池配置 (frame_free 歸還)，0 時以 malloc 配置 (呼叫端 free)；
+// 壓縮資料的暫存區一律向緩衝區池借用，解開後隨即歸還
+static void *payload_alloc(size_t n, int pooled) { return pooled ? pool_get(n, NULL) : malloc(n); }
+static void payload_release(void *p, int pooled) { if (pooled) pool_put(p); else free(p); }
+
+static int recv_frame_as(int fd, struct msg_hdr *hdr_out, void **payload_out, uint32_t *len_out, int timeout_ms, int pooled) {
     struct msg_hdr h;   // 暫存標頭
-    if (readn_timeout(fd, &h, sizeof h, timeout_ms) < 0) return -1; // 讀取固定 12 bytes 標頭
-    if (!validate_hdr(&h)) { errno = EPROTO; return -1; } // 標頭驗證失敗
+    int64_t dl = deadline_after(timeout_ms); // header 與 payload 共用 deadline
+    if (readn_deadline(fd, &h, sizeof h, dl) < 0) return -1; // 讀取固定 12 bytes 標頭
+    if (!hdr_valid(&h)) { errno = EPROTO; return -1; } // 標頭驗證失敗
     uint32_t len = ntohl(h.length); // 取得負載長度
+    int comp = (ntohs(h.flags) & MSG_F_COMP) != 0;
+    int wire_pooled = comp || pooled;   // 壓縮資料只是暫存，一律用池
     void *buf = NULL;   // 預設無 payload
     if (len) { // 若有 payload 則配置記憶體並讀取
-        buf = malloc(len);
+        buf = payload_alloc(len, wire_pooled);
         if (!buf) return -1;
-        if (readn_timeout(fd, buf, len, timeout_ms) < 0) { free(buf); return -1; }
+        if (readn_deadline(fd, buf, len, dl) < 0) { payload_release(buf, wire_pooled); return -1; }
+    }
+    if (comp) {   // 解開到呼叫端要的記憶體，壓縮資料隨即歸還
+        long raw = frame_raw_len(&h, buf, len);
+        void *out = raw > 0 ? payload_alloc((size_t)raw, pooled) : NULL;
+        if (raw < 0 || (raw > 0 && !out) || frame_inflate(&h, buf, len, out, (uint32_t)raw) < 0) {
+            int e = errno; payload_release(out, pooled); pool_put(buf); errno = e; return -1;
+        }
+        pool_put(buf);
+        buf = out; len = (uint32_t)raw;
     }
     if (hdr_out) *hdr_out = h;  // 回傳標頭（網路位元序一樣）
     if (payload_out) {
         *payload_out = buf;
     } else {
-        free(buf);
-    } 
+        payload_release(buf, pooled);
+    }
     if (len_out) *len_out = len; // 回傳長度
+    TRACE(RECV, ntohs(h.type), len);
     return 0;
 }
+int recv_frame(int fd, struct msg_hdr *hdr_out, void **payload_out, uint32_t *len_out, int timeout_ms) {
+    return recv_frame_as(fd, hdr_out, payload_out, len_out, timeout_ms, 0);
+}
+int recv_frame_pooled(int fd, struct msg_hdr *hdr_out, void **payload_out, uint32_t *len_out, int timeout_ms) {
+    return recv_frame_as(fd, hdr_out, payload_out, len_out, timeout_ms, 1);
+}
+// 接收一個 chunk 到固定大小的緩衝區：每條連線的記憶體用量只跟 chunk 大小有關
+int recv_chunk(int fd, struct msg_hdr *hdr_out, void *buf, uint32_t cap, uint32_t *len_out, int timeout_ms) {
+    struct msg_hdr h;
+    int64_t dl = deadline_after(timeout_ms);
+    if (readn_deadline(fd, &h, sizeof h, dl) < 0) return -1;
+    if (!hdr_valid(&h)) { errno = EPROTO; return -1; }
+    uint32_t len = ntohl(h.length);
+    if (ntohs(h.flags) & MSG_F_COMP) {   // 壓縮資料先讀進暫存區，再解到呼叫端的緩衝區
+        char *zb = len ? pool_get(len, NULL) : NULL;
+        if (len && !zb) return -1;
+        long raw = -1;
+        if (readn_deadline(fd, zb, len, dl) == (ssize_t)len && (raw = frame_raw_len(&h, zb, len)) >= 0) {
+            if ((uint32_t)raw > cap) { errno = EMSGSIZE; raw = -1; }
+            else if (frame_inflate(&h, zb, len, buf, (uint32_t)raw) < 0) raw = -1;
+        }
+        int e = errno; pool_put(zb); errno = e;
+        if (raw < 0) return -1;
+        len = (uint32_t)raw;
+    } else {
+        if (len > cap) { errno = EMSGSIZE; return -1; }
+        if (len && readn_deadline(fd, buf, len, dl) < 0) return -1;
+    }
+    if (hdr_out) *hdr_out = h;
+    if (len_out) *len_out = len;
+    TRACE(RECV, ntohs(h.type), len);
+    return (ntohs(h.flags) & MSG_F_MORE) ? 1 : 0;
+}
+
+// ===== buffered framed I/O =====
+// frame_reader：一次 recv 盡量多讀，再從緩衝區切出所有完整的 frame，
+// pipelined 的 N 個小請求只需要一次 syscall。
+#define FRD_INIT_CAP   4096
+#define FRD_KEEP_CAP   (64*1024)   // 緩衝區清空時，超過此大小的 buffer 直接釋放
+
+void frd_init(struct frame_reader *r) { memset(r, 0, sizeof *r); }
+void frd_free(struct frame_reader *r) { pool_put(r->buf); pool_put(r->zbuf); memset(r, 0, sizeof *r); }
+size_t frd_buffered(const struct frame_reader *r) { return r->end - r->start; }
+
+// 確保緩衝區能容納目前待解析 frame 的完整長度 (need bytes)
+static int frd_reserve(struct frame_reader *r, size_t need) {
+    if (r->start && (r->start == r->end || r->cap - r->start < need)) { // 先把未消化的資料搬到最前面
+        memmove(r->buf, r->buf + r->start, r->end - r->start);
+        r->valid = r->valid > r->start ? r->valid - r->start : 0;
+        r->end -= r->start; r->start = 0;
+    }
+    if (need <= r->cap) return 0;
+    size_t cap = r->cap ? r->cap : FRD_INIT_CAP;
+    while (cap < need) cap *= 2;
+    char *nb = pool_grow(r->buf, r->end, cap, &cap);
+    if (!nb) return -1;
+    r->buf = nb; r->cap = cap;
+    return 0;
+}
+
+ssize_t frd_fill(struct frame_reader *r, int fd, int64_t deadline) {
+    size_t need = FRD_INIT_CAP;
+    size_t have = r->end - r->start;
+    if (have >= sizeof(struct msg_hdr)) { // 已有 header：至少要放得下整個 frame
+        struct msg_hdr h; memcpy(&h, r->buf + r->start, sizeof h);
+        size_t flen = sizeof h + (size_t)ntohl(h.length);
+        if (flen > need) need = flen;
+    }
+    if (have + 1 > need) need = have + 1;
+    if (frd_reserve(r, need) < 0) return -1;
+    for (;;) {
+        ssize_t n = recv(fd, r->buf + r->end, r->cap - r->end, deadline >= 0 ? MSG_DONTWAIT : 0);
+        if (n > 0) { r->end += (size_t)n; return n; }
+        if (n == 0) return 0;
+        if (errno == EINTR) continue;
+        if (deadline >= 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (!wait_fd(fd, POLLIN, deadline)) return -1; // 等待可讀（可能逾時）
+            continue;
+        }
+        return -1;
+    }
+}
 
-// ===== system info =====
-static char *read_file_first(const char *path) {
-    FILE *f = fopen(path, "r"); if (!f) return NULL; // 讀取檔案第一行
-    char *line = NULL; size_t cap = 0; ssize_t n = getline(&line, &cap, f); // 讀一整行（自動配置）
-    fclose(f);
-    if (n <= 0) { free(line); return NULL; }    // 沒讀到內容則釋放並回傳 NULL
-    // trim
-    while (n>0 && (line[n-1]=='\n' || line[n-1]=='\r')) { line[--n]='\0'; }
-    return line; // caller free
-}
-
-char *get_system_info(void) {
-    struct utsname uts; uname(&uts); // 取得系統識別（節點名、OS、版本、硬體）
-    struct sysinfo si; sysinfo(&si); // 取得系統統計（記憶體、開機時間等)
-
-    char *model = read_file_first("/sys/devices/virtual/dmi/id/product_name"); // 讀取機型
-
-    double up_days = si.uptime / 86400.0; // 換算成天數
-    char load[64];
-    FILE *f = fopen("/proc/loadavg", "r");
-    if (f) { if (fscanf(f, "%63s", load)!=1) strcpy(load, "n/a"); fclose(f);} else strcpy(load, "n/a");
-
-    char buf[1024];
-    int n = snprintf(buf, sizeof buf,
-        "node=%s sys=%s %s release=%s machine=%s | uptime=%.2fd | mem_total=%luMB free=%luMB | load=%s",
-        uts.nodename, uts.sysname, uts.version, uts.release, uts.machine,
-        up_days, (unsigned long)(si.totalram/1024/1024), (unsigned long)(si.freeram/1024/1024), load);
-
-    char *out = malloc((size_t)n+1);
-    if (!out) { free(model); return NULL; }
-    memcpy(out, buf, (size_t)n+1);
-    free(model);
-    return out;
-}
\ No newline at end of file
+int frd_append(struct frame_reader *r, const void *p, size_t n) {
+    if (frd_reserve(r, r->end - r->start + n) < 0) return -1;
+    memcpy(r->buf + r->end, p, n);
+    r->end += n;
+    return 0;
+}
+
+// 從 [valid, end) 一次掃過所有已到齊的 frame，驗證它們的 header 並推進 valid。
+// 回傳 1 = start 處有可取出的 frame，0 = 資料不足，-1 = start 處的 header 不合法
+// (不合法的 header 前面若還有合法 frame，先讓它們被取出，下一次才回報錯誤)
+static int frd_scan(struct frame_reader *r) {
+    size_t pos = r->valid > r->start ? r->valid : r->start;
+    while (r->end - pos >= sizeof(struct msg_hdr)) {
+        const struct msg_hdr *h = (const struct msg_hdr *)(const void *)(r->buf + pos);
+        if (!hdr_valid(h)) {
+            if (pos == r->start) { errno = EPROTO; return -1; }
+            break;
+        }
+        size_t flen = sizeof *h + ntohl(h->length);
+        if (r->end - pos < flen) break;   // payload 尚未到齊
+        pos += flen;
+    }
+    r->valid = pos;
+    return pos > r->start;
+}
+
+int frd_next(struct frame_reader *r, struct msg_hdr *h, const void **payload, uint32_t *len) {
+    if (r->valid <= r->start) {
+        int rc = frd_scan(r);
+        if (rc <= 0) {
+            if (rc == 0 && r->start == r->end && r->cap > FRD_KEEP_CAP) { pool_put(r->buf); r->buf = NULL; r->cap = r->start = r->end = r->valid = 0; }
+            if (rc == 0 && r->zcap > FRD_KEEP_CAP) { pool_put(r->zbuf); r->zbuf = NULL; r->zcap = 0; }
+            return rc;
+        }
+    }
+    memcpy(h, r->buf + r->start, sizeof *h);
+    uint32_t plen = ntohl(h->length);
+    const char *p = r->buf + r->start + sizeof *h;
+    if (ntohs(h->flags) & MSG_F_COMP) {
+        long raw = frame_raw_len(h, p, plen);
+        if (raw < 0) return -1;
+        if ((size_t)raw > r->zcap) {   // 不需保留舊內容，直接換一塊
+            size_t cap;
+            char *nb = pool_get((size_t)raw, &cap);
+            if (!nb) return -1;
+            pool_put(r->zbuf);
+            r->zbuf = nb; r->zcap = cap;
+        }
+        if (frame_inflate(h, p, plen, r->zbuf, (uint32_t)raw) < 0) return -1;
+        *payload = r->zbuf;
+        *len = (uint32_t)raw;
+    } else {
+        *payload = p;
+        *len = plen;
+    }
+    r->start += sizeof *h + plen;
+    if (r->start == r->end) r->start = r->end = r->valid = 0;
+    TRACE(RECV, ntohs(h->type), *len);
+    return 1;
+}
+
+// frame_writer：把多個小回應累積起來一次送出；大 payload 直接以 writev 送，避免多一次複製
+#define FWR_DIRECT_MIN (16*1024)
+
+void fwr_init(struct frame_writer *w) { memset(w, 0, sizeof *w); }
+void fwr_free(struct frame_writer *w) { pool_put(w->buf); memset(w, 0, sizeof *w); }
+
+int fwr_flush(struct frame_writer *w, int fd, int64_t deadline) {
+    if (!w->len) return 0;
+    TRACE(FLUSH, w->len, 0);
+    ssize_t r = writen_deadline(fd, w->buf, w->len, deadline);
+    w->len = 0;
+    return r < 0 ? -1 : 0;
+}
+
+int fwr_frame(struct frame_writer *w, int fd, uint16_t type, const void *payload, uint32_t len, int64_t deadline) {
+    return fwr_frame_flags(w, fd, type, 0, payload, len, deadline);
+}
+int fwr_frame_flags(struct frame_writer *w, int fd, uint16_t type, uint16_t flags, const void *payload, uint32_t len, int64_t deadline) {
+    void *zb = NULL;
+    if (flags & MSG_F_COMP) frame_compress(&flags, &payload, &len, &zb);   // 以壓縮後的長度決定直接送或累積
+    TRACE(SEND, type, len);
+    int rc = 0;
+    if (len >= FWR_DIRECT_MIN) {
+        struct msg_hdr h = { htonl(MSG_MAGIC), htons(type), htons(flags), htonl(len) };
+        struct iovec iov[2] = { { &h, sizeof h }, { (void*)(uintptr_t)payload, len } };
+        if (fwr_flush(w, fd, deadline) < 0 || writev_deadline(fd, iov, 2, deadline, g_zc_min && len >= g_zc_min) < 0) rc = -1;
+        pool_put(zb);
+        return rc;
+    }
+    size_t need = w->len + sizeof(struct msg_hdr) + len;
+    if (need > w->cap) {
+        size_t cap = w->cap ? w->cap : 4096;
+        while (cap < need) cap *= 2;
+        char *nb = pool_grow(w->buf, w->len, cap, &cap);
+        if (!nb) { pool_put(zb); return -1; }
+        w->buf = nb; w->cap = cap;
+    }
+    struct msg_hdr h = { htonl(MSG_MAGIC), htons(type), htons(flags), htonl(len) };
+    memcpy(w->buf + w->len, &h, sizeof h);
+    if (len) memcpy(w->buf + w->len + sizeof h, payload, len);
+    w->len = need;
+    pool_put(zb);
+    return 0;
+}
+
+// ===== splice 轉送 (socket → pipe → socket) =====
+// payload 不進入使用者空間；pipe 每個行程建立一次後重複使用
+#define SPLICE_PIPE_SZ (1024*1024)
+static int g_spipe[2] = { -1, -1 };
+static size_t g_spipe_cap;
+
+static int splice_pipe(void) {
+    if (g_spipe[0] >= 0) return 0;
+    if (pipe2(g_spipe, O_CLOEXEC | O_NONBLOCK) < 0) { g_spipe[0] = g_spipe[1] = -1; return -1; }
+    int sz = fcntl(g_spipe[1], F_SETPIPE_SZ, SPLICE_PIPE_SZ);  // 放大失敗 (超過 pipe-max-size) 就用預設大小
+    if (sz < 0) sz = fcntl(g_spipe[1], F_GETPIPE_SZ);
+    g_spipe_cap = sz > 0 ? (size_t)sz : 65536;
+    return 0;
+}
+static void splice_pipe_reset(void) {   // 中途失敗時 pipe 內可能殘留資料，直接丟棄重建
+    if (g_spipe[0] >= 0) { close(g_spipe[0]); close(g_spipe[1]); }
+    g_spipe[0] = g_spipe[1] = -1;
+}
+
+int frd_peek(const struct frame_reader *r, struct msg_hdr *h) {
+    if (r->end - r->start < sizeof *h) return 0;
+    memcpy(h, r->buf + r->start, sizeof *h);
+    if (!hdr_valid(h)) { errno = EPROTO; return -1; }
+    return 1;
+}
+
+int frd_splice(struct frame_reader *r, int in_fd, int out_fd, uint16_t resp_type, int64_t deadline) {
+    struct msg_hdr h;
+    int rc = frd_peek(r, &h);
+    if (rc != 1) { if (rc == 0) errno = EINVAL; return -1; }   // header 必須已在緩衝區中
+    if (splice_pipe() < 0) return -1;
+    uint32_t len = ntohl(h.length);
+    r->start += sizeof h;
+    size_t have = r->end - r->start;
+    size_t nbuf = have < len ? have : len;   // 已經讀進緩衝區的 payload 跟回應 header 一起送出
+    struct msg_hdr rh = { htonl(MSG_MAGIC), htons(resp_type), h.flags, htonl(len) };
+    struct iovec iov[2] = { { &rh, sizeof rh }, { r->buf + r->start, nbuf } };
+    if (writev_deadline(out_fd, iov, nbuf ? 2 : 1, deadline, 0) < 0) return -1;
+    r->start += nbuf;
+    if (r->start == r->end) r->start = r->end = r->valid = 0;
+
+    size_t left = len - nbuf, inpipe = 0;
+    while (left || inpipe) {
+        ssize_t n;
+        if (!inpipe) {   // socket → pipe
+            size_t want = left < g_spipe_cap ? left : g_spipe_cap;
+            n = splice(in_fd, NULL, g_spipe[1], NULL, want, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n > 0) { left -= (size_t)n; inpipe = (size_t)n; continue; }
+            if (n == 0) { errno = ECONNRESET; goto fail; }   // payload 尚未送完對方就關閉
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN && wait_fd(in_fd, POLLIN, deadline)) continue;
+            goto fail;
+        }
+        // pipe → socket；後面還有資料時加 SPLICE_F_MORE，讓 TCP 合併成大封包
+        n = splice(g_spipe[0], NULL, out_fd, NULL, inpipe, SPLICE_F_MOVE | SPLICE_F_NONBLOCK | (left ? SPLICE_F_MORE : 0));
+        if (n > 0) { inpipe -= (size_t)n; continue; }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno == EAGAIN && wait_fd(out_fd, POLLOUT, deadline)) continue;
+        if (n == 0) errno = EPIPE;
+        goto fail;
+    }
+    return 0;
+fail:
+    if (inpipe) splice_pipe_reset();
+    return -1;
+}
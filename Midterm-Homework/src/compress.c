@@ -0,0 +1,156 @@
+// ============================================================
+// 這支檔案實作 libutils.so 中的 payload 壓縮 (見 compress.h)。
+// LZ4 block：每個 sequence 為 token (高 4 位元 literal 長度、低 4 位元 match 長度-4)、
+// literal、2 bytes little-endian offset 與延伸長度；最後一段只有 literal。
+// 壓縮端以 4 bytes hash 表 (12 位元) 找候選位置，貪婪比對；連續找不到時步伐加大，
+// 不可壓縮的資料不會花太多時間。hash 表放在堆疊，不需配置記憶體。
+// ============================================================
+#include "compress.h"
+#include "common.h"
+#include <string.h>
+#include <errno.h>
+#ifdef ENABLE_ZSTD
+# include <zstd.h>
+#endif
+
+#define LZ_MINMATCH      4
+#define LZ_HASH_BITS     12
+#define LZ_LASTLITERALS  5     // 最後 5 bytes 一定是 literal
+#define LZ_MFLIMIT       12    // 最後一個 match 至少要在結尾前 12 bytes 開始
+#define LZ_MAX_OFFSET    65535
+
+static inline uint32_t read32(const unsigned char *p) { uint32_t v; memcpy(&v, p, sizeof v); return v; }
+static inline uint32_t lz_hash(uint32_t v) { return (v * 2654435761u) >> (32 - LZ_HASH_BITS); }
+
+static unsigned char *put_len(unsigned char *op, size_t len) {
+    while (len >= 255) { *op++ = 255; len -= 255; }
+    *op++ = (unsigned char)len;
+    return op;
+}
+
+size_t lz4_bound(size_t n) { return n + n / 255 + 16; }
+
+// 寫出一個 sequence (off = 0 時只寫 literal，即最後一段)；dst 不足回傳 NULL
+static unsigned char *put_seq(unsigned char *op, const unsigned char *oend, const unsigned char *lit, size_t nlit,
+                              size_t off, size_t mlen) {
+    if ((size_t)(oend - op) < 1 + nlit / 255 + 1 + nlit + 2 + mlen / 255 + 1) return NULL;
+    unsigned char *tok = op++;
+    if (nlit >= 15) { *tok = 15 << 4; op = put_len(op, nlit - 15); }
+    else *tok = (unsigned char)(nlit << 4);
+    memcpy(op, lit, nlit); op += nlit;
+    if (!off) return op;
+    *op++ = (unsigned char)(off & 0xff); *op++ = (unsigned char)(off >> 8);
+    if (mlen >= 15) { *tok |= 15; op = put_len(op, mlen - 15); }
+    else *tok |= (unsigned char)mlen;
+    return op;
+}
+
+size_t lz4_compress(const void *src, size_t n, void *dst, size_t cap) {
+    const unsigned char *base = src, *ip = base, *anchor = base, *iend = base + n;
+    unsigned char *op = dst;
+    const unsigned char *oend = op + cap;
+    if (n > LZ_MFLIMIT) {
+        const unsigned char *mflimit = iend - LZ_MFLIMIT, *mlimit = iend - LZ_LASTLITERALS;
+        uint32_t tab[1u << LZ_HASH_BITS];   // 位置相對 base；0 也是合法候選，比對內容後才採用
+        memset(tab, 0, sizeof tab);
+        ip++;
+        while (ip < mflimit) {
+            uint32_t seq = read32(ip), hv = lz_hash(seq);
+            const unsigned char *ref = base + tab[hv];
+            tab[hv] = (uint32_t)(ip - base);
+            if (ref >= ip || ip - ref > LZ_MAX_OFFSET || read32(ref) != seq) {
+                ip += 1 + ((size_t)(ip - anchor) >> 6);   // 越久沒找到 match，跳得越遠
+                continue;
+            }
+            while (ip > anchor && ref > base && ip[-1] == ref[-1]) { ip--; ref--; }   // 往前延伸
+            const unsigned char *p = ip + LZ_MINMATCH, *q = ref + LZ_MINMATCH;
+            while (p < mlimit && *p == *q) { p++; q++; }
+            op = put_seq(op, oend, anchor, (size_t)(ip - anchor), (size_t)(ip - ref), (size_t)(p - ip) - LZ_MINMATCH);
+            if (!op) return 0;
+            ip = anchor = p;
+            if (ip < mflimit) tab[lz_hash(read32(ip - 2))] = (uint32_t)(ip - 2 - base);
+        }
+    }
+    op = put_seq(op, oend, anchor, (size_t)(iend - anchor), 0, 0);
+    return op ? (size_t)(op - (unsigned char *)dst) : 0;
+}
+
+static int get_len(const unsigned char **ip, const unsigned char *iend, size_t *len) {
+    unsigned b;
+    do {
+        if (*ip >= iend) return -1;
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return 0;
+}
+
+long lz4_decompress(const void *src, size_t n, void *dst, size_t cap) {
+    const unsigned char *ip = src, *iend = ip + n;
+    unsigned char *op = dst, *ostart = op, *oend = op + cap;
+    while (ip < iend) {
+        unsigned tok = *ip++;
+        size_t nlit = tok >> 4, mlen = tok & 15;
+        if (nlit == 15 && get_len(&ip, iend, &nlit) < 0) return -1;
+        if ((size_t)(iend - ip) < nlit || (size_t)(oend - op) < nlit) return -1;
+        memcpy(op, ip, nlit); op += nlit; ip += nlit;
+        if (ip == iend) break;   // 最後一段只有 literal
+        if (iend - ip < 2) return -1;
+        size_t off = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if (!off || off > (size_t)(op - ostart)) return -1;
+        if (mlen == 15 && get_len(&ip, iend, &mlen) < 0) return -1;
+        mlen += LZ_MINMATCH;
+        if ((size_t)(oend - op) < mlen) return -1;
+        // 重疊 (off < mlen) 時內容以 off 為週期：每次複製的距離加倍，長串重複只需 log 次 memcpy
+        for (size_t d = off; mlen > 0; d *= 2) {
+            size_t c = mlen < d ? mlen : d;
+            memcpy(op, op - d, c);
+            op += c; mlen -= c;
+        }
+    }
+    return (long)(op - ostart);
+}
+
+// ===== codec 分派 =====
+int comp_supported(uint16_t codec) {
+    if (codec == MSG_F_LZ4) return 1;
+#ifdef ENABLE_ZSTD
+    if (codec == MSG_F_ZSTD) return 1;
+#endif
+    return 0;
+}
+
+size_t comp_bound(uint16_t codec, size_t n) {
+#ifdef ENABLE_ZSTD
+    if (codec == MSG_F_ZSTD) return ZSTD_compressBound(n);
+#endif
+    (void)codec;
+    return lz4_bound(n);
+}
+
+size_t comp_encode(uint16_t codec, int level, const void *src, size_t n, void *dst, size_t cap) {
+    (void)level;
+    if (codec == MSG_F_LZ4) return lz4_compress(src, n, dst, cap);
+#ifdef ENABLE_ZSTD
+    if (codec == MSG_F_ZSTD) {
+        size_t r = ZSTD_compress(dst, cap, src, n, level);
+        return ZSTD_isError(r) ? 0 : r;
+    }
+#endif
+    return 0;
+}
+
+long comp_decode(uint16_t codec, const void *src, size_t n, void *dst, size_t cap) {
+    long r = -1;
+    if (codec == MSG_F_LZ4) r = lz4_decompress(src, n, dst, cap);
+#ifdef ENABLE_ZSTD
+    else if (codec == MSG_F_ZSTD) {
+        size_t z = ZSTD_decompress(dst, cap, src, n);
+        r = ZSTD_isError(z) ? -1 : (long)z;
+    }
+#endif
+    else { errno = ENOTSUP; return -1; }
+    if (r < 0) errno = EPROTO;
+    return r;
+}
@@ -0,0 +1,51 @@
+// ============================================================
+// 這支檔案實作 libutils.so 中的請求分派表 (見 dispatch.h)。
+// 型別值直接當陣列索引，查表一次即可取得 handler 與回應型別；
+// 表格在 fork 前登錄完成，子行程繼承後只讀不寫。
+// ============================================================
+#include "dispatch.h"
+#include <string.h>
+#include <errno.h>
+
+struct dispatch_slot {
+    msg_handler fn;
+    uint16_t resp_type;
+};
+
+static struct dispatch_slot g_table[MSG_TYPE_MAX];
+static struct dispatch_slot g_saved[MSG_TYPE_MAX];
+
+int dispatch_register(uint16_t req, uint16_t resp, uint32_t req_max_len, uint16_t allowed_flags, msg_handler fn) {
+    if (!fn || req >= MSG_TYPE_MAX || resp >= MSG_TYPE_MAX) { errno = EINVAL; return -1; }
+    if (msg_type_register(req, req_max_len, allowed_flags) < 0) return -1;
+    if (msg_type_register(resp, FRAME_MAX_LEN, allowed_flags) < 0) return -1;
+    g_table[req].fn = fn;
+    g_table[req].resp_type = resp;
+    return 0;
+}
+
+void dispatch_unregister(uint16_t req) {
+    if (req < MSG_TYPE_MAX) g_table[req].fn = NULL;   // 型別表保留，已在路上的請求仍可通過驗證並得到錯誤回應
+}
+
+void dispatch_checkpoint(void) {
+    memcpy(g_saved, g_table, sizeof g_table);
+    msg_types_checkpoint();
+}
+
+void dispatch_rollback(void) {
+    memcpy(g_table, g_saved, sizeof g_table);   // 未 checkpoint 過時 g_saved 全空，等於清空
+    msg_types_rollback();
+}
+
+int dispatch_request(uint16_t type, uint16_t flags, const void *payload, uint32_t len, reply_fn reply, void *sink) {
+    const struct dispatch_slot *s = type < MSG_TYPE_MAX ? &g_table[type] : NULL;
+    if (!s || !s->fn) { errno = ENOENT; return -1; }
+    struct dispatch_req rq = { type, flags, s->resp_type, payload, len, reply, sink };
+    s->fn(&rq);
+    return 0;
+}
+
+int dispatch_error(const struct dispatch_req *rq, const char *msg) {
+    return rq->reply(rq->sink, RESP_ERROR, 0, msg, (uint32_t)strlen(msg));
+}
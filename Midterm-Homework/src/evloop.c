@@ -0,0 +1,328 @@
+// ============================================================
+// 這支檔案實作 libutils.so 中的 epoll 事件迴圈。
+// 連線一律使用 non-blocking socket；讀取端以 frame_reader 一次 recv
+// 再切出所有完整的 msg_hdr frame，寫出端以緩衝區暫存未送完的資料。
+// 每條連線一個 timer wheel 上的 timer：閒置超過 idle_timeout_ms (keep-alive) 或請求進行中
+// 超過 io_timeout_ms 沒有進展時關閉；等待時間取自最近的 timer，沒有連線時不必定期醒來。
+// 以 IOURING=1 編譯並 ev_set_backend(EV_BACKEND_URING) 時改由 evloop_uring.c 等待與送出。
+// ============================================================
+#include "evloop_impl.h"
+#include "stats.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+
+#define EV_MAX_EVENTS   256
+#define EV_ACCEPT_BATCH 64              // 每次喚醒最多 accept 幾條，避免新連線餓死既有連線
+
+static int g_ev_backend = EV_BACKEND_EPOLL;
+
+// ===== 建立/釋放 =====
+struct ev_loop *ev_loop_new(ev_frame_cb on_frame, int max_conns) {
+    struct ev_loop *L = calloc(1, sizeof *L);
+    if (!L) return NULL;
+    L->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (L->epfd < 0) { free(L); return NULL; }
+    L->on_frame = on_frame;
+    L->max_conns = max_conns;
+    L->accepting = 1;
+    tw_init(&L->wheel, EV_TICK_MS, mono_now_ms());
+#ifdef ENABLE_IOURING
+    if (g_ev_backend == EV_BACKEND_URING && ev_ur_init(L) < 0)
+        LOGW("io_uring unavailable (%s), falling back to epoll", strerror(errno));
+#endif
+    return L;
+}
+
+int ev_set_backend(int backend) {
+    if (backend != EV_BACKEND_EPOLL && backend != EV_BACKEND_URING) { errno = EINVAL; return -1; }
+#ifndef ENABLE_IOURING
+    if (backend == EV_BACKEND_URING) { errno = ENOTSUP; return -1; }
+#endif
+    g_ev_backend = backend;
+    return 0;
+}
+
+int ev_loop_backend(const struct ev_loop *L) { return L->ur ? EV_BACKEND_URING : EV_BACKEND_EPOLL; }
+
+static void conn_destroy(struct ev_conn *c) {
+    struct ev_loop *L = c->loop;
+    epoll_ctl(L->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    conn_unlink(L, c);
+    tw_del(&L->wheel, &c->tmr);
+    frd_free(&c->rd); pool_put(c->out); free(c);
+    L->nconns--;
+    stats_conn_close();
+}
+
+void ev_loop_free(struct ev_loop *L) {
+    if (!L) return;
+#ifdef ENABLE_IOURING
+    if (L->ur) ev_ur_free(L);   // 先取消 kernel 中的操作並回收連線
+#endif
+    while (L->conns) conn_destroy(L->conns);
+    struct ev_listener *l = L->listeners;
+    while (l) { struct ev_listener *n = l->next; free(l); l = n; }
+    close(L->epfd);
+    free(L);
+}
+
+int ev_loop_add_listener(struct ev_loop *L, int lfd) {
+    struct ev_listener *l = calloc(1, sizeof *l);
+    if (!l) return -1;
+    l->kind = EV_KIND_LISTENER; l->fd = lfd;
+    set_nonblock(lfd, 1);
+#ifdef ENABLE_IOURING
+    if (L->ur) {
+        if (ev_ur_add_listener(L, l) < 0) { free(l); return -1; }
+        l->next = L->listeners; L->listeners = l;
+        return 0;
+    }
+#endif
+    // 多個 worker 的 epoll 都在等同一個 listener：EPOLLEXCLUSIVE 讓 kernel 只喚醒其中一個
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLEXCLUSIVE, .data.ptr = l };
+    if (epoll_ctl(L->epfd, EPOLL_CTL_ADD, lfd, &ev) < 0) { free(l); return -1; }
+    l->next = L->listeners; L->listeners = l;
+    return 0;
+}
+
+void ev_loop_stop(struct ev_loop *L) { L->stop = 1; }
+void ev_loop_drain(struct ev_loop *L) { L->drain = 1; }
+void ev_loop_set_sigmask(struct ev_loop *L, const sigset_t *mask) {
+    L->has_mask = mask != NULL;
+    if (mask) L->mask = *mask;
+}
+int  ev_loop_nconns(const struct ev_loop *L) { return L->nconns; }
+const struct accept_stats *ev_loop_accept_stats(const struct ev_loop *L) { return &L->ast; }
+int  ev_conn_fd(const struct ev_conn *c) { return c->fd; }
+unsigned long ev_conn_nframes(const struct ev_conn *c) { return c->nframes; }
+
+// 連線數達上限時把監聽 socket 從 epoll 拿掉，讓其他 worker 接手 accept
+static void set_accepting(struct ev_loop *L, int on) {
+    if (L->accepting == on) return;
+    for (struct ev_listener *l = L->listeners; l; l = l->next) {
+        struct epoll_event ev = { .events = EPOLLIN | EPOLLEXCLUSIVE, .data.ptr = l }; // EPOLLEXCLUSIVE 不能 MOD，只能 DEL/ADD
+        epoll_ctl(L->epfd, on ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, l->fd, &ev);
+    }
+    L->accepting = on;
+}
+
+static void conn_update_events(struct ev_conn *c) {
+    uint32_t want = 0;
+    if (!c->closing && !c->eof && c->olen - c->ooff < EV_OUT_HIWAT) want |= EPOLLIN;
+    if (c->olen > c->ooff) want |= EPOLLOUT;
+    if (want == c->events) return;
+    struct epoll_event ev = { .events = want, .data.ptr = c };
+    epoll_ctl(c->loop->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+    c->events = want;
+}
+
+// ===== 寫出 =====
+// 盡量把緩衝區寫到 socket；回傳 -1 表示連線已壞
+static int conn_flush(struct ev_conn *c) {
+    if (c->ooff < c->olen) TRACE(FLUSH, c->olen - c->ooff, 0);
+    while (c->ooff < c->olen) {
+        ssize_t w = send(c->fd, c->out + c->ooff, c->olen - c->ooff, MSG_NOSIGNAL);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return -1;
+        }
+        c->ooff += (size_t)w;
+    }
+    if (c->ooff == c->olen) c->ooff = c->olen = 0; // 全部送完，緩衝區歸零重用
+    return 0;
+}
+
+static int out_append(struct ev_conn *c, const void *p, size_t n) {
+    if (c->ooff && c->olen + n > c->ocap) { // 先把已送出的部分往前搬
+        memmove(c->out, c->out + c->ooff, c->olen - c->ooff);
+        c->olen -= c->ooff; c->ooff = 0;
+    }
+    if (c->olen + n > c->ocap) {
+        size_t cap = c->ocap ? c->ocap : 4096;
+        while (cap < c->olen + n) cap *= 2;
+        char *nb = pool_grow(c->out, c->olen, cap, &cap);
+        if (!nb) return -1;
+        c->out = nb; c->ocap = cap;
+    }
+    memcpy(c->out + c->olen, p, n);
+    c->olen += n;
+    return 0;
+}
+
+int ev_conn_send(struct ev_conn *c, uint16_t type, const void *payload, uint32_t len) {
+    return ev_conn_send_flags(c, type, 0, payload, len);
+}
+int ev_conn_send_flags(struct ev_conn *c, uint16_t type, uint16_t flags, const void *payload, uint32_t len) {
+    if (c->dead) { errno = EPIPE; return -1; }
+    void *zb = NULL;
+    if (flags & MSG_F_COMP) frame_compress(&flags, &payload, &len, &zb);   // 壓縮結果隨即複製進輸出緩衝區
+    TRACE(SEND, type, len);
+    struct msg_hdr h = { htonl(MSG_MAGIC), htons(type), htons(flags), htonl(len) };
+    int rc = out_append(c, &h, sizeof h);
+    if (rc == 0 && len && payload) rc = out_append(c, payload, len);
+    pool_put(zb);
+    if (rc < 0) return -1;
+#ifdef ENABLE_IOURING
+    if (c->loop->ur) { ev_ur_kick(c); return 0; }   // 同一批的回應累積起來，一個 SEND 送出
+#endif
+    if (conn_flush(c) < 0) { c->dead = 1; return -1; }
+    conn_update_events(c);
+    return 0;
+}
+
+void ev_conn_close(struct ev_conn *c) {
+    c->closing = 1;
+#ifdef ENABLE_IOURING
+    if (c->loop->ur) { ev_ur_kick(c); return; }
+#endif
+    conn_update_events(c);
+}
+
+// ===== 讀取 =====
+int ev_conn_process_frames(struct ev_conn *c) {
+    struct ev_loop *L = c->loop;
+    while (!c->closing && !c->dead && ev_out_pending(c) < EV_OUT_HIWAT) {
+        struct msg_hdr h; const void *pl; uint32_t len;
+        int rc = frd_next(&c->rd, &h, &pl, &len);
+        if (rc < 0) { LOGW("conn fd=%d: invalid header", c->fd); stats_error(); return -1; }
+        if (rc == 0) break;
+        if (!(ntohs(h.flags) & MSG_F_MORE)) c->nframes++;   // chunked 訊息在最後一個 chunk 才算完成
+        L->on_frame(c, &h, pl, len);
+    }
+    return 0;
+}
+
+// 回傳 -1 表示連線應該結束 (EOF、錯誤或協定錯誤)
+static int conn_read(struct ev_conn *c) {
+    for (;;) {
+        if (ev_conn_process_frames(c) < 0) return -1;
+        if (c->eof || c->closing || c->dead) return 0;
+        if (c->olen - c->ooff >= EV_OUT_HIWAT) return 0; // 對方不讀回應時先停止讀取
+        ssize_t r = frd_fill(&c->rd, c->fd, -1);
+        if (r == 0) {
+            LOGD("conn fd=%d closed by peer", c->fd);
+            c->eof = 1;
+            continue;   // 先把已收到的完整 frame 回應完
+        }
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            LOGD("conn fd=%d recv: %s", c->fd, strerror(errno));
+            return -1;
+        }
+        conn_touch(c);
+    }
+}
+
+// ===== accept =====
+static void do_accept(struct ev_loop *L, struct ev_listener *l) {
+    int fds[EV_ACCEPT_BATCH];
+    int room = L->max_conns ? L->max_conns - L->nconns : EV_ACCEPT_BATCH;
+    if (room > EV_ACCEPT_BATCH) room = EV_ACCEPT_BATCH;
+    int n = room > 0 ? accept_batch(l->fd, fds, room, SOCK_NONBLOCK | SOCK_CLOEXEC, &L->ast) : 0;
+    if (n < 0) { LOGW("accept4: %s", strerror(errno)); return; }
+    if (n > 0) stats_note_accept(&L->ast);
+    for (int i=0;i<n;i++) {
+        int fd = fds[i];
+        sockopt_apply_conn(fd);
+        struct ev_conn *c = calloc(1, sizeof *c);
+        if (!c) { close(fd); continue; }
+        c->kind = EV_KIND_CONN; c->fd = fd; c->loop = L;
+        frd_init(&c->rd);
+        c->events = EPOLLIN;
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+        if (epoll_ctl(L->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) { close(fd); free(c); continue; }
+        L->nconns++;
+        stats_conn_open();
+        conn_link(L, c);
+        conn_touch(c);
+        ev_conn_timer_update(c);
+        LOGD("accepted fd=%d (conns=%d)", fd, L->nconns);
+    }
+    // 沒取完的連線 listener 仍是可讀 (level-triggered)，下一輪 epoll_wait 會再回來
+    if (L->max_conns && L->nconns >= L->max_conns) set_accepting(L, 0);
+}
+
+// ===== 逾時 =====
+// 閒置 (沒有未完成的 frame、回應都已送出) 時以 idle_timeout_ms 為限，每次有進展重新起算；
+// 請求進行中則以 io_timeout_ms 為限。有進展時只更新 last_ms，timer 到期時才依最新的
+// last_ms 重新排定，每個請求不必搬動 timer；只有時限變短時才提早重排
+static int conn_limit_ms(const struct ev_conn *c) {
+    if (!ROBUST_ON(enable_timeouts)) return 0;
+    return (frd_buffered(&c->rd) || ev_out_pending(c)) ? g_robust.io_timeout_ms : g_robust.idle_timeout_ms;
+}
+
+static void conn_timer_fired(void *arg) {
+    struct ev_conn *c = arg;
+    int busy = frd_buffered(&c->rd) || ev_out_pending(c);
+    int lim = conn_limit_ms(c);
+    if (lim <= 0) return;   // 目前狀態不限時；狀態改變時 ev_conn_timer_update 會再排入
+    if (mono_now_ms() - c->last_ms < lim) { ev_conn_timer_update(c); return; }
+    LOGI("conn fd=%d %s timeout", c->fd, busy ? "I/O" : "idle");
+    stats_timeout();
+#ifdef ENABLE_IOURING
+    if (c->loop->ur) { ev_ur_conn_timeout(c); return; }
+#endif
+    conn_destroy(c);
+}
+
+void ev_conn_timer_update(struct ev_conn *c) {
+    int lim = conn_limit_ms(c);
+    if (lim <= 0) return;
+    int64_t due = c->last_ms + lim;
+    if (tw_pending(&c->tmr) && c->tmr_ms <= due) return;   // 已排定的時間較早：到期時再延後
+    if (!c->tmr.fn) tw_timer_init(&c->tmr, conn_timer_fired, c);
+    tw_add(&c->loop->wheel, &c->tmr, due);
+    c->tmr_ms = due;
+}
+
+int ev_loop_wait_ms(struct ev_loop *L) { return tw_next_ms(&L->wheel, mono_now_ms()); }
+
+int ev_loop_run(struct ev_loop *L) {
+#ifdef ENABLE_IOURING
+    if (L->ur) return ev_ur_run(L);
+#endif
+    struct epoll_event evs[EV_MAX_EVENTS];
+    while (!L->stop) {
+        if (L->drain) {   // 不再接新連線，現有連線都結束後離開
+            if (L->accepting) set_accepting(L, 0);
+            if (L->nconns == 0) break;
+        }
+        int wait_ms = ev_loop_wait_ms(L);
+        log_flush();   // 進入等待前把累積的 log 寫出
+        TRACE_IDLE();
+        int n = epoll_pwait(L->epfd, evs, EV_MAX_EVENTS, wait_ms, L->has_mask ? &L->mask : NULL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            LOGE("epoll_wait: %s", strerror(errno));
+            return -1;
+        }
+        for (int i=0;i<n;i++) {
+            int kind = *(int*)evs[i].data.ptr;
+            if (kind == EV_KIND_LISTENER) { do_accept(L, evs[i].data.ptr); continue; }
+            struct ev_conn *c = evs[i].data.ptr;
+            int bad = 0;
+            if (evs[i].events & (EPOLLERR | EPOLLHUP)) bad = !(evs[i].events & EPOLLIN);
+            if (!bad && (evs[i].events & EPOLLOUT)) {
+                if (conn_flush(c) < 0) bad = 1; else conn_touch(c);
+            }
+            // 可讀時讀取；或剛送完積壓的回應，緩衝區內可能還有待處理的 frame
+            if (!bad && ((evs[i].events & EPOLLIN) || frd_buffered(&c->rd))) bad = conn_read(c) < 0;
+            if (!bad && c->eof && c->olen == c->ooff) bad = 1; // 對方已關閉且回應都送完 (殘留的不完整 frame 丟棄)
+            if (c->dead) bad = 1;
+            if (!bad && c->closing && c->olen == c->ooff) bad = 1; // 已送完，依要求關閉
+            if (bad) conn_destroy(c); else { conn_update_events(c); ev_conn_timer_update(c); }
+        }
+        tw_advance(&L->wheel, mono_now_ms());
+        if (!L->accepting && !L->drain && (!L->max_conns || L->nconns < L->max_conns)) set_accepting(L, 1);
+    }
+    return 0;
+}
@@ -0,0 +1,105 @@
+#ifndef EVLOOP_IMPL_H
+#define EVLOOP_IMPL_H
+// ============================================================
+// 事件迴圈內部共用的結構 (evloop.c 與 evloop_uring.c)，不對外安裝。
+// 連線狀態、frame 解析與逾時 timer 兩種後端共用；只有等待/送出的方式不同：
+//   epoll    — readiness 通知後自己 recv/send (evloop.c)
+//   io_uring — 以 multishot accept/recv 與非同步 send 取得完成通知 (evloop_uring.c)
+// ============================================================
+#include "evloop.h"
+#include "twheel.h"
+
+#define EV_OUT_HIWAT    (4u*1024*1024)  // 寫出緩衝超過此值時暫停讀取 (backpressure)
+#define EV_TICK_MS      10              // timer wheel 的 tick
+
+enum { EV_KIND_LISTENER = 1, EV_KIND_CONN = 2 };
+
+struct ev_listener {
+    int kind;
+    int fd;
+    int armed;           // io_uring：multishot accept 仍在 kernel 中
+    int cancelling;      // io_uring：已送出取消，等最後一個 CQE
+    int64_t retry_ms;    // io_uring：accept 出錯 (如 EMFILE) 後，這個時間之前不重新掛上
+    struct ev_listener *next;
+};
+
+struct ev_conn {
+    int kind;
+    int fd;
+    struct ev_loop *loop;
+    // 讀取緩衝 (frame 邊界由 frame_reader 解析)
+    struct frame_reader rd;
+    int eof;             // 對方已關閉寫端，處理完緩衝區後結束
+    // 寫出緩衝區
+    char *out; size_t olen, ooff, ocap;
+    uint32_t events;     // 目前向 epoll 註冊的事件
+    int closing;         // 送完緩衝區後關閉
+    int dead;            // 已出錯，等待回收
+    unsigned long nframes;
+    int64_t last_ms;     // 最後活動時間
+    struct tw_timer tmr; // 閒置/I-O 逾時
+    int64_t tmr_ms;      // tmr 目前排定的到期時間
+    struct ev_conn *prev, *next;   // 所有連線的串列 (io_uring 關閉後改掛在 zombies)
+    // io_uring：送出中的緩衝區交給 kernel 期間，新的回應繼續累積在 out
+    char *snd; size_t slen, soff, scap;
+    int refs;            // 尚未收到最後一個 CQE 的 SQE 數；歸零才能 close/free
+    int recv_armed, recv_stopping, send_armed, torn_down;
+    int kicked;          // 已在 kick 串列中
+    struct ev_conn *knext;
+};
+
+struct ev_uring;
+
+struct ev_loop {
+    int epfd;
+    volatile sig_atomic_t stop, drain;   // 可由 signal handler 設定
+    int has_mask;        // epoll_pwait 期間改用 mask
+    sigset_t mask;
+    int nconns, max_conns;
+    int accepting;       // 監聽 socket 是否仍在 epoll 中 (io_uring：是否掛著 accept)
+    ev_frame_cb on_frame;
+    struct ev_listener *listeners;
+    struct ev_conn *conns;               // 所有服務中的連線
+    struct twheel wheel;                 // 每條連線一個逾時 timer
+    struct accept_stats ast;
+    struct ev_uring *ur;                 // 非 NULL = 使用 io_uring 後端
+    struct ev_conn *kick_head;           // io_uring：這一批 CQE 處理完後要更新狀態的連線
+    struct ev_conn *zombies;             // io_uring：已關閉但仍有 SQE 在 kernel 中的連線
+};
+
+// ===== 連線串列 =====
+static inline void conn_link(struct ev_loop *L, struct ev_conn *c) {
+    c->prev = NULL; c->next = L->conns;
+    if (L->conns) L->conns->prev = c;
+    L->conns = c;
+}
+static inline void conn_unlink(struct ev_loop *L, struct ev_conn *c) {
+    if (c->prev) c->prev->next = c->next; else L->conns = c->next;
+    if (c->next) c->next->prev = c->prev;
+    c->prev = c->next = NULL;
+}
+// 有讀寫進展：只記下時間，timer 到期時才依此重新排定 (見 ev_conn_timer_update)
+static inline void conn_touch(struct ev_conn *c) { c->last_ms = mono_now_ms(); }
+
+// 尚未送到 kernel 的回應 bytes (含 io_uring 送出中的部分)
+static inline size_t ev_out_pending(const struct ev_conn *c) {
+    return (c->olen - c->ooff) + (c->slen - c->soff);
+}
+
+// 把緩衝區內已到齊的 frame 全部交給上層；寫出端積壓過多時暫停 (evloop.c)
+int  ev_conn_process_frames(struct ev_conn *c);
+// 新連線或狀態改變後呼叫：依目前狀態 (閒置 / 請求進行中) 的時限，必要時提早 timer
+void ev_conn_timer_update(struct ev_conn *c);
+// wheel 的等待時間 (ms，-1 = 不限)
+int  ev_loop_wait_ms(struct ev_loop *L);
+
+#ifdef ENABLE_IOURING
+int  ev_ur_init(struct ev_loop *L);          // 失敗時回傳 -1 (呼叫端退回 epoll)
+void ev_ur_free(struct ev_loop *L);
+int  ev_ur_add_listener(struct ev_loop *L, struct ev_listener *l);
+void ev_ur_kick(struct ev_conn *c);          // 有新的回應或要關閉：本批 CQE 處理完後更新
+int  ev_ur_run(struct ev_loop *L);
+void ev_ur_conn_timeout(struct ev_conn *c);  // 逾時：關閉連線
+#endif
+
+#endif /* EVLOOP_IMPL_H */
@@ -0,0 +1,495 @@
+// ============================================================
+// 這支檔案實作事件迴圈的 io_uring 後端 (IOURING=1 時編入 libutils.so)。
+// 直接使用 io_uring_setup / io_uring_enter / io_uring_register 系統呼叫，不依賴 liburing：
+//   - 每個 listener 掛一個 multishot accept，新連線以 CQE 回報，不必再呼叫 accept4
+//   - 每條連線掛一個 multishot recv，從 provided buffer ring 取緩衝區；資料複製進
+//     frame_reader 後立即歸還，frame 解析與 epoll 後端共用 ev_conn_process_frames
+//   - 每條連線同時只有一個 SEND 在 kernel 中；期間產生的回應累積在 out，送完再交換
+//     緩衝區一起送出，pipelined 請求的 header 與 payload 因此合併成一次 SEND
+//   - 啟用逾時時 SEND 以 IOSQE_IO_LINK 連結一個 LINK_TIMEOUT，取代 SO_SNDTIMEO；
+//     讀取端的閒置/I-O 逾時沿用 timer wheel (evloop.c)
+//   - 送出新的 SQE 與等待 CQE 在同一次 io_uring_enter 完成 (EXT_ARG 帶 timeout 與 signal mask)
+// user_data 為 listener/連線指標，低 3 位元標記操作種類。
+// 需要 kernel >= 6.0 (SINGLE_ISSUER、multishot recv)；否則 ev_ur_init 失敗，呼叫端退回 epoll。
+// ============================================================
+#include "evloop_impl.h"
+#include "stats.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#define UR_SQ_ENTRIES 256
+#define UR_CQ_ENTRIES 4096
+#define UR_NBUFS      64              // provided buffer 數量 (必須是 2 的次方)
+#define UR_BUFSZ      (16*1024)
+#define UR_BGID       0
+#define UR_RETRY_MS   100             // accept 出錯後多久再重新掛上
+#define UR_FREE_WAIT  10              // ev_ur_free 最多等幾輪 (每輪 10ms) 讓取消的操作完成
+
+enum { UD_NONE = 0, UD_ACCEPT = 1, UD_RECV = 2, UD_SEND = 3, UD_TIMEOUT = 4 };
+#define UD(p, tag)  ((uint64_t)(uintptr_t)(p) | (uint64_t)(tag))
+#define UD_TAG(ud)  ((int)((ud) & 7))
+#define UD_PTR(ud)  ((void*)(uintptr_t)((ud) & ~(uint64_t)7))
+
+struct ev_uring {
+    int fd;
+    int closing;                  // ev_ur_free 中：新 accept 到的連線直接關閉
+    // SQ/CQ 共用一塊映射 (IORING_FEAT_SINGLE_MMAP)
+    void *ring; size_t ring_sz;
+    struct io_uring_sqe *sqes; size_t sqes_sz;
+    unsigned *sq_head, *sq_tail, sq_mask, sq_entries;
+    unsigned sq_local;            // 已填好、尚未公布給 kernel 的 tail
+    unsigned *cq_head, *cq_tail, cq_mask;
+    struct io_uring_cqe *cqes;
+    // provided buffer ring：kernel 收資料時自己挑一塊，CQE 回報 buffer id
+    struct io_uring_buf_ring *br; size_t br_sz;
+    char *bufs; size_t bufs_sz;
+    uint16_t br_tail;
+    struct __kernel_timespec send_ts;   // LINK_TIMEOUT 的時限 (kernel 在 prep 時複製)
+    unsigned long enters, ncqes, nsends;
+};
+
+static int ur_enter(struct ev_uring *u, unsigned submit, unsigned min_complete, unsigned flags, void *arg, size_t argsz) {
+    u->enters++;
+    return (int)syscall(__NR_io_uring_enter, u->fd, submit, min_complete, flags, arg, argsz);
+}
+
+// 公布已填好的 SQE，回傳 kernel 尚未取走的數量
+static unsigned ur_publish(struct ev_uring *u) {
+    __atomic_store_n(u->sq_tail, u->sq_local, __ATOMIC_RELEASE);
+    return u->sq_local - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+}
+
+static void ur_submit(struct ev_uring *u) {
+    unsigned n = ur_publish(u);
+    while (n && ur_enter(u, n, 0, 0, NULL, 0) < 0 && errno == EINTR) { }
+}
+
+// 取得 SQE 並保證還有 n-1 個空位 (連結的 SEND + LINK_TIMEOUT 必須在同一次提交中)
+static struct io_uring_sqe *ur_sqe(struct ev_uring *u, unsigned n) {
+    if (u->sq_local - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) + n > u->sq_entries) {
+        ur_submit(u);   // SQ 滿了：先把已填好的送出
+        if (u->sq_local - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) + n > u->sq_entries) return NULL;
+    }
+    struct io_uring_sqe *e = &u->sqes[u->sq_local & u->sq_mask];
+    memset(e, 0, sizeof *e);
+    u->sq_local++;
+    return e;
+}
+
+static int ur_cq_ready(const struct ev_uring *u) {
+    return *u->cq_head != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+}
+
+static void ur_buf_put(struct ev_uring *u, unsigned bid) {
+    struct io_uring_buf *b = &u->br->bufs[u->br_tail & (UR_NBUFS - 1)];
+    b->addr = (uint64_t)(uintptr_t)(u->bufs + (size_t)bid * UR_BUFSZ);
+    b->len = UR_BUFSZ;
+    b->bid = (uint16_t)bid;
+    u->br_tail++;
+    __atomic_store_n(&u->br->tail, u->br_tail, __ATOMIC_RELEASE);
+}
+
+static void ur_cancel(struct ev_uring *u, uint64_t ud) {
+    struct io_uring_sqe *e = ur_sqe(u, 1);
+    if (!e) return;
+    e->opcode = IORING_OP_ASYNC_CANCEL;
+    e->addr = ud;
+    e->user_data = UD(NULL, UD_NONE);
+}
+
+static void ur_destroy(struct ev_uring *u) {
+    if (u->bufs) munmap(u->bufs, u->bufs_sz);
+    if (u->br) munmap(u->br, u->br_sz);
+    if (u->sqes) munmap(u->sqes, u->sqes_sz);
+    if (u->ring) munmap(u->ring, u->ring_sz);
+    if (u->fd >= 0) close(u->fd);
+    free(u);
+}
+
+// ===== 建立/釋放 =====
+int ev_ur_init(struct ev_loop *L) {
+    // DEFER_TASKRUN (6.1) 讓完成處理延到 io_uring_enter 時集中進行；不支援時退一級
+    static const unsigned try_flags[] = {
+        IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN,
+        IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN | IORING_SETUP_SINGLE_ISSUER,
+    };
+    const unsigned need = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    struct ev_uring *u = calloc(1, sizeof *u);
+    if (!u) return -1;
+    u->fd = -1;
+    struct io_uring_params p;
+    for (size_t i=0; i<sizeof try_flags/sizeof try_flags[0] && u->fd < 0; i++) {
+        memset(&p, 0, sizeof p);
+        p.flags = try_flags[i];
+        p.cq_entries = UR_CQ_ENTRIES;
+        u->fd = (int)syscall(__NR_io_uring_setup, UR_SQ_ENTRIES, &p);
+    }
+    if (u->fd < 0) goto fail;
+    if ((p.features & need) != need) { errno = ENOTSUP; goto fail; }
+
+    size_t sq_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    u->ring_sz = sq_sz > cq_sz ? sq_sz : cq_sz;
+    u->ring = mmap(NULL, u->ring_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+    if (u->ring == MAP_FAILED) { u->ring = NULL; goto fail; }
+    u->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED) { u->sqes = NULL; goto fail; }
+    char *r = u->ring;
+    u->sq_head = (unsigned*)(r + p.sq_off.head);
+    u->sq_tail = (unsigned*)(r + p.sq_off.tail);
+    u->sq_mask = *(unsigned*)(r + p.sq_off.ring_mask);
+    u->sq_entries = p.sq_entries;
+    unsigned *sq_array = (unsigned*)(r + p.sq_off.array);
+    for (unsigned i=0;i<p.sq_entries;i++) sq_array[i] = i;   // SQE 與 array 位置一對一
+    u->sq_local = *u->sq_tail;
+    u->cq_head = (unsigned*)(r + p.cq_off.head);
+    u->cq_tail = (unsigned*)(r + p.cq_off.tail);
+    u->cq_mask = *(unsigned*)(r + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe*)(r + p.cq_off.cqes);
+
+    u->br_sz = UR_NBUFS * sizeof(struct io_uring_buf);
+    u->br = mmap(NULL, u->br_sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (u->br == MAP_FAILED) { u->br = NULL; goto fail; }
+    u->bufs_sz = (size_t)UR_NBUFS * UR_BUFSZ;
+    u->bufs = mmap(NULL, u->bufs_sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (u->bufs == MAP_FAILED) { u->bufs = NULL; goto fail; }
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof reg);
+    reg.ring_addr = (uint64_t)(uintptr_t)u->br;
+    reg.ring_entries = UR_NBUFS;
+    reg.bgid = UR_BGID;
+    if (syscall(__NR_io_uring_register, u->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) goto fail;
+    for (unsigned i=0;i<UR_NBUFS;i++) ur_buf_put(u, i);
+
+    if (ROBUST_ON(enable_timeouts) && g_robust.io_timeout_ms > 0) {
+        u->send_ts.tv_sec = g_robust.io_timeout_ms / 1000;
+        u->send_ts.tv_nsec = (long long)(g_robust.io_timeout_ms % 1000) * 1000000;
+    }
+    L->ur = u;
+    LOGD("io_uring ready: sq=%u cq=%u flags=0x%x features=0x%x", p.sq_entries, p.cq_entries, p.flags, p.features);
+    return 0;
+fail:
+    {
+        int e = errno;
+        ur_destroy(u);
+        errno = e;
+    }
+    return -1;
+}
+
+static void conn_free(struct ev_conn *c) {
+    close(c->fd);
+    frd_free(&c->rd); pool_put(c->out); pool_put(c->snd); free(c);
+}
+
+static void zombie_del(struct ev_loop *L, struct ev_conn *c) {
+    if (c->prev) c->prev->next = c->next; else L->zombies = c->next;
+    if (c->next) c->next->prev = c->prev;
+    c->prev = c->next = NULL;
+}
+
+// 連線的一個 SQE 已收到最後一個 CQE；已關閉且沒有其他操作時才釋放
+static void conn_put(struct ev_conn *c) {
+    if (--c->refs == 0 && c->torn_down) { zombie_del(c->loop, c); conn_free(c); }
+}
+
+// 關閉連線：取消 kernel 中所有以此 fd 為目標的操作，等它們都完成才 close (fd 號碼不能先被重用)
+static void conn_teardown(struct ev_conn *c) {
+    struct ev_loop *L = c->loop;
+    c->torn_down = 1;
+    conn_unlink(L, c);
+    tw_del(&L->wheel, &c->tmr);
+    L->nconns--;
+    stats_conn_close();
+    if (c->refs == 0) { conn_free(c); return; }
+    struct io_uring_sqe *e = ur_sqe(L->ur, 1);
+    if (e) {
+        e->opcode = IORING_OP_ASYNC_CANCEL;
+        e->fd = c->fd;
+        e->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+        e->user_data = UD(NULL, UD_NONE);
+    }
+    c->prev = NULL; c->next = L->zombies;
+    if (L->zombies) L->zombies->prev = c;
+    L->zombies = c;
+}
+
+// ===== 掛上操作 =====
+static void arm_accept(struct ev_loop *L, struct ev_listener *l) {
+    struct io_uring_sqe *e = ur_sqe(L->ur, 1);
+    if (!e) return;
+    e->opcode = IORING_OP_ACCEPT;
+    e->fd = l->fd;
+    e->ioprio = IORING_ACCEPT_MULTISHOT;
+    e->accept_flags = SOCK_CLOEXEC;
+    e->user_data = UD(l, UD_ACCEPT);
+    l->armed = 1;
+}
+
+static void arm_recv(struct ev_conn *c) {
+    struct io_uring_sqe *e = ur_sqe(c->loop->ur, 1);
+    if (!e) { c->dead = 1; return; }
+    e->opcode = IORING_OP_RECV;
+    e->fd = c->fd;
+    e->ioprio = IORING_RECV_MULTISHOT;
+    e->flags = IOSQE_BUFFER_SELECT;
+    e->buf_group = UR_BGID;
+    e->user_data = UD(c, UD_RECV);
+    c->recv_armed = 1;
+    c->refs++;
+}
+
+// 沒有 SEND 在 kernel 中時送出累積的回應；上一次沒送完的部分優先
+static void arm_send(struct ev_conn *c) {
+    struct ev_uring *u = c->loop->ur;
+    if (c->send_armed) return;
+    if (c->slen == c->soff) {   // 上一次已送完：交換緩衝區，out 繼續接收新的回應
+        if (c->olen == c->ooff) return;
+        char *b = c->snd; size_t cap = c->scap;
+        c->snd = c->out; c->slen = c->olen; c->soff = c->ooff; c->scap = c->ocap;
+        c->out = b; c->ocap = cap; c->olen = c->ooff = 0;
+    }
+    int tmo = u->send_ts.tv_sec || u->send_ts.tv_nsec;
+    struct io_uring_sqe *e = ur_sqe(u, tmo ? 2 : 1);
+    if (!e) { c->dead = 1; return; }
+    size_t n = c->slen - c->soff;
+    if (n > UINT32_MAX) n = UINT32_MAX;
+    TRACE(FLUSH, n, 0);
+    e->opcode = IORING_OP_SEND;
+    e->fd = c->fd;
+    e->addr = (uint64_t)(uintptr_t)(c->snd + c->soff);
+    e->len = (uint32_t)n;
+    e->msg_flags = MSG_NOSIGNAL;
+    e->user_data = UD(c, UD_SEND);
+    c->send_armed = 1;
+    c->refs++;
+    u->nsends++;
+    if (tmo) {
+        e->flags |= IOSQE_IO_LINK;
+        struct io_uring_sqe *t = ur_sqe(u, 1);
+        t->opcode = IORING_OP_LINK_TIMEOUT;
+        t->addr = (uint64_t)(uintptr_t)&u->send_ts;
+        t->len = 1;
+        t->user_data = UD(c, UD_TIMEOUT);
+        c->refs++;
+    }
+}
+
+// ===== 連線狀態更新 =====
+void ev_ur_kick(struct ev_conn *c) {
+    struct ev_loop *L = c->loop;
+    if (c->kicked || c->torn_down) return;
+    c->kicked = 1;
+    c->knext = L->kick_head;
+    L->kick_head = c;
+}
+
+// 解析新到的 frame、送出回應、依積壓程度暫停或恢復讀取，必要時關閉
+static void conn_service(struct ev_conn *c) {
+    struct ev_uring *u = c->loop->ur;
+    if (!c->dead && ev_conn_process_frames(c) < 0) c->dead = 1;
+    if (!c->dead) arm_send(c);
+    size_t pend = ev_out_pending(c);
+    if (c->dead || ((c->eof || c->closing) && pend == 0)) { conn_teardown(c); return; }
+    if (pend >= EV_OUT_HIWAT) {   // 對方不讀回應時先停止讀取，送出完成後再恢復
+        if (c->recv_armed && !c->recv_stopping) { ur_cancel(u, UD(c, UD_RECV)); c->recv_stopping = 1; }
+    } else if (!c->eof && !c->closing && !c->recv_armed) {
+        arm_recv(c);
+    }
+    ev_conn_timer_update(c);
+}
+
+static void run_kicks(struct ev_loop *L) {
+    while (L->kick_head) {
+        struct ev_conn *c = L->kick_head;
+        L->kick_head = c->knext;
+        c->kicked = 0;
+        conn_service(c);
+    }
+}
+
+// ===== CQE 處理 =====
+static void on_accept(struct ev_loop *L, struct ev_listener *l, const struct io_uring_cqe *cqe, int *nacc) {
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {   // multishot 結束 (被取消或出錯)，之後視情況重新掛上
+        l->armed = l->cancelling = 0;
+        if (cqe->res < 0 && cqe->res != -ECANCELED) l->retry_ms = mono_now_ms() + UR_RETRY_MS;
+    }
+    if (cqe->res < 0) {
+        if (cqe->res != -ECANCELED) LOGW("accept: %s", strerror(-cqe->res));
+        return;
+    }
+    int fd = cqe->res;
+    if (L->ur->closing) { close(fd); return; }
+    TRACE(ACCEPT, fd, 1);
+    sockopt_apply_conn(fd);
+    struct ev_conn *c = calloc(1, sizeof *c);
+    if (!c) { close(fd); return; }
+    c->kind = EV_KIND_CONN; c->fd = fd; c->loop = L;
+    frd_init(&c->rd);
+    L->nconns++;
+    stats_conn_open();
+    conn_link(L, c);
+    conn_touch(c);
+    ev_conn_timer_update(c);
+    arm_recv(c);
+    (*nacc)++;
+    LOGD("accepted fd=%d (conns=%d)", fd, L->nconns);
+}
+
+static void on_recv(struct ev_conn *c, const struct io_uring_cqe *cqe) {
+    struct ev_uring *u = c->loop->ur;
+    int more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+        unsigned bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        if (cqe->res > 0 && !c->torn_down && frd_append(&c->rd, u->bufs + (size_t)bid * UR_BUFSZ, (size_t)cqe->res) < 0) c->dead = 1;
+        ur_buf_put(u, bid);   // 已複製進 frame_reader，立即歸還
+    }
+    if (!c->torn_down) {
+        if (cqe->res > 0) conn_touch(c);
+        else if (cqe->res == 0) { LOGD("conn fd=%d closed by peer", c->fd); c->eof = 1; }
+        else if (cqe->res != -ENOBUFS && cqe->res != -ECANCELED) { LOGD("conn fd=%d recv: %s", c->fd, strerror(-cqe->res)); c->dead = 1; }
+        ev_ur_kick(c);
+    }
+    if (!more) { c->recv_armed = c->recv_stopping = 0; conn_put(c); }
+}
+
+static void on_send(struct ev_conn *c, const struct io_uring_cqe *cqe) {
+    c->send_armed = 0;
+    if (!c->torn_down) {
+        if (cqe->res >= 0) {
+            c->soff += (size_t)cqe->res;   // 沒送完的部分下一次 arm_send 再送
+            if (c->soff == c->slen) c->soff = c->slen = 0;
+            conn_touch(c);
+        } else if (cqe->res == -ECANCELED) {   // 連結的 LINK_TIMEOUT 到期
+            LOGI("conn fd=%d send timeout", c->fd);
+            stats_timeout();
+            c->dead = 1;
+        } else {
+            LOGD("conn fd=%d send: %s", c->fd, strerror(-cqe->res));
+            c->dead = 1;
+        }
+        ev_ur_kick(c);
+    }
+    conn_put(c);
+}
+
+// 處理目前 CQ 中的所有 CQE (只取一次 tail 快照，其餘留給下一輪)
+static void ur_reap(struct ev_loop *L) {
+    struct ev_uring *u = L->ur;
+    unsigned head = *u->cq_head, tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+    int nacc = 0;
+    while (head != tail) {
+        struct io_uring_cqe cqe = u->cqes[head & u->cq_mask];
+        __atomic_store_n(u->cq_head, ++head, __ATOMIC_RELEASE);
+        u->ncqes++;
+        void *p = UD_PTR(cqe.user_data);
+        switch (UD_TAG(cqe.user_data)) {
+        case UD_ACCEPT:  on_accept(L, p, &cqe, &nacc); break;
+        case UD_RECV:    on_recv(p, &cqe); break;
+        case UD_SEND:    on_send(p, &cqe); break;
+        case UD_TIMEOUT: conn_put(p); break;   // -ETIME 時對應的 SEND 會以 -ECANCELED 回報
+        default: break;                        // 取消操作本身的 CQE
+        }
+    }
+    if (nacc > 0) {
+        L->ast.accepted += (uint64_t)nacc; L->ast.batches++;
+        if ((uint32_t)nacc > L->ast.max_batch) L->ast.max_batch = (uint32_t)nacc;
+        if ((uint32_t)nacc > L->ast.max_qlen) L->ast.max_qlen = (uint32_t)nacc;
+        stats_note_accept(&L->ast);
+    }
+}
+
+// 連線數未達上限且不在收尾時掛著 accept，否則取消 (讓其他 worker 接手)；
+// 取消送出到生效之間已取得的連線照常服務，上限因此可能短暫超過幾條
+static int update_accepting(struct ev_loop *L) {
+    int want = !L->drain && (!L->max_conns || L->nconns < L->max_conns), retry = 0;
+    int64_t now = -1;
+    L->accepting = want;
+    for (struct ev_listener *l = L->listeners; l; l = l->next) {
+        if (want && !l->armed) {
+            if (l->retry_ms) {
+                if (now < 0) now = mono_now_ms();
+                if (now < l->retry_ms) { retry = 1; continue; }
+                l->retry_ms = 0;
+            }
+            arm_accept(L, l);
+        } else if (!want && l->armed && !l->cancelling) {
+            ur_cancel(L->ur, UD(l, UD_ACCEPT));
+            l->cancelling = 1;
+        }
+    }
+    return retry;
+}
+
+void ev_ur_conn_timeout(struct ev_conn *c) { conn_teardown(c); }
+
+int ev_ur_add_listener(struct ev_loop *L, struct ev_listener *l) {
+    (void)L;
+    l->armed = l->cancelling = 0;   // 進入 ev_ur_run 時才掛上 accept
+    return 0;
+}
+
+int ev_ur_run(struct ev_loop *L) {
+    struct ev_uring *u = L->ur;
+    while (!L->stop) {
+        int retry = update_accepting(L);
+        if (L->drain && L->nconns == 0) break;   // 不再接新連線，現有連線都結束後離開
+        log_flush();   // 進入等待前把累積的 log 寫出
+        TRACE_IDLE();
+        unsigned pend = ur_publish(u);
+        int rc = 0;
+        if (ur_cq_ready(u)) {   // 還有沒處理完的 CQE：只送出，不等待
+            if (pend) rc = ur_enter(u, pend, 0, 0, NULL, 0);
+        } else {
+            int wait_ms = ev_loop_wait_ms(L);
+            if (retry && (wait_ms < 0 || wait_ms > UR_RETRY_MS)) wait_ms = UR_RETRY_MS;
+            struct __kernel_timespec ts = { wait_ms / 1000, (long long)(wait_ms % 1000) * 1000000 };
+            struct io_uring_getevents_arg arg;
+            memset(&arg, 0, sizeof arg);
+            if (L->has_mask) { arg.sigmask = (uint64_t)(uintptr_t)&L->mask; arg.sigmask_sz = _NSIG / 8; }
+            if (wait_ms >= 0) arg.ts = (uint64_t)(uintptr_t)&ts;
+            rc = ur_enter(u, pend, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof arg);
+        }
+        if (rc < 0 && errno != EINTR && errno != ETIME && errno != EAGAIN && errno != EBUSY) {
+            LOGE("io_uring_enter: %s", strerror(errno));
+            return -1;
+        }
+        ur_reap(L);
+        run_kicks(L);
+        tw_advance(&L->wheel, mono_now_ms());
+    }
+    return 0;
+}
+
+void ev_ur_free(struct ev_loop *L) {
+    struct ev_uring *u = L->ur;
+    u->closing = 1;
+    while (L->conns) conn_teardown(L->conns);
+    for (struct ev_listener *l = L->listeners; l; l = l->next)
+        if (l->armed && !l->cancelling) { ur_cancel(u, UD(l, UD_ACCEPT)); l->cancelling = 1; }
+    // 等取消的操作回報完成，kernel 不再使用連線緩衝區後才釋放
+    for (int i=0; i<UR_FREE_WAIT; i++) {
+        int busy = L->zombies != NULL;
+        for (struct ev_listener *l = L->listeners; l; l = l->next) busy |= l->armed;
+        if (!busy) break;
+        struct __kernel_timespec ts = { 0, 10 * 1000000 };
+        struct io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof arg);
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+        ur_enter(u, ur_publish(u), 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof arg);
+        ur_reap(L);
+    }
+    while (L->zombies) { struct ev_conn *c = L->zombies; zombie_del(L, c); conn_free(c); }
+    LOGI("worker %d io_uring: %lu enters, %lu cqes, %lu sends", (int)getpid(), u->enters, u->ncqes, u->nsends);
+    ur_destroy(u);
+    L->ur = NULL;
+}
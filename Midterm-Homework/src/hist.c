@@ -0,0 +1,65 @@
+// ============================================================
+// 這支檔案實作 libutils.so 中的延遲直方圖。
+// v < 64 時每個值一格；之後每個 2 的次方區間保留最高 6 位元，
+// 切成 32 格，因此 bucket 編號可用位元運算直接算出。
+// ============================================================
+#include "hist.h"
+#include <string.h>
+
+int hist_bucket(uint64_t v) {
+    if (v < (1u << HIST_SUB_BITS)) return (int)v;
+    int msb = 63 - __builtin_clzll(v);
+    int shift = msb - (HIST_SUB_BITS - 1);           // >= 1
+    int mant = (int)(v >> shift) - (1 << (HIST_SUB_BITS - 1)); // 0..31
+    return (1 << HIST_SUB_BITS) + (shift - 1) * (1 << (HIST_SUB_BITS - 1)) + mant;
+}
+
+// bucket 的上界 (含)
+static uint64_t bucket_hi(int idx) {
+    if (idx < (1 << HIST_SUB_BITS)) return (uint64_t)idx;
+    int rel = idx - (1 << HIST_SUB_BITS);
+    int shift = rel / (1 << (HIST_SUB_BITS - 1)) + 1;
+    uint64_t mant = (uint64_t)(rel % (1 << (HIST_SUB_BITS - 1)) + (1 << (HIST_SUB_BITS - 1)));
+    return ((mant + 1) << shift) - 1;
+}
+
+void hist_init(struct hist *h) {
+    memset(h, 0, sizeof *h);
+    h->min = UINT64_MAX;
+}
+
+void hist_record(struct hist *h, uint64_t v) {
+    h->counts[hist_bucket(v)]++;
+    h->total++;
+    h->sum += (double)v;
+    if (v < h->min) h->min = v;
+    if (v > h->max) h->max = v;
+}
+
+void hist_merge(struct hist *dst, const struct hist *src) {
+    for (int i=0;i<HIST_BUCKETS;i++) dst->counts[i] += src->counts[i];
+    dst->total += src->total;
+    dst->sum += src->sum;
+    if (src->min < dst->min) dst->min = src->min;
+    if (src->max > dst->max) dst->max = src->max;
+}
+
+uint64_t hist_percentile(const struct hist *h, double p) {
+    if (!h->total) return 0;
+    uint64_t want = (uint64_t)((p / 100.0) * (double)h->total + 0.5);
+    if (want < 1) want = 1;
+    if (want > h->total) want = h->total;
+    uint64_t acc = 0;
+    for (int i=0;i<HIST_BUCKETS;i++) {
+        acc += h->counts[i];
+        if (acc >= want) {
+            uint64_t hi = bucket_hi(i);
+            return hi > h->max ? h->max : hi;
+        }
+    }
+    return h->max;
+}
+
+double hist_mean(const struct hist *h) {
+    return h->total ? h->sum / (double)h->total : 0.0;
+}
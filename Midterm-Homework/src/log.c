@@ -0,0 +1,320 @@
+// ============================================================
+// 這支檔案實作 libutils.so 中的 Logging 系統。
+// 同步模式：整行先格式化在堆疊緩衝區，再以單一 write() 輸出；
+//           時間字串每秒只格式化一次 (快取)。
+// 非同步模式 (log_set_async)：log_msg 只把「時間戳 + fmt 指標 + 參數」
+//           以二進位記錄寫進行程內的緩衝區，格式化與 write() 延後到
+//           log_flush() 時批次進行。每個行程各自一份緩衝區且不使用
+//           thread，因此不需要任何鎖。
+// ============================================================
+#include "common.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+// ===== Runtime Logging 實作 =====
+// 透過 log_set_level / log_msg 控制輸出層級
+static int g_log_level = LOG_INFO;
+static const char *g_prog = "app";
+static int g_pid = 0;                        // 快取的 PID，fork 後由 atfork handler 更新
+static volatile sig_atomic_t g_in_log = 0;   // 訊號處理函式重入時改走同步輸出
+
+static const char *level_tag(int lvl) {
+    return lvl==LOG_ERROR?"ERROR": lvl==LOG_WARN?"WARN": lvl==LOG_INFO?"INFO":"DEBUG";
+}
+
+// ===== 時間字串快取 =====
+static time_t g_ts_sec = (time_t)-1;
+static char g_ts_str[32];
+
+static const char *ts_string(time_t sec) {
+    if (sec != g_ts_sec) {   // 每秒才做一次 localtime_r + strftime
+        struct tm tm; localtime_r(&sec, &tm);
+        strftime(g_ts_str, sizeof g_ts_str, "%F %T", &tm); // YYYY-MM-DD HH:MM:SS
+        g_ts_sec = sec;
+    }
+    return g_ts_str;
+}
+
+static int fmt_prefix(char *out, size_t cap, int64_t ts_us, int pid, int lvl) {
+    time_t sec = (time_t)(ts_us / 1000000);
+    int n = snprintf(out, cap, "%s.%03ld %s[%d] %s: ", ts_string(sec), (long)((ts_us % 1000000) / 1000),
+                     g_prog, pid, level_tag(lvl)); // 前綴（時間.毫秒 程式名[PID] 等級: ）
+    return n < 0 ? 0 : ((size_t)n < cap ? n : (int)cap - 1);
+}
+
+static int64_t now_us(void) {
+    struct timeval tv; gettimeofday(&tv, NULL);  // vDSO，不進 kernel
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void write_all(const char *p, size_t n) {
+    while (n) {
+        ssize_t w = write(STDERR_FILENO, p, n);
+        if (w < 0) { if (errno == EINTR) continue; return; }
+        p += w; n -= (size_t)w;
+    }
+}
+
+// ===== 非同步記錄緩衝區 =====
+// 每筆記錄：log_rec 標頭 + (ARGS) 型別表 / 8-byte 參數槽 / 字串資料，或 (TEXT) 已格式化文字
+#define LOG_BUF_SIZE     (256*1024)
+#define LOG_FLUSH_HIWAT  (LOG_BUF_SIZE/2)   // 超過一半就在 log_msg 內直接批次輸出
+#define LOG_FLUSH_MS     100                // 距上次 flush 過久也會觸發
+#define LOG_MAX_ARGS     16
+#define LOG_MAX_STR      1024
+#define LOG_MAX_REC      4096
+
+enum { REC_ARGS = 0, REC_TEXT = 1 };
+enum { A_INT = 1, A_LONG, A_LLONG, A_SIZE, A_PTRDIFF, A_INTMAX, A_DOUBLE, A_PTR, A_STR };
+
+struct log_rec {
+    uint32_t size;          // 整筆記錄長度 (8-byte 對齊)
+    uint8_t  lvl, kind, nargs, pad;
+    int64_t  ts_us;
+    const char *fmt;        // 格式字串為程式中的常數，行程內指標始終有效
+};
+
+union log_arg { int64_t i; double d; const void *p; uint32_t str_off; };
+
+static int g_async = 0;
+static char *g_buf = NULL;
+static size_t g_len = 0;
+static int64_t g_last_flush_us = 0;
+static int g_atfork_done = 0;
+
+static void log_atfork_prepare(void) { log_flush(); }   // fork 前先把父行程的記錄寫出
+static void log_atfork_child(void) { g_pid = (int)getpid(); g_len = 0; }
+
+static void ensure_init(void) {
+    if (!g_pid) g_pid = (int)getpid();
+    if (!g_atfork_done) { pthread_atfork(log_atfork_prepare, NULL, log_atfork_child); g_atfork_done = 1; }
+}
+
+void log_set_level(int lvl) { g_log_level = lvl; }
+void log_set_prog(const char *name) { g_prog = name ? name : g_prog; }
+
+void log_set_async(int on) {
+    ensure_init();
+    if (!on) { log_flush(); g_async = 0; return; }
+    if (!g_buf) {
+        g_buf = malloc(LOG_BUF_SIZE);
+        if (g_buf) atexit(log_flush);   // 正常結束時寫出剩餘記錄
+    }
+    g_async = g_buf != NULL;
+}
+
+// 解析 fmt 中每個轉換規格需要的參數型別；遇到無法安全延後格式化的規格 (%n、%m、%Lf、%ls…) 回傳 -1
+static int scan_format(const char *fmt, uint8_t *types) {
+    int n = 0;
+    for (const char *p = fmt; *p; p++) {
+        if (*p != '%') continue;
+        p++;
+        if (*p == '%') continue;
+        while (*p && strchr("-+ #0'I", *p)) p++;                  // flags
+        if (*p == '*') { if (n >= LOG_MAX_ARGS) return -1; types[n++] = A_INT; p++; }
+        else while (*p >= '0' && *p <= '9') p++;                 // width
+        if (*p == '.') {
+            p++;
+            if (*p == '*') { if (n >= LOG_MAX_ARGS) return -1; types[n++] = A_INT; p++; }
+            else while (*p >= '0' && *p <= '9') p++;             // precision
+        }
+        int len = 0;   // 0=無, 1=l, 2=ll, 3=z, 4=t, 5=j, 6=L
+        if (*p == 'h') { p++; if (*p == 'h') p++; }
+        else if (*p == 'l') { p++; len = 1; if (*p == 'l') { p++; len = 2; } }
+        else if (*p == 'q') { p++; len = 2; }
+        else if (*p == 'z' || *p == 'Z') { p++; len = 3; }
+        else if (*p == 't') { p++; len = 4; }
+        else if (*p == 'j') { p++; len = 5; }
+        else if (*p == 'L') { p++; len = 6; }
+        if (n >= LOG_MAX_ARGS) return -1;
+        switch (*p) {
+        case 'd': case 'i': case 'o': case 'u': case 'x': case 'X': case 'c':
+            if (*p == 'c' && len) return -1;
+            types[n++] = len==0 ? A_INT : len==1 ? A_LONG : len==2 ? A_LLONG : len==3 ? A_SIZE :
+                         len==4 ? A_PTRDIFF : len==5 ? A_INTMAX : 0;
+            if (!types[n-1]) return -1;
+            break;
+        case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+            if (len == 6) return -1;
+            types[n++] = A_DOUBLE; break;
+        case 's': if (len) return -1; types[n++] = A_STR; break;
+        case 'p': types[n++] = A_PTR; break;
+        default: return -1;   // %n、%m 或不認得的規格
+        }
+        if (!*p) return -1;
+    }
+    return n;
+}
+
+#define REC_ALIGN(x) (((x) + 7u) & ~(size_t)7u)
+
+// 把一筆記錄加到緩衝區；回傳 -1 表示此訊息無法延後，呼叫端改用同步輸出
+static int async_append(int lvl, int64_t ts, const char *fmt, va_list ap) {
+    uint8_t types[LOG_MAX_ARGS];
+    int nargs = scan_format(fmt, types);
+    char tmp[LOG_MAX_REC];
+    struct log_rec *r = (struct log_rec*)tmp;
+    size_t off = sizeof *r;
+    r->lvl = (uint8_t)lvl; r->ts_us = ts; r->fmt = fmt; r->pad = 0;
+    if (nargs >= 0) {
+        r->kind = REC_ARGS; r->nargs = (uint8_t)nargs;
+        memcpy(tmp + off, types, (size_t)nargs);
+        off = REC_ALIGN(off + (size_t)nargs);
+        union log_arg *vals = (union log_arg*)(tmp + off);
+        off += sizeof(union log_arg) * (size_t)nargs;
+        for (int i=0;i<nargs;i++) {
+            switch (types[i]) {
+            case A_INT:     vals[i].i = va_arg(ap, int); break;
+            case A_LONG:    vals[i].i = va_arg(ap, long); break;
+            case A_LLONG:   vals[i].i = va_arg(ap, long long); break;
+            case A_SIZE:    vals[i].i = (int64_t)va_arg(ap, size_t); break;
+            case A_PTRDIFF: vals[i].i = va_arg(ap, ptrdiff_t); break;
+            case A_INTMAX:  vals[i].i = va_arg(ap, intmax_t); break;
+            case A_DOUBLE:  vals[i].d = va_arg(ap, double); break;
+            case A_PTR:     vals[i].p = va_arg(ap, void*); break;
+            case A_STR: {   // 字串內容必須複製，指標在 flush 時可能已失效
+                const char *s = va_arg(ap, const char*);
+                if (!s) s = "(null)";
+                size_t sl = strnlen(s, LOG_MAX_STR);
+                if (off + sl + 1 > sizeof tmp) return -1;
+                vals[i].str_off = (uint32_t)off;
+                memcpy(tmp + off, s, sl); tmp[off + sl] = '\0';
+                off += sl + 1;
+                break;
+            }
+            }
+        }
+    } else {
+        r->kind = REC_TEXT; r->nargs = 0;
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+        int n = vsnprintf(tmp + off, sizeof tmp - off, fmt, ap);
+#pragma GCC diagnostic pop
+        if (n < 0) return -1;
+        off += ((size_t)n < sizeof tmp - off ? (size_t)n : sizeof tmp - off - 1) + 1;
+    }
+    off = REC_ALIGN(off);
+    r->size = (uint32_t)off;
+    if (g_len + off > LOG_BUF_SIZE) log_flush();
+    memcpy(g_buf + g_len, tmp, off);
+    g_len += off;
+    return 0;
+}
+
+// 依記錄重新格式化：逐段複製文字，每個轉換規格以對應型別單獨呼叫 snprintf
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+static size_t render_args(char *out, size_t cap, const struct log_rec *r) {
+    const char *base = (const char*)r;
+    const uint8_t *types = (const uint8_t*)(base + sizeof *r);
+    const union log_arg *vals = (const union log_arg*)(base + REC_ALIGN(sizeof *r + r->nargs));
+    size_t o = 0; int ai = 0;
+    for (const char *p = r->fmt; *p && o + 1 < cap; ) {
+        if (*p != '%') { out[o++] = *p++; continue; }
+        if (p[1] == '%') { out[o++] = '%'; p += 2; continue; }
+        const char *q = p + 1;   // 找出整個規格
+        while (*q && !strchr("diouxXcaAeEfFgGsp", *q)) q++;
+        size_t sl = (size_t)(q - p) + 1;
+        char spec[64];
+        if (!*q || sl >= sizeof spec) break;
+        memcpy(spec, p, sl); spec[sl] = '\0';
+        p = q + 1;
+        int st[2], ns = 0;
+        for (const char *s = spec; *s; s++) if (*s == '*' && ns < 2) st[ns++] = (int)vals[ai++].i;
+        const union log_arg *v = &vals[ai];
+        int t = types[ai++];
+        size_t room = cap - o; int w = 0;
+#define EMIT(val) do { \
+            if (ns == 0) w = snprintf(out + o, room, spec, val); \
+            else if (ns == 1) w = snprintf(out + o, room, spec, st[0], val); \
+            else w = snprintf(out + o, room, spec, st[0], st[1], val); } while (0)
+        switch (t) {
+        case A_INT:     EMIT((int)v->i); break;
+        case A_LONG:    EMIT((long)v->i); break;
+        case A_LLONG:   EMIT((long long)v->i); break;
+        case A_SIZE:    EMIT((size_t)v->i); break;
+        case A_PTRDIFF: EMIT((ptrdiff_t)v->i); break;
+        case A_INTMAX:  EMIT((intmax_t)v->i); break;
+        case A_DOUBLE:  EMIT(v->d); break;
+        case A_PTR:     EMIT(v->p); break;
+        case A_STR:     EMIT(base + v->str_off); break;
+        }
+#undef EMIT
+        if (w < 0) break;
+        o += (size_t)w < room ? (size_t)w : room - 1;
+    }
+    out[o] = '\0';
+    return o;
+}
+#pragma GCC diagnostic pop
+
+void log_flush(void) {
+    if (!g_len || g_in_log) return;
+    g_in_log = 1;
+    char out[16384]; size_t o = 0;
+    for (size_t off = 0; off < g_len; ) {
+        const struct log_rec *r = (const struct log_rec*)(g_buf + off);
+        char line[LOG_MAX_REC + 128];
+        size_t n = (size_t)fmt_prefix(line, sizeof line, r->ts_us, g_pid, r->lvl);
+        if (r->kind == REC_ARGS) n += render_args(line + n, sizeof line - n - 1, r);
+        else {
+            const char *txt = (const char*)r + sizeof *r;
+            size_t tl = strnlen(txt, sizeof line - n - 2);
+            memcpy(line + n, txt, tl); n += tl;
+        }
+        line[n++] = '\n';
+        if (o + n > sizeof out) { write_all(out, o); o = 0; }   // 累積成大塊再 write
+        memcpy(out + o, line, n); o += n;
+        off += r->size;
+    }
+    write_all(out, o);
+    g_len = 0;
+    g_last_flush_us = now_us();
+    g_in_log = 0;
+}
+
+// 輸出日誌訊息 (包含時間、PID、層級)
+void log_msg(int lvl, const char *fmt, ...) {
+    if (lvl > g_log_level) return; // 若訊息層級高於目前設定則不輸出
+    int saved_errno = errno;  // %m 與呼叫端都依賴 errno，不能被 log 本身改掉
+    ensure_init();
+    int64_t ts = now_us();  // 取得目前時間（含微秒）
+    va_list ap; va_start(ap, fmt);
+    if (g_async && !g_in_log) {
+        g_in_log = 1;
+        va_list aq; va_copy(aq, ap);
+        int rc = async_append(lvl, ts, fmt, aq);
+        va_end(aq);
+        g_in_log = 0;
+        if (rc == 0) {
+            va_end(ap);
+            // 錯誤訊息立即寫出；其餘累積到一定量或間隔才批次輸出
+            if (lvl == LOG_ERROR || g_len >= LOG_FLUSH_HIWAT || ts - g_last_flush_us >= LOG_FLUSH_MS * 1000) log_flush();
+            errno = saved_errno;
+            return;
+        }
+        log_flush(); // 無法延後的訊息：先送出前面的記錄以維持順序
+    }
+    char line[LOG_MAX_REC];
+    int n = fmt_prefix(line, sizeof line, ts, g_pid, lvl);
+    errno = saved_errno;
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+    int m = vsnprintf(line + n, sizeof line - (size_t)n - 1, fmt, ap);
+#pragma GCC diagnostic pop
+    va_end(ap);
+    if (m < 0) m = 0;
+    if ((size_t)m > sizeof line - (size_t)n - 2) m = (int)(sizeof line - (size_t)n - 2); // 過長則截斷
+    n += m;
+    line[n++] = '\n';
+    write_all(line, (size_t)n);   // 整行一次 write，避免多個行程交錯
+    errno = saved_errno;
+}
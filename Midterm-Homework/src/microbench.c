@@ -0,0 +1,334 @@
+// ============================================================
+// 這支程式為 libutils 熱路徑的微基準測試 (bin/microbench)。
+// 每個項目先倍增迭代次數校準到一批約 --min-time / --reps 毫秒，
+// 再量測 --reps 批，回報每次操作的中位數與最小值 (ns/op)，不受單批雜訊影響。
+// 項目：send_frame/recv_frame_pooled (socketpair，單向與經 echo 子行程的來回)、frd_next 解析、
+// header 驗證、get_system_info_pooled (快取前後)、log_msg (啟用/過濾掉/非同步)、LZ4、緩衝區池。
+// --json 輸出單一 JSON 物件，供 make bench (bench.sh) 彙整後跨 commit 比較。
+// ============================================================
+#include "common.h"
+#include "compress.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#define MB_MAX_REPS 31
+
+struct mb_ctx {
+    int sp[2];          // socketpair：sp[0] 送、sp[1] 收 (echo 模式時 sp[1] 在子行程)
+    pid_t echo_pid;
+    uint32_t size;
+    char *buf, *aux;
+    size_t aux_len;
+    struct frame_reader rd;
+};
+
+struct mb_case {
+    const char *name;
+    uint32_t size;                      // payload 大小 (不適用時為 0)
+    int  (*setup)(struct mb_ctx *c);    // 回傳 -1 = 略過這個項目
+    void (*run)(struct mb_ctx *c, uint64_t iters);
+    void (*teardown)(struct mb_ctx *c);
+};
+
+static volatile uint64_t g_sink;   // 防止編譯器把結果丟掉
+
+static void die_io(const char *what) { LOGE("%s: %s", what, strerror(errno)); exit(1); }
+
+// ===== send_frame / recv_frame_pooled =====
+static int setup_pair(struct mb_ctx *c) {
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, c->sp) < 0) return -1;
+    int sz = 4 * 1024 * 1024;
+    for (int i = 0; i < 2; i++) {
+        setsockopt(c->sp[i], SOL_SOCKET, SO_SNDBUF, &sz, sizeof sz);
+        setsockopt(c->sp[i], SOL_SOCKET, SO_RCVBUF, &sz, sizeof sz);
+    }
+    c->buf = malloc(c->size ? c->size : 1);
+    if (!c->buf) return -1;
+    for (uint32_t i = 0; i < c->size; i++) c->buf[i] = (char)(i * 131 >> 3);
+    return 0;
+}
+static void teardown_pair(struct mb_ctx *c) {
+    if (c->sp[0] >= 0) close(c->sp[0]);
+    if (c->sp[1] >= 0) close(c->sp[1]);
+    if (c->echo_pid > 0) { int st; waitpid(c->echo_pid, &st, 0); }
+    free(c->buf); free(c->aux);
+}
+
+// 單向：同一行程送出後立即收回，量的是兩端的函式庫與 syscall 成本，沒有排程切換
+static void run_oneway(struct mb_ctx *c, uint64_t iters) {
+    for (uint64_t i = 0; i < iters; i++) {
+        struct msg_hdr h; void *pl; uint32_t len;
+        if (send_frame(c->sp[0], REQ_ECHO, c->buf, c->size, -1) < 0) die_io("send_frame");
+        if (recv_frame_pooled(c->sp[1], &h, &pl, &len, -1) < 0) die_io("recv_frame_pooled");
+        g_sink += len;
+        frame_free(pl);
+    }
+}
+
+// 來回：子行程以 recv_frame_pooled/send_frame 回送，payload 大於 socket 緩衝區也能量
+static int setup_echo(struct mb_ctx *c) {
+    if (setup_pair(c) < 0) return -1;
+    c->echo_pid = fork();
+    if (c->echo_pid < 0) return -1;
+    if (c->echo_pid == 0) {
+        close(c->sp[0]);
+        struct msg_hdr h; void *pl; uint32_t len;
+        while (recv_frame_pooled(c->sp[1], &h, &pl, &len, -1) == 0) {
+            int rc = send_frame(c->sp[1], RESP_ECHO, pl, len, -1);
+            frame_free(pl);
+            if (rc < 0) break;
+        }
+        _exit(0);
+    }
+    close(c->sp[1]); c->sp[1] = -1;
+    return 0;
+}
+static void run_echo(struct mb_ctx *c, uint64_t iters) {
+    for (uint64_t i = 0; i < iters; i++) {
+        struct msg_hdr h; void *pl; uint32_t len;
+        if (send_frame(c->sp[0], REQ_ECHO, c->buf, c->size, -1) < 0) die_io("send_frame");
+        if (recv_frame_pooled(c->sp[0], &h, &pl, &len, -1) < 0) die_io("recv_frame_pooled");
+        g_sink += len;
+        frame_free(pl);
+    }
+}
+
+// ===== frame_reader：一個緩衝區內 64 個 pipelined frame 的解析 =====
+#define MB_PIPE_FRAMES 64
+static int setup_frd(struct mb_ctx *c) {
+    size_t flen = sizeof(struct msg_hdr) + c->size;
+    c->aux_len = flen * MB_PIPE_FRAMES;
+    c->aux = malloc(c->aux_len);
+    if (!c->aux) return -1;
+    for (int i = 0; i < MB_PIPE_FRAMES; i++) {
+        struct msg_hdr h = { htonl(MSG_MAGIC), htons(REQ_ECHO), 0, htonl(c->size) };
+        memcpy(c->aux + flen * (size_t)i, &h, sizeof h);
+        memset(c->aux + flen * (size_t)i + sizeof h, 'x', c->size);
+    }
+    frd_init(&c->rd);
+    return 0;
+}
+static void teardown_frd(struct mb_ctx *c) { frd_free(&c->rd); free(c->aux); }
+static void run_frd(struct mb_ctx *c, uint64_t iters) {   // 1 op = 一個 frame
+    for (uint64_t i = 0; i < iters; i += MB_PIPE_FRAMES) {
+        if (frd_append(&c->rd, c->aux, c->aux_len) < 0) die_io("frd_append");
+        struct msg_hdr h; const void *pl; uint32_t len;
+        while (frd_next(&c->rd, &h, &pl, &len) == 1) g_sink += len;
+    }
+}
+
+// ===== header 驗證 =====
+static void run_validate_ok(struct mb_ctx *c, uint64_t iters) {
+    (void)c;
+    struct msg_hdr h[4] = {
+        { htonl(MSG_MAGIC), htons(REQ_PING), 0, htonl(4) },
+        { htonl(MSG_MAGIC), htons(REQ_ECHO), htons(MSG_F_MORE), htonl(65536) },
+        { htonl(MSG_MAGIC), htons(REQ_SYSINFO), 0, 0 },
+        { htonl(MSG_MAGIC), htons(RESP_ECHO), htons(MSG_F_LZ4), htonl(100) },
+    };
+    uint64_t ok = 0;
+    for (uint64_t i = 0; i < iters; i++) ok += (uint64_t)frame_validate_hdr(&h[i & 3]);
+    g_sink += ok;
+}
+static void run_validate_bad(struct mb_ctx *c, uint64_t iters) {
+    (void)c;
+    struct msg_hdr h[4] = {
+        { htonl(0xdeadbeefu), htons(REQ_PING), 0, htonl(4) },         // magic 錯誤
+        { htonl(MSG_MAGIC), htons(200), 0, 0 },                       // 未定義型別
+        { htonl(MSG_MAGIC), htons(REQ_PING), htons(0x8000), 0 },      // 未定義旗標
+        { htonl(MSG_MAGIC), htons(REQ_ECHO), 0, htonl(FRAME_MAX_LEN + 1) },
+    };
+    uint64_t ok = 0;
+    for (uint64_t i = 0; i < iters; i++) ok += (uint64_t)frame_validate_hdr(&h[i & 3]);
+    g_sink += ok;
+}
+
+// ===== get_system_info_pooled =====
+static void run_sysinfo(struct mb_ctx *c, uint64_t iters) {
+    (void)c;
+    for (uint64_t i = 0; i < iters; i++) {
+        char *s = get_system_info_pooled();
+        if (!s) die_io("get_system_info_pooled");
+        g_sink += (uint64_t)s[0];
+        frame_free(s);
+    }
+}
+// 快取建立後就回不去非快取路徑，所以這個項目排在所有 sysinfo 項目的最後
+static int setup_sysinfo_cached(struct mb_ctx *c) { (void)c; return sysinfo_cache_init(1000); }
+
+// ===== log_msg：stderr 暫時導向 /dev/null =====
+static int g_saved_stderr = -1;
+static int setup_log(struct mb_ctx *c) {
+    (void)c;
+    int fd = open("/dev/null", O_WRONLY);
+    if (fd < 0) return -1;
+    fflush(stderr);
+    g_saved_stderr = dup(STDERR_FILENO);
+    dup2(fd, STDERR_FILENO); close(fd);
+    log_set_level(LOG_INFO);
+    return 0;
+}
+static void teardown_log(struct mb_ctx *c) {
+    (void)c;
+    log_flush();
+    log_set_async(0);
+    log_set_level(LOG_WARN);
+    dup2(g_saved_stderr, STDERR_FILENO); close(g_saved_stderr);
+}
+static int setup_log_async(struct mb_ctx *c) {
+    if (setup_log(c) < 0) return -1;
+    log_set_async(1);
+    return 0;
+}
+static void run_log_enabled(struct mb_ctx *c, uint64_t iters) {
+    (void)c;
+    for (uint64_t i = 0; i < iters; i++) log_msg(LOG_INFO, "request type=%u len=%u from fd=%d", 20u, (unsigned)i, 7);
+}
+static void run_log_disabled(struct mb_ctx *c, uint64_t iters) {   // 執行期層級過濾 (LOGD 編譯期就移除，不必量)
+    (void)c;
+    for (uint64_t i = 0; i < iters; i++) log_msg(LOG_DEBUG, "request type=%u len=%u from fd=%d", 20u, (unsigned)i, 7);
+}
+
+// ===== LZ4 (frame 壓縮) =====
+static int setup_lz4(struct mb_ctx *c) {
+    static const char words[] = "sysinfo node=vm release=6.1 load=0.10 mem_total=2048MB free=1024MB ";
+    c->buf = malloc(c->size);
+    c->aux = malloc(lz4_bound(c->size));
+    if (!c->buf || !c->aux) return -1;
+    uint64_t r = 88172645463325252ull;
+    for (uint32_t i = 0; i < c->size; i++) {   // 文字為主、夾雜少量雜訊，接近實際的回應內容
+        r ^= r << 13; r ^= r >> 7; r ^= r << 17;
+        c->buf[i] = (r & 31) ? words[i % (sizeof words - 1)] : (char)r;
+    }
+    c->aux_len = lz4_compress(c->buf, c->size, c->aux, lz4_bound(c->size));
+    return c->aux_len ? 0 : -1;
+}
+static void teardown_lz4(struct mb_ctx *c) { free(c->buf); free(c->aux); }
+static void run_lz4_compress(struct mb_ctx *c, uint64_t iters) {
+    char *out = malloc(lz4_bound(c->size));
+    if (!out) die_io("malloc");
+    for (uint64_t i = 0; i < iters; i++) g_sink += lz4_compress(c->buf, c->size, out, lz4_bound(c->size));
+    free(out);
+}
+static void run_lz4_decompress(struct mb_ctx *c, uint64_t iters) {
+    char *out = malloc(c->size);
+    if (!out) die_io("malloc");
+    for (uint64_t i = 0; i < iters; i++) g_sink += (uint64_t)lz4_decompress(c->aux, c->aux_len, out, c->size);
+    free(out);
+}
+
+// ===== 緩衝區池 =====
+static void run_pool(struct mb_ctx *c, uint64_t iters) {
+    for (uint64_t i = 0; i < iters; i++) {
+        void *p = pool_get(c->size, NULL);
+        g_sink += (uintptr_t)p;
+        pool_put(p);
+    }
+}
+
+static const struct mb_case g_cases[] = {
+    { "frame_oneway_64",      64,      setup_pair, run_oneway,  teardown_pair },
+    { "frame_oneway_4k",      4096,    setup_pair, run_oneway,  teardown_pair },
+    { "frame_rtt_64",         64,      setup_echo, run_echo,    teardown_pair },
+    { "frame_rtt_4k",         4096,    setup_echo, run_echo,    teardown_pair },
+    { "frame_rtt_1m",         1 << 20, setup_echo, run_echo,    teardown_pair },
+    { "frd_next_pipelined_64", 64,     setup_frd,  run_frd,     teardown_frd },
+    { "validate_hdr_ok",      0,       NULL,       run_validate_ok,  NULL },
+    { "validate_hdr_bad",     0,       NULL,       run_validate_bad, NULL },
+    { "get_system_info",      0,       NULL,       run_sysinfo, NULL },
+    { "get_system_info_cached", 0,     setup_sysinfo_cached, run_sysinfo, NULL },
+    { "log_msg_enabled",      0,       setup_log,  run_log_enabled,  teardown_log },
+    { "log_msg_disabled",     0,       setup_log,  run_log_disabled, teardown_log },
+    { "log_msg_async",        0,       setup_log_async, run_log_enabled, teardown_log },
+    { "lz4_compress_64k",     65536,   setup_lz4,  run_lz4_compress,   teardown_lz4 },
+    { "lz4_decompress_64k",   65536,   setup_lz4,  run_lz4_decompress, teardown_lz4 },
+    { "pool_get_put_4k",      4096,    NULL,       run_pool,    NULL },
+};
+#define MB_NCASES (sizeof g_cases / sizeof g_cases[0])
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+struct mb_result { double median_ns, min_ns; uint64_t iters; };
+
+static void mb_measure(const struct mb_case *k, struct mb_ctx *c, int min_ms, int reps, struct mb_result *out) {
+    int64_t batch_ns = (int64_t)min_ms * 1000000 / reps;
+    uint64_t iters = 1;
+    for (;;) {   // 校準 (同時暖身)：一批至少 batch_ns
+        int64_t t0 = mono_now_ns();
+        k->run(c, iters);
+        int64_t dt = mono_now_ns() - t0;
+        if (dt >= batch_ns || iters >= (1ull << 40)) break;
+        uint64_t next = dt > 0 ? (uint64_t)((double)iters * (double)batch_ns / (double)dt * 1.2) : iters * 16;
+        iters = next > iters * 16 ? iters * 16 : (next > iters ? next : iters * 2);
+    }
+    double t[MB_MAX_REPS];
+    for (int r = 0; r < reps; r++) {
+        int64_t t0 = mono_now_ns();
+        k->run(c, iters);
+        t[r] = (double)(mono_now_ns() - t0) / (double)iters;
+    }
+    qsort(t, (size_t)reps, sizeof t[0], cmp_double);
+    out->median_ns = t[reps / 2];
+    out->min_ns = t[0];
+    out->iters = iters;
+}
+
+static void usage(const char *arg0) {
+    fprintf(stderr, "Usage: %s [--json] [--min-time MS] [--reps N] [--filter SUBSTR] [--list]\n", arg0);
+}
+
+int main(int argc, char **argv) {
+    log_set_prog("microbench");
+    log_set_level(LOG_WARN);
+    robust_set_defaults(0);
+    int json = 0, min_ms = 300, reps = 5;
+    const char *filter = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--json")) json = 1;
+        else if (!strcmp(argv[i], "--min-time") && i+1<argc) min_ms = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--reps") && i+1<argc) reps = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--filter") && i+1<argc) filter = argv[++i];
+        else if (!strcmp(argv[i], "--list")) { for (size_t k = 0; k < MB_NCASES; k++) puts(g_cases[k].name); return 0; }
+        else { usage(argv[0]); return 2; }
+    }
+    if (min_ms < 1 || reps < 1 || reps > MB_MAX_REPS) { usage(argv[0]); return 2; }
+    signal(SIGPIPE, SIG_IGN);
+
+    if (json) printf("{\"min_time_ms\":%d,\"reps\":%d,\"results\":[", min_ms, reps);
+    else printf("%-26s %12s %12s %14s %12s\n", "benchmark", "median ns/op", "min ns/op", "ops/s", "iters/rep");
+    int first = 1;
+    for (size_t k = 0; k < MB_NCASES; k++) {
+        const struct mb_case *bc = &g_cases[k];
+        if (filter && !strstr(bc->name, filter)) continue;
+        struct mb_ctx c = { .sp = { -1, -1 }, .size = bc->size };
+        if (bc->setup && bc->setup(&c) < 0) {
+            LOGW("%s: setup failed (%s), skipped", bc->name, strerror(errno));
+            if (bc->teardown) bc->teardown(&c);
+            continue;
+        }
+        struct mb_result r;
+        mb_measure(bc, &c, min_ms, reps, &r);
+        if (bc->teardown) bc->teardown(&c);
+        double ops = r.median_ns > 0 ? 1e9 / r.median_ns : 0;
+        if (json) {
+            printf("%s{\"name\":\"%s\",\"size\":%u,\"ns_per_op\":%.2f,\"min_ns_per_op\":%.2f,\"ops_per_s\":%.0f,\"iters\":%llu}",
+                first ? "" : ",", bc->name, (unsigned)bc->size, r.median_ns, r.min_ns, ops, (unsigned long long)r.iters);
+        } else {
+            printf("%-26s %12.1f %12.1f %14.0f %12llu\n", bc->name, r.median_ns, r.min_ns, ops, (unsigned long long)r.iters);
+        }
+        fflush(stdout);
+        first = 0;
+    }
+    if (json) printf("]}\n");
+    return 0;
+}
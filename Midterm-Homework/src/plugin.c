@@ -0,0 +1,100 @@
+// ============================================================
+// 這支檔案實作 libutils.so 中的 handler plugin 載入 (見 plugin.h)。
+// 只在父行程 (fork 前或 SIGHUP 後) 呼叫；worker 以 fork 繼承載入結果，
+// 因此每一代 worker 看到的分派表都是固定的，不需要任何同步。
+// ============================================================
+#include "plugin.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dlfcn.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#define PLUGIN_MAX_PATHS 32
+#define PLUGIN_MAX_LOADED 128
+
+struct plugin {
+    void *handle;
+    void (*fini)(void);
+};
+
+static char *g_paths[PLUGIN_MAX_PATHS];
+static int g_npaths = 0;
+static struct plugin g_loaded[PLUGIN_MAX_LOADED];
+static int g_nloaded = 0;
+static int g_gen = 0;
+
+int plugin_add_path(const char *path) {
+    if (!path || !*path) { errno = EINVAL; return -1; }
+    if (g_npaths == PLUGIN_MAX_PATHS) { errno = ENOSPC; return -1; }
+    char *p = strdup(path);
+    if (!p) return -1;
+    g_paths[g_npaths++] = p;
+    return 0;
+}
+
+int plugin_generation(void) { return g_gen; }
+
+void plugin_unload_all(void) {
+    for (int i = g_nloaded - 1; i >= 0; i--) {   // 與載入順序相反
+        if (g_loaded[i].fini) g_loaded[i].fini();
+        dlclose(g_loaded[i].handle);
+    }
+    g_nloaded = 0;
+}
+
+static int load_one(const char *file) {
+    if (g_nloaded == PLUGIN_MAX_LOADED) { LOGW("plugin %s: too many plugins", file); return -1; }
+    void *h = dlopen(file, RTLD_NOW | RTLD_LOCAL);
+    if (!h) { LOGW("plugin %s: %s", file, dlerror()); return -1; }
+    const int *abi = dlsym(h, "csb_plugin_abi");
+    int (*init)(void) = NULL; void (*fini)(void) = NULL;
+    void *sym = dlsym(h, "csb_plugin_init");
+    if (sym) memcpy(&init, &sym, sizeof init);   // ISO C 不允許直接把 void* 轉成函式指標
+    if ((sym = dlsym(h, "csb_plugin_fini"))) memcpy(&fini, &sym, sizeof fini);
+    if (!abi || *abi != PLUGIN_ABI || !init) {
+        LOGW("plugin %s: missing csb_plugin_init or ABI mismatch (want %d, have %d)", file, PLUGIN_ABI, abi ? *abi : -1);
+        dlclose(h); return -1;
+    }
+    int rc = init();
+    // init 失敗時可能已登錄了部分 handler，不能 dlclose；保留到下一次 reload 再一併清除
+    g_loaded[g_nloaded].handle = h;
+    g_loaded[g_nloaded].fini = rc < 0 ? NULL : fini;
+    g_nloaded++;
+    if (rc < 0) { LOGW("plugin %s: init failed", file); return -1; }
+    LOGI("plugin loaded: %s", file);
+    return 0;
+}
+
+static int is_so(const struct dirent *d) {
+    size_t n = strlen(d->d_name);
+    return n > 3 && !strcmp(d->d_name + n - 3, ".so");
+}
+
+static int load_path(const char *path) {
+    struct stat st;
+    if (stat(path, &st) < 0) { LOGW("plugin %s: %s", path, strerror(errno)); return 0; }
+    if (!S_ISDIR(st.st_mode)) return load_one(path) == 0;
+    struct dirent **ents;
+    int n = scandir(path, &ents, is_so, alphasort);
+    if (n < 0) { LOGW("plugin dir %s: %s", path, strerror(errno)); return 0; }
+    int ok = 0;
+    for (int i=0;i<n;i++) {
+        char file[4096];
+        if (snprintf(file, sizeof file, "%s/%s", path, ents[i]->d_name) < (int)sizeof file && load_one(file) == 0) ok++;
+        free(ents[i]);
+    }
+    free(ents);
+    return ok;
+}
+
+int plugin_reload(void) {
+    dispatch_rollback();     // 先移除舊 handler，再卸載它們所在的 .so
+    plugin_unload_all();
+    int ok = 0;
+    for (int i=0;i<g_npaths;i++) ok += load_path(g_paths[i]);
+    g_gen++;
+    return ok;
+}
@@ -0,0 +1,26 @@
+// ============================================================
+// 範例 handler plugin：REQ_UPPER (40) 回傳轉成大寫的 payload (RESP_UPPER = 41)。
+// 編譯成 lib/plugins/upper.so，以 server --plugin lib/plugins 載入；
+// client 端可用  client call 40 hello  測試。
+// ============================================================
+#include "plugin.h"
+#include <ctype.h>
+
+#define REQ_UPPER  40
+#define RESP_UPPER 41
+#define UPPER_MAX  (64*1024)
+
+const int csb_plugin_abi = PLUGIN_ABI;
+int  csb_plugin_init(void);
+
+static void h_upper(const struct dispatch_req *rq) {
+    char out[UPPER_MAX];
+    if (rq->len > UPPER_MAX) { dispatch_error(rq, "payload too large"); return; }   // server 關閉 header 驗證時
+    const unsigned char *in = rq->payload;
+    for (uint32_t i=0;i<rq->len;i++) out[i] = (char)toupper(in[i]);
+    dispatch_reply(rq, 0, out, rq->len);
+}
+
+int csb_plugin_init(void) {
+    return dispatch_register(REQ_UPPER, RESP_UPPER, UPPER_MAX, 0, h_upper);
+}
@@ -0,0 +1,120 @@
+// ============================================================
+// 這支檔案實作 libutils.so 中的緩衝區池 (size-class free list)。
+// 每塊緩衝區前面有 16 bytes 標頭記錄所屬 class；歸還時掛回該 class 的
+// free list，下一次借用直接重複使用，不必經過 malloc/free。
+// 每個行程各自一份 (只使用 fork、沒有 thread)，因此不需要鎖；fork 之後
+// 子行程繼承父行程的 free list，直接沿用即可。
+// ============================================================
+#include "common.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define POOL_MAGIC    0x504f4f4cu   // "POOL"
+#define POOL_BIG      0xffu         // 超過最大 class：直接 malloc/free
+#define POOL_NCLASS   6
+#define POOL_KEEP_MAX (1024*1024)   // 每個 class 的 free list 最多保留的 bytes
+
+static const size_t g_class_size[POOL_NCLASS] = { 64, 256, 1024, 4096, 16384, 65536 };
+
+struct pool_blk {
+    union {
+        struct pool_blk *next;              // 在 free list 中時使用
+        struct { uint32_t magic, cls; } h;  // 借出時記錄 class
+    } u;
+    uint64_t size;                          // 可用容量 (bytes)
+};                                          // 16 bytes，payload 維持 16-byte 對齊
+
+static struct pool_blk *g_free[POOL_NCLASS];
+static unsigned g_nfree[POOL_NCLASS];
+static struct pool_stats g_ps;
+
+static int class_of(size_t len) {
+    for (int i=0;i<POOL_NCLASS;i++) if (len <= g_class_size[i]) return i;
+    return -1;
+}
+
+static unsigned keep_limit(int cls) {
+    size_t n = POOL_KEEP_MAX / g_class_size[cls];
+    return n > 256 ? 256 : (unsigned)n;
+}
+
+void *pool_get(size_t len, size_t *cap_out) {
+    int cls = class_of(len ? len : 1);
+    struct pool_blk *b;
+    if (cls >= 0 && g_free[cls]) {          // 命中 free list
+        b = g_free[cls]; g_free[cls] = b->u.next; g_nfree[cls]--;
+        g_ps.hits++;
+    } else {
+        size_t sz = cls >= 0 ? g_class_size[cls] : len;
+        if (sz > SIZE_MAX - sizeof *b) { errno = ENOMEM; return NULL; }
+        b = malloc(sizeof *b + sz);
+        if (!b) return NULL;
+        b->size = sz;
+        g_ps.misses++;
+    }
+    b->u.h.magic = POOL_MAGIC;
+    b->u.h.cls = cls >= 0 ? (uint32_t)cls : POOL_BIG;
+    g_ps.in_use++;
+    if (cap_out) *cap_out = (size_t)b->size;
+    return b + 1;
+}
+
+void pool_put(void *p) {
+    if (!p) return;
+    struct pool_blk *b = (struct pool_blk*)p - 1;
+    if (b->u.h.magic != POOL_MAGIC) { LOGE("pool_put: bad block %p", p); abort(); } // 不是 pool 借出的指標
+    uint32_t cls = b->u.h.cls;
+    g_ps.in_use--;
+    if (cls == POOL_BIG || g_nfree[cls] >= keep_limit((int)cls)) { b->u.h.magic = 0; free(b); return; }
+    b->u.next = g_free[cls]; g_free[cls] = b; g_nfree[cls]++;
+}
+
+void *pool_grow(void *p, size_t used, size_t len, size_t *cap_out) {
+    if (p) {
+        struct pool_blk *b = (struct pool_blk*)p - 1;
+        if (len <= b->size) { if (cap_out) *cap_out = (size_t)b->size; return p; }
+        if (b->u.h.cls == POOL_BIG && class_of(len) < 0) { // 大塊之間直接 realloc，避免複製
+            b->u.h.magic = 0;
+            struct pool_blk *nb = realloc(b, sizeof *nb + len);
+            if (!nb) { b->u.h.magic = POOL_MAGIC; return NULL; }
+            nb->u.h.magic = POOL_MAGIC; nb->size = len;
+            if (cap_out) *cap_out = len;
+            return nb + 1;
+        }
+    }
+    void *np = pool_get(len, cap_out);
+    if (!np) return NULL;
+    if (p) { if (used) memcpy(np, p, used); pool_put(p); }
+    return np;
+}
+
+void pool_trim(void) {
+    for (int i=0;i<POOL_NCLASS;i++) {
+        while (g_free[i]) { struct pool_blk *b = g_free[i]; g_free[i] = b->u.next; free(b); }
+        g_nfree[i] = 0;
+    }
+}
+
+int pool_prefill(size_t len, unsigned n) {
+    int cls = class_of(len ? len : 1);
+    if (cls < 0) { errno = EINVAL; return -1; }
+    int added = 0;
+    while (n-- > 0 && g_nfree[cls] < keep_limit(cls)) {
+        struct pool_blk *b = malloc(sizeof *b + g_class_size[cls]);
+        if (!b) return added ? added : -1;
+        memset(b + 1, 0, g_class_size[cls]);   // 先碰過每一頁，page fault 發生在父行程
+        b->size = g_class_size[cls];
+        b->u.next = g_free[cls]; g_free[cls] = b; g_nfree[cls]++;
+        added++;
+    }
+    return added;
+}
+
+void pool_get_stats(struct pool_stats *st) {
+    *st = g_ps;
+    st->cached_bytes = 0;
+    for (int i=0;i<POOL_NCLASS;i++) st->cached_bytes += (uint64_t)g_nfree[i] * g_class_size[i];
+}
+
+void frame_free(void *payload) { pool_put(payload); }
@@ -1,132 +1,728 @@
 // ============================================================
 // 這支程式為伺服器端主程式，採用 fork() 模型。
-// 每個 client 連線都會由父行程 accept 後 fork 出子行程處理。
+// 預設模式：每個 client 連線都會由父行程 accept 後 fork 出子行程處理，
 // 子行程處理完畢後結束，由 SIGCHLD handler 回收資源。
+// --prefork N 模式：父行程預先 fork N 個常駐 worker，
+// worker 共用同一個監聽 socket 各自 accept，父行程只負責補回死掉的 worker。
+// --event 模式：每個 prefork worker 以 epoll 事件迴圈同時服務多條連線。
+// --io-uring：同上，但事件迴圈改用 io_uring 後端 (需以 IOURING=1 編譯；kernel 不支援時退回 epoll)。
+// --reuseport：每個 worker slot 有自己的 SO_REUSEPORT listener (父行程預先建立)，
+// 搭配 --cpu-affinity 把 worker 綁在固定 CPU，--bpf-steer 依收封包的 CPU 分派連線。
+// 統計：fork 前建立共享記憶體統計區，各子行程累加自己的 slot，REQ_STATS 回傳彙總。
+// 追蹤：以 make TRACE=1 編譯時，--trace FILE 把 accept/fork/請求各階段的事件寫成二進位追蹤檔。
+// Zygote：所有共用狀態 (分派表、plugin、sysinfo、統計區) 在 fork 前建好，子行程不需重做；
+// 進入 accept/fork 迴圈前先收回父行程的 heap，fork 要複製的 page table 越少越快。
+// Admission control (fork-per-accept)：活躍子行程達上限時，父行程直接回 RESP_ERROR "busy"
+// 並關閉連線，不 fork；--adaptive-limit 依近期連線 accept → 第一個回應的 p99 以 AIMD 調整上限。
+// 壓縮：請求帶 MSG_F_ACCEPT_LZ4 / ZSTD 時，>= --comp-min 的回應在 frame 層壓縮 (handler 不必處理)。
+// Plugin：--plugin PATH 在 fork 前載入 handler .so；收到 SIGHUP 時父行程重新載入，
+// prefork 模式換上新一代 worker，舊 worker 收到 SIGUSR1 後不再 accept，服務完手上的連線才結束。
 // ============================================================
 #include "common.h"
+#include "evloop.h"
+#include "stats.h"
+#include "trace.h"
+#include "dispatch.h"
+#include "plugin.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
 #include <signal.h>
+#include <time.h>
+#include <sched.h>
+#include <poll.h>
 #include <sys/wait.h>
+#include <malloc.h>
 #include <arpa/inet.h>
 
 // 紀錄目前活躍子行程數量
 static volatile sig_atomic_t g_children = 0;
-// SIGCHLD handler：回收已結束的子行程
-static void sigchld_handler(int sig) {
-    (void)sig;
+
+// ===== prefork worker pool =====
+#define MAX_WORKERS 1024
+#define ACCEPT_BATCH 64                // fork-per-accept 模式每次最多取出的連線數
+static pid_t g_workers[MAX_WORKERS];   // 每個 slot 目前的 worker pid (0 = 需要補)
+static int g_nworkers = 0;             // 0 = fork-per-accept 模式
+static volatile sig_atomic_t g_stop = 0;
+static int g_event_mode = 0;           // worker 使用 epoll 事件迴圈
+static int g_max_conns = 0;            // 事件模式下每個 worker 的連線上限 (0 = 不限)
+// admission control (fork-per-accept)
+static int g_max_children = 0;         // --max-children：活躍子行程上限 (0 = 不限)
+static int64_t g_adm_target_ns = 0;    // --adaptive-limit：accept → 第一個回應的 p99 目標 (0 = 固定上限)
+static int g_adm_limit = 0;            // 目前生效的上限 (0 = 不限)
+static int g_adm_peak = 0;             // 這段期間觀察到的最大活躍子行程數
+static uint64_t g_adm_rejected = 0;    // 累計拒絕數 (log 用)
+static int64_t g_adm_next_ms = 0;
+static int64_t g_accept_ns = 0;        // adaptive：這條連線被 accept 的時間 (子行程取樣 accept → 第一個回應)
+static uint32_t g_zerocopy_min = 0;    // ECHO 等大型回應 >= 此大小時使用 MSG_ZEROCOPY (0 = 停用)
+static int g_reuseport = 0;             // 每個 worker slot 一個 SO_REUSEPORT listener
+static int g_listeners[MAX_WORKERS];
+static const char *g_unix_path = NULL;   // --unix：同主機的 client 另可經 AF_UNIX 連線
+static int g_ufd = -1;                   // AF_UNIX listener (所有 worker 共用)
+static int g_cpu_affinity = 0;         // worker[i] 綁在第 i 顆可用 CPU
+static int g_bpf_steer = 0;            // reuseport 群組掛 CPU 分派的 BPF
+static int g_stats = 1;                 // 共享記憶體統計 (--no-stats 關閉)
+static int g_sysinfo_refresh_ms = 1000; // sysinfo 快取的動態欄位更新間隔 (-1 = 不使用快取)
+static uint32_t g_splice_echo_min = 0;   // ECHO payload >= 此大小時以 splice 轉送 (0 = 停用)
+static sigset_t g_base_mask;           // 父行程 block 訊號前的 mask，worker 需還原
+static volatile sig_atomic_t g_reload = 0;    // SIGHUP：重新載入 plugin (父行程)
+static volatile sig_atomic_t g_draining = 0;  // SIGUSR1：舊一代 worker 停止 accept
+#define MAX_DRAINING (MAX_WORKERS*4)
+static pid_t g_drain_pids[MAX_DRAINING];      // 正在收尾的舊一代 worker (關機時也要通知)
+
+// 回收已結束的子行程 (SIGCHLD handler；SIGCHLD 被 block 時也可直接呼叫)
+static void reap_children(void) {
     int status; pid_t pid;
     while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
         g_children--;
+        for (int i=0;i<g_nworkers;i++) if (g_workers[i]==pid) { g_workers[i]=0; break; } // 空出 slot 讓父行程補上
+        for (int i=0;i<MAX_DRAINING;i++) if (g_drain_pids[i]==pid) { g_drain_pids[i]=0; break; }
         LOGI("child %d exited (active=%d)", (int)pid, (int)g_children);
     }
 }
+// SIGCHLD handler
+static void sigchld_handler(int sig) {
+    (void)sig;
+    reap_children();
+    log_flush(); // 父行程多半阻塞在 accept()，不會經過閒置點，直接在此寫出
+}
 
-// SIGALRM handler：防止子行程卡死
+// SIGALRM handler：單一請求超過 child_guard_secs 仍未完成 (handler 卡死或對方極慢)，結束子行程
 static void sigalrm_handler(int sig) {
-    (void)sig; LOGW("child guard timeout, exiting");
+    (void)sig; LOGW("request guard timeout (%ds), exiting", g_robust.child_guard_secs);
+    log_flush();
+    TRACE_FLUSH();
     _exit(2);
 }
 
+// SIGTERM/SIGINT handler：通知父行程結束 worker pool
+static void sigterm_handler(int sig) {
+    (void)sig; g_stop = 1;
+}
+
+static void sighup_handler(int sig) {
+    (void)sig; g_reload = 1;
+}
+
 static void usage(const char *arg0) {
-    fprintf(stderr, "Usage: %s [-p port] [-l addr] [-v level] [--no-robust] [--max-reqs N]\n", arg0);
+    fprintf(stderr, "Usage: %s [-p port] [-l addr] [--unix PATH] [-v level] [--no-robust] [--max-reqs N] [--idle-timeout MS] [--request-timeout SECS] [--prefork N] [--event] [--max-conns N] [--max-children N] [--adaptive-limit P99_US] [--zerocopy BYTES] [--comp-min BYTES] [--zstd-level N] [--sysinfo-refresh MS] [--log-async] [--splice-echo BYTES] [--sockopt LIST] [--backlog N] [--reuseport] [--cpu-affinity] [--bpf-steer] [--no-stats] [--trace FILE] [--plugin PATH]... [--io-uring]\n", arg0);
+}
+
+// 回應函式 (reply_fn)：blocking 模式累積到 frame_writer，事件模式排入 ev_conn 的寫出緩衝區
+
+struct fd_sink {
+    int fd;
+    struct frame_writer w;
+};
+static void count_reply(uint16_t type, uint32_t len) {
+    stats_bytes_out((uint32_t)sizeof(struct msg_hdr) + len);
+    if (type == RESP_ERROR) stats_error();
+}
+static int reply_fd(void *sink, uint16_t type, uint16_t flags, const void *payload, uint32_t len) {
+    struct fd_sink *k = sink;
+    count_reply(type, len);
+    return fwr_frame_flags(&k->w, k->fd, type, flags, payload, len, deadline_after(g_robust.io_timeout_ms));
+}
+static int reply_ev(void *sink, uint16_t type, uint16_t flags, const void *payload, uint32_t len) {
+    count_reply(type, len);
+    return ev_conn_send_flags(sink, type, flags, payload, len);
+}
+
+// ===== 請求 handler (以 dispatch_register 登錄，兩種模式共用) =====
+#define SMALL_REQ_MAX 1024   // 不帶資料的請求 (ping/sysinfo/stats) 的 payload 上限
+
+static void h_ping(const struct dispatch_req *rq) {
+    char pong[64];
+    snprintf(pong, sizeof(pong), "pong from pid %d", (int)getpid()); // 將目前子行程 PID 加入回應
+    dispatch_reply(rq, 0, pong, (uint32_t)strlen(pong));
+}
+
+// chunked ECHO 逐 chunk 回送並保留 MSG_F_MORE
+static void h_echo(const struct dispatch_req *rq) {
+    dispatch_reply(rq, (uint16_t)(rq->flags & MSG_F_MORE), rq->payload, rq->len);
+}
+
+static void h_sysinfo(const struct dispatch_req *rq) {
+    char info[1024];
+    int n = sysinfo_format(info, sizeof info); // 快取命中時只讀共享記憶體
+    if (n < 0) dispatch_error(rq, "sysinfo failed");
+    else dispatch_reply(rq, 0, info, (uint32_t)n);
+}
+
+static void h_sysinfo_bin(const struct dispatch_req *rq) {
+    unsigned char bin[SYSINFO_BIN_MAX];
+    int n = sysinfo_encode_bin(bin, sizeof bin);
+    if (n < 0) dispatch_error(rq, "sysinfo failed");
+    else dispatch_reply(rq, 0, bin, (uint32_t)n);
+}
+
+static void h_stats(const struct dispatch_req *rq) {
+    char text[4096];
+    int n = stats_format(text, sizeof text);
+    if (n < 0) dispatch_error(rq, "stats disabled");
+    else dispatch_reply(rq, 0, text, (uint32_t)n);
+}
+
+static void register_handlers(void) {
+    dispatch_register(REQ_PING, RESP_PING, SMALL_REQ_MAX, 0, h_ping);
+    dispatch_register(REQ_ECHO, RESP_ECHO, FRAME_MAX_LEN, MSG_F_MORE, h_echo);
+    dispatch_register(REQ_SYSINFO, RESP_SYSINFO, SMALL_REQ_MAX, 0, h_sysinfo);
+    dispatch_register(REQ_SYSINFO_BIN, RESP_SYSINFO_BIN, SMALL_REQ_MAX, 0, h_sysinfo_bin);
+    dispatch_register(REQ_STATS, RESP_STATS, SMALL_REQ_MAX, 0, h_stats);
+}
+
+// 查表分派一個請求，並記錄處理時間
+static void handle_request(uint16_t t, uint16_t flags, const void *pl, uint32_t len, reply_fn reply, void *sink) {
+    int64_t t0 = mono_now_ns();
+    TRACE(DISPATCH, t, len);
+    if (dispatch_request(t, flags, pl, len, reply, sink) < 0) {
+        const char *err = "unknown request";   // 沒有 handler 的型別 (例如回應型別) 或關閉 header 驗證時
+        reply(sink, RESP_ERROR, 0, err, (uint32_t)strlen(err));
+    }
+    int64_t ns = mono_now_ns() - t0;
+    TRACE(DISPATCH_END, t, ns);
+    stats_request(t, (uint32_t)sizeof(struct msg_hdr) + len, ns);
+}
+
+// keep-alive 閒置等待的 deadline；idle_timeout_ms = 0 時不限 (仍以 poll 等待，不受 SO_RCVTIMEO 影響)
+static int64_t idle_deadline(void) {
+    if (!g_robust.enable_timeouts) return -1;
+    return g_robust.idle_timeout_ms > 0 ? deadline_after(g_robust.idle_timeout_ms) : INT64_MAX;
+}
+
+// 處理單一 client 連線直到對方離線、閒置逾時或達到請求上限。
+// 連線保持 keep-alive：請求之間只受 idle_timeout_ms 限制；每個請求從第一個 byte 起
+// 受 io_timeout_ms 與 child_guard_secs 的 alarm() 硬上限保護，回應送出、回到閒置時解除；
+// pipelined 的下一個請求已有部分在緩衝區時，兩者在前一個請求完成後重新起算
+static void serve_client(int cfd) {
+    set_timeouts(cfd, g_robust.io_timeout_ms, g_robust.io_timeout_ms);
+    sockopt_apply_conn(cfd);
+    stats_conn_open();
+    if (g_zerocopy_min && sock_enable_zerocopy(cfd) < 0) LOGD("SO_ZEROCOPY: %s", strerror(errno));
+    LOGI("child %d handling client", (int)getpid());
+    /* 每連線最大請求數：環境變數 MAX_REQS_PER_CONN 或 --max-reqs 設定，預設不限 */
+    int reqs = 0, guard = 0;
+    const int max_reqs = g_robust.max_reqs_per_conn; // 0 表示無上限
+    LOGD("child %d: max_reqs_per_conn=%d", (int)getpid(), max_reqs);
+    // 讀取 client 請求與回應邏輯：一次 recv 可能帶進多個 pipelined 請求，
+    // 全部處理完、回應一次送出後才再去讀
+    struct frame_reader rd; frd_init(&rd);
+    struct fd_sink sk = { .fd = cfd }; fwr_init(&sk.w);
+    int64_t dl = -1;
+    // admission control 的延遲樣本從 accept 起算；連上後請求還沒到 (client 自己慢) 時改從請求到達起算
+    int64_t t_first = g_accept_ns; int served = 0;
+    if (t_first) { char c; if (recv(cfd, &c, 1, MSG_PEEK | MSG_DONTWAIT) < 0) t_first = -1; }
+    for (;;) {
+        struct msg_hdr h; const void *pl=NULL; uint32_t len=0; int rc, fin = 0;
+        for (;;) {
+            // 大型 ECHO 且 payload 尚未讀進緩衝區：不再 recv 到使用者空間，直接 splice 回送
+            // (壓縮的請求要先驗證原始長度，照一般路徑處理)
+            if (g_splice_echo_min && frd_peek(&rd, &h) == 1 && ntohs(h.type) == REQ_ECHO && !(ntohs(h.flags) & MSG_F_COMP) &&
+                ntohl(h.length) >= g_splice_echo_min && frd_buffered(&rd) < sizeof h + ntohl(h.length)) {
+                int64_t sdl = deadline_after(g_robust.io_timeout_ms), t0 = mono_now_ns();
+                TRACE(DISPATCH, REQ_ECHO, ntohl(h.length));
+                if (fwr_flush(&sk.w, cfd, sdl) < 0 || frd_splice(&rd, cfd, cfd, RESP_ECHO, sdl) < 0) { rc = -1; break; }
+                LOGD("spliced echo of %u bytes", (unsigned)ntohl(h.length));
+                stats_bytes_out((uint32_t)sizeof h + ntohl(h.length));
+                int64_t ns = mono_now_ns() - t0;
+                TRACE(DISPATCH_END, REQ_ECHO, ns);
+                stats_request(REQ_ECHO, (uint32_t)sizeof h + ntohl(h.length), ns);
+                rc = 1; served = 1; fin = 1;
+            } else if ((rc = frd_next(&rd, &h, &pl, &len)) == 1) {
+                handle_request(ntohs(h.type), ntohs(h.flags), pl, len, reply_fd, &sk);
+                served = 1; fin = 1;
+            } else break;
+            if (ntohs(h.flags) & MSG_F_MORE) continue; // chunked 訊息的中間 chunk 不計入請求數
+            /* 遞增次數並檢查是否達上限 */
+            if (max_reqs > 0 && ++reqs >= max_reqs) break;
+        }
+        if (fwr_flush(&sk.w, cfd, deadline_after(g_robust.io_timeout_ms)) < 0) {
+            LOGW("client send error: %s", strerror(errno));
+            break;
+        }
+        if (served && t_first > 0) { stats_first_response(mono_now_ns() - t_first); t_first = 0; }
+        if (rc < 0) { LOGW("client recv error: %s", strerror(errno)); if (errno == ETIMEDOUT) stats_timeout(); else stats_error(); break; }
+        if (rc == 1) {
+            LOGI("child %d: reached max requests per connection (%d), closing",
+                (int)getpid(), max_reqs);
+            break;
+        }
+        int idle = frd_buffered(&rd) == 0;
+        if (idle) {   // 請求之間：暫停請求時限，改用 keep-alive 閒置逾時；閒置前先寫出 log
+            if (guard) { alarm(0); guard = 0; }
+            dl = idle_deadline(); log_flush(); TRACE_IDLE();
+        } else if (fin) {   // 緩衝區剩下的是下一個請求的開頭：時限從這裡重新起算
+            dl = deadline_after(g_robust.io_timeout_ms);
+            if (g_robust.child_guard_secs > 0) { alarm((unsigned)g_robust.child_guard_secs); guard = 1; }
+        }
+        ssize_t n = frd_fill(&rd, cfd, dl);
+        if (t_first < 0 && n > 0) t_first = mono_now_ns();
+        if (n == 0 || (n < 0 && errno == ECONNRESET)) { LOGI("client closed connection"); break; } // 正常離線
+        if (n < 0 && idle && errno == ETIMEDOUT) { LOGI("child %d: keep-alive idle timeout", (int)getpid()); stats_timeout(); break; }
+        if (n < 0) { LOGW("client recv error: %s", strerror(errno)); if (errno == ETIMEDOUT || errno == EAGAIN) stats_timeout(); break; }
+        if (idle) {   // 新請求的第一個 byte：其餘部分須在 io_timeout_ms 內到齊
+            dl = deadline_after(g_robust.io_timeout_ms);
+            if (g_robust.child_guard_secs > 0) { alarm((unsigned)g_robust.child_guard_secs); guard = 1; }
+        }
+    }
+    if (guard) alarm(0);
+    stats_conn_close();
+    fwr_free(&sk.w);
+    frd_free(&rd);
+}
+
+// 事件模式：每收到一個完整 frame 就回應；達到每連線請求上限時排程關閉
+static void on_event_frame(struct ev_conn *c, const struct msg_hdr *h, const void *pl, uint32_t len) {
+    handle_request(ntohs(h->type), ntohs(h->flags), pl, len, reply_ev, c);
+    const int max_reqs = g_robust.max_reqs_per_conn;
+    if (max_reqs > 0 && ev_conn_nframes(c) >= (unsigned long)max_reqs) {
+        LOGI("worker %d: fd=%d reached max requests per connection (%d), closing",
+            (int)getpid(), ev_conn_fd(c), max_reqs);
+        ev_conn_close(c);
+    }
+}
+
+// 事件模式 worker 收到 SIGTERM：epoll_wait 被打斷後結束迴圈，讓統計與 log 有機會寫出
+static struct ev_loop *g_ev = NULL;
+static void ev_term_handler(int sig) {
+    (void)sig; if (g_ev) ev_loop_stop(g_ev);
+}
+
+// 換代：父行程以 SIGUSR1 通知舊 worker 收尾
+static void drain_handler(int sig) {
+    (void)sig; g_draining = 1;
+    if (g_ev) ev_loop_drain(g_ev);
+}
+
+// 事件模式 worker：單一行程以 epoll 服務多條連線 (不使用 alarm guard，改由 timer wheel 上的閒置/I-O 逾時清理)
+static void event_worker_loop(int lfd) {
+    struct ev_loop *L = ev_loop_new(on_event_frame, g_max_conns);
+    if (!L || ev_loop_add_listener(L, lfd) < 0 || (g_ufd >= 0 && ev_loop_add_listener(L, g_ufd) < 0)) { LOGE("event loop init failed: %s", strerror(errno)); _exit(1); }
+    g_ev = L;
+    set_signal_handler(SIGTERM, ev_term_handler);
+    // SIGTERM/SIGUSR1 平時 block，只在 epoll_pwait 期間解除，旗標檢查與等待之間不會漏掉訊號
+    sigset_t blk, wait_mask = g_base_mask;
+    sigemptyset(&blk); sigaddset(&blk, SIGTERM); sigaddset(&blk, SIGUSR1);
+    sigprocmask(SIG_BLOCK, &blk, NULL);
+    sigdelset(&wait_mask, SIGTERM); sigdelset(&wait_mask, SIGUSR1);
+    ev_loop_set_sigmask(L, &wait_mask);
+    LOGI("worker %d ready (event mode, %s, max_conns=%d, generation %d)", (int)getpid(),
+        ev_loop_backend(L) == EV_BACKEND_URING ? "io_uring" : "epoll", g_max_conns, plugin_generation());
+    int rc = ev_loop_run(L);
+    if (g_draining) LOGI("worker %d drained", (int)getpid());
+    const struct accept_stats *as = ev_loop_accept_stats(L);
+    LOGI("worker %d accept stats: accepted=%llu batches=%llu max_batch=%u max_queue=%u/%u near_full=%llu", (int)getpid(),
+        (unsigned long long)as->accepted, (unsigned long long)as->batches, as->max_batch, as->max_qlen, as->backlog,
+        (unsigned long long)as->near_full);
+    ev_loop_free(L);
+    log_flush();
+    TRACE_FLUSH();
+    _exit(rc < 0 ? 1 : 0);
+}
+
+// 把目前行程綁到第 slot 顆可用 CPU (依原本 affinity mask 的順序)
+static void pin_cpu(int slot) {
+    cpu_set_t avail, one;
+    if (sched_getaffinity(0, sizeof avail, &avail) < 0) { LOGW("sched_getaffinity: %s", strerror(errno)); return; }
+    int n = CPU_COUNT(&avail), want = slot % (n > 0 ? n : 1), k = 0;
+    for (int cpu=0; cpu<CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &avail)) continue;
+        if (k++ != want) continue;
+        CPU_ZERO(&one); CPU_SET(cpu, &one);
+        if (sched_setaffinity(0, sizeof one, &one) < 0) LOGW("sched_setaffinity: %s", strerror(errno));
+        else LOGD("worker %d pinned to cpu %d", (int)getpid(), cpu);
+        return;
+    }
+}
+
+// prefork worker：常駐迴圈，在監聽 socket 上 accept 並處理連線
+// (一般為所有 worker 共用；--reuseport 時為此 slot 專屬的 listener)；--unix 的 listener 一併等待
+static void worker_loop(int lfd, int slot) {
+    sigprocmask(SIG_SETMASK, &g_base_mask, NULL); // 父行程在 sigsuspend 外 block 了訊號，worker 不能繼承
+    if (g_reuseport) for (int i=0;i<g_nworkers;i++) if (g_listeners[i] != lfd) close(g_listeners[i]);
+    if (g_cpu_affinity) pin_cpu(slot);
+    stats_attach(slot);
+    set_signal_handler(SIGCHLD, SIG_DFL);
+    set_signal_handler(SIGTERM, SIG_DFL);
+    set_signal_handler(SIGINT, SIG_DFL);
+    set_signal_handler(SIGHUP, SIG_IGN);   // reload 只由父行程處理
+    set_signal_handler(SIGUSR1, drain_handler);
+    if (g_event_mode) event_worker_loop(lfd);
+    if (g_robust.child_guard_secs>0) set_signal_handler(SIGALRM, sigalrm_handler);
+    // listener 為 non-blocking (父行程設定)：以 ppoll 等待，SIGUSR1 只在等待期間解除 block，
+    // 不會打斷進行中的連線，也不會落在檢查 g_draining 與進入等待之間
+    sigset_t blk, wait_mask = g_base_mask;
+    sigemptyset(&blk); sigaddset(&blk, SIGUSR1);
+    sigprocmask(SIG_BLOCK, &blk, NULL);
+    sigdelset(&wait_mask, SIGUSR1);
+    LOGI("worker %d ready (generation %d)", (int)getpid(), plugin_generation());
+    while (!g_draining) {
+        log_flush();
+        TRACE_FLUSH();
+        struct pollfd pfd[2] = { { .fd = lfd, .events = POLLIN }, { .fd = g_ufd, .events = POLLIN } };   // fd < 0 的項目 poll 會略過
+        if (ppoll(pfd, 2, NULL, &wait_mask) < 0) {
+            if (errno == EINTR) continue;
+            LOGE("ppoll: %s", strerror(errno));
+            _exit(1);
+        }
+        for (int k=0;k<2 && !g_draining;k++) {   // 兩個都就緒時各接一條，不會讓其中一個餓死
+            if (!pfd[k].revents) continue;
+            int cfd = accept4(pfd[k].fd, NULL, NULL, SOCK_CLOEXEC);   // 其他 worker 可能先取走：EAGAIN 時回去等
+            if (cfd < 0) {
+                if (errno==EAGAIN || errno==EWOULDBLOCK || errno==EINTR || errno==ECONNABORTED) continue;
+                LOGE("accept: %s", strerror(errno));
+                _exit(1); // 交給父行程重新補一個 worker
+            }
+            TRACE(ACCEPT, cfd, 1);
+            serve_client(cfd);   // 請求時限 (alarm) 由 serve_client 逐請求設定
+            close(cfd);
+            LOGD("worker %d connection done", (int)getpid());
+        }
+    }
+    LOGI("worker %d drained", (int)getpid());
+}
+
+// fork 一個 worker 放進 slot；回傳 0 成功
+static int spawn_worker(int slot, int lfd) {
+    pid_t pid = fork();
+    if (pid < 0) { LOGE("fork: %s", strerror(errno)); return -1; }
+    if (pid == 0) { worker_loop(lfd, slot); log_flush(); TRACE_FLUSH(); _exit(0); }
+    TRACE(FORK, pid, slot);
+    g_workers[slot] = pid;
+    g_children++;
+    LOGI("forked worker[%d] pid=%d (active=%d)", slot, (int)pid, (int)g_children);
+    return 0;
+}
+
+static void reload_plugins(void) {
+    int n = plugin_reload();
+    LOGI("plugins reloaded: generation %d, %d module(s)", plugin_generation(), n);
+}
+
+// SIGHUP：先 fork 新一代 worker 接手 listener，再通知舊的收尾，accept 不會中斷
+static void start_new_generation(int lfd) {
+    pid_t old[MAX_WORKERS]; int nold = 0;
+    for (int i=0;i<g_nworkers;i++) {
+        if (!g_workers[i]) continue;
+        old[nold++] = g_workers[i];
+        for (int j=0;j<MAX_DRAINING;j++) if (!g_drain_pids[j]) { g_drain_pids[j] = g_workers[i]; break; }
+        g_workers[i] = 0;
+    }
+    for (int i=0;i<g_nworkers;i++) spawn_worker(i, g_reuseport ? g_listeners[i] : lfd);
+    for (int i=0;i<nold;i++) kill(old[i], SIGUSR1);
+    LOGI("generation %d started, draining %d old worker(s)", plugin_generation(), nold);
+}
+
+// ===== admission control =====
+#define ADM_WINDOW_MS    100    // adaptive：每隔多久依延遲調整一次上限
+#define ADM_MIN_SAMPLES  16     // 這段期間取樣到的連線太少時不依延遲調整
+#define ADM_MIN_LIMIT    1
+#define ADM_CEIL         1024   // adaptive 且未指定 --max-children 時的上限
+
+static void admission_init(void) {
+    if (g_adm_target_ns && !g_max_children) g_max_children = ADM_CEIL;
+    g_adm_limit = g_max_children;
+    g_adm_next_ms = mono_now_ms() + ADM_WINDOW_MS;
+    if (g_max_children) LOGI("admission control: max children %d%s", g_max_children, g_adm_target_ns ? " (adaptive)" : "");
+}
+
+// AIMD：p99 超過目標時乘法遞減 (×3/4)；延遲正常且上限確實被用滿時加 1 (沒用滿就沒有理由放寬)
+static void admission_tick(void) {
+    if (!g_adm_target_ns) return;
+    int64_t now = mono_now_ms();
+    if (now < g_adm_next_ms) return;
+    g_adm_next_ms = now + ADM_WINDOW_MS;
+    uint64_t p99 = 0;
+    long n = stats_window_percentile(99, &p99);
+    int old = g_adm_limit;
+    if (n >= ADM_MIN_SAMPLES && p99 > (uint64_t)g_adm_target_ns) {
+        // 從實際用到的並行數往下減：上限遠高於目前負載時，一次就能收斂到有效範圍
+        int base = g_adm_peak < g_adm_limit ? g_adm_peak : g_adm_limit;
+        g_adm_limit = base - (base / 4 > 0 ? base / 4 : 1);
+    }
+    else if (g_adm_peak >= g_adm_limit) g_adm_limit++;
+    if (g_adm_limit < ADM_MIN_LIMIT) g_adm_limit = ADM_MIN_LIMIT;
+    if (g_adm_limit > g_max_children) g_adm_limit = g_max_children;
+    if (g_adm_limit != old) LOGD("admission limit %d -> %d (p99=%.1fus over %ld conns, peak=%d)", old, g_adm_limit, (double)p99 / 1e3, n, g_adm_peak);
+    g_adm_peak = (int)g_children;
+}
+
+// 下一次需要醒來調整上限的等待時間 (ppoll 的 timeout；NULL = 不限)
+static const struct timespec *admission_wait(struct timespec *ts) {
+    if (!g_adm_target_ns) return NULL;
+    int64_t d = g_adm_next_ms - mono_now_ms();
+    if (d < 0) d = 0;
+    ts->tv_sec = d / 1000; ts->tv_nsec = (d % 1000) * 1000000;
+    return ts;
+}
+
+// 拒絕：不讀請求，直接送出 RESP_ERROR 後關閉。先把已到的請求讀掉，
+// 避免 close() 時接收緩衝區有資料而送出 RST，讓 client 來不及讀到回應
+static void reject_busy(int cfd) {
+    static const char msg[] = "busy";
+    struct { struct msg_hdr h; char p[sizeof msg - 1]; } f = {
+        { htonl(MSG_MAGIC), htons(RESP_ERROR), 0, htonl(sizeof msg - 1) }, "busy" };
+    char sink[512];
+    if (send(cfd, &f, sizeof f, MSG_DONTWAIT | MSG_NOSIGNAL) < 0) LOGD("reject send: %s", strerror(errno));
+    shutdown(cfd, SHUT_WR);
+    while (recv(cfd, sink, sizeof sink, MSG_DONTWAIT) > 0) { }
+    close(cfd);
+    stats_note_reject();
+    g_adm_rejected++;
+}
+
+// ===== zygote =====
+#define ZYGOTE_PREFILL_SZ 4096   // frame_reader / frame_writer 的初始緩衝區大小
+
+// 開始 fork 前呼叫一次：啟動過程 (getaddrinfo、plugin 載入…) 釋放的記憶體先還給 kernel，
+// 再放入每條連線一定會借用的兩塊緩衝區，子行程從繼承的 free list 直接取得
+static void zygote_prepare(int fork_per_conn) {
+    sysinfo_prepare();
+    pool_trim();
+    malloc_trim(0);
+    if (fork_per_conn && pool_prefill(ZYGOTE_PREFILL_SZ, 2) < 0) LOGW("pool prefill: %s", strerror(errno));
+    // 父行程自己不會呼叫 alarm()：handler 先裝好，每個子行程省一次 sigaction
+    if (fork_per_conn && g_robust.child_guard_secs>0) set_signal_handler(SIGALRM, sigalrm_handler);
+#ifdef ENABLE_DEBUG
+    struct mallinfo2 mi = mallinfo2();
+    LOGD("zygote ready: heap %zu bytes in use, %zu bytes free", mi.uordblks, mi.fordblks);
+#endif
+}
+
+// 父行程：維持 N 個 worker，只在 worker 死亡時補上
+static int run_prefork(int lfd) {
+    set_signal_handler(SIGTERM, sigterm_handler);
+    set_signal_handler(SIGINT, sigterm_handler);
+    sigset_t block;
+    sigemptyset(&block); sigaddset(&block, SIGCHLD); sigaddset(&block, SIGTERM); sigaddset(&block, SIGINT); sigaddset(&block, SIGHUP);
+    sigprocmask(SIG_BLOCK, &block, &g_base_mask); // 檢查 slot 與等待訊號之間不可被打斷
+    if (!g_event_mode) {   // blocking worker 以 ppoll + accept4 等待連線 (見 worker_loop)
+        if (g_reuseport) for (int i=0;i<g_nworkers;i++) set_nonblock(g_listeners[i], 1);
+        else set_nonblock(lfd, 1);
+        if (g_ufd >= 0) set_nonblock(g_ufd, 1);
+    }
+    zygote_prepare(0);
+    time_t last_spawn = 0; int burst = 0;
+    while (!g_stop) {
+        if (g_reload) {
+            g_reload = 0;
+            reload_plugins();
+            start_new_generation(lfd);
+        }
+        for (int i=0;i<g_nworkers;i++) {
+            if (g_workers[i]) continue;
+            // 避免 worker 一啟動就死掉時瘋狂 fork：同一秒內補太多次就稍等
+            time_t now = time(NULL);
+            if (now == last_spawn && ++burst > g_nworkers) { sleep(1); burst = 0; }
+            else if (now != last_spawn) { last_spawn = now; burst = 0; }
+            spawn_worker(i, g_reuseport ? g_listeners[i] : lfd); // 重生的 worker 沿用同一個 listener，佇列中的連線不會遺失
+        }
+        log_flush();
+        sigsuspend(&g_base_mask); // 等待 SIGCHLD / SIGTERM
+    }
+    LOGI("shutting down %d workers", g_nworkers);
+    for (int i=0;i<g_nworkers;i++) if (g_workers[i]) kill(g_workers[i], SIGTERM);
+    for (int i=0;i<MAX_DRAINING;i++) if (g_drain_pids[i]) kill(g_drain_pids[i], SIGTERM);
+    sigprocmask(SIG_SETMASK, &g_base_mask, NULL);
+    while (g_children > 0 && waitpid(-1, NULL, 0) > 0) g_children--;
+    if (g_reuseport) for (int i=0;i<g_nworkers;i++) close(g_listeners[i]);
+    else close(lfd);
+    if (g_ufd >= 0) { close(g_ufd); if (g_unix_path[0] != '@') unlink(g_unix_path); }
+    return 0;
 }
 
 int main(int argc, char **argv) {
     // 初始化日誌與 Robustness 設定
     log_set_prog("server");
     log_set_level(getenv("LOG_LEVEL")? atoi(getenv("LOG_LEVEL")) : LOG_INFO);
+    if (getenv("LOG_ASYNC")) log_set_async(atoi(getenv("LOG_ASYNC")));
     robust_set_defaults(1);
 
     const char *port = "9090"; const char *addr = NULL;
     // 解析命令列參數
-    // 支援 -p, -l, -v, --no-robust
+    // 支援 -p, -l, --unix, -v, --no-robust, --max-reqs, --idle-timeout, --request-timeout, --prefork, --event, --max-conns, --max-children, --adaptive-limit, --zerocopy, --sysinfo-refresh, --log-async, --splice-echo, --sockopt, --backlog, --reuseport, --cpu-affinity, --bpf-steer, --no-stats, --trace, --plugin, --io-uring
+    const char *trace_path = NULL; int have_plugins = 0, io_uring = 0;
     for (int i=1;i<argc;i++) {
         if (!strcmp(argv[i], "-p") && i+1<argc) port = argv[++i];
         else if (!strcmp(argv[i], "-l") && i+1<argc) addr = argv[++i];
+        else if (!strcmp(argv[i], "--unix") && i+1<argc) g_unix_path = argv[++i];
         else if (!strcmp(argv[i], "-v") && i+1<argc) log_set_level(atoi(argv[++i]));
         else if (!strcmp(argv[i], "--no-robust")) { g_robust.enable_timeouts=0; g_robust.validate_headers=0; g_robust.ignore_sigpipe=0; g_robust.child_guard_secs=0; g_robust.max_reqs_per_conn=0; }
         else if (!strcmp(argv[i], "--max-reqs") && i+1<argc) {
             g_robust.max_reqs_per_conn = atoi(argv[++i]);  // 0 = 無上限
         }
+        else if (!strcmp(argv[i], "--idle-timeout") && i+1<argc) g_robust.idle_timeout_ms = atoi(argv[++i]);     // 0 = 不限
+        else if (!strcmp(argv[i], "--request-timeout") && i+1<argc) g_robust.child_guard_secs = atoi(argv[++i]); // 0 = 不限
+        else if (!strcmp(argv[i], "--prefork") && i+1<argc) {
+            g_nworkers = atoi(argv[++i]);
+            if (g_nworkers < 1 || g_nworkers > MAX_WORKERS) { fprintf(stderr, "--prefork must be 1..%d\n", MAX_WORKERS); return 2; }
+        }
+        else if (!strcmp(argv[i], "--event")) g_event_mode = 1;
+        else if (!strcmp(argv[i], "--io-uring")) { g_event_mode = 1; io_uring = 1; }   // 事件模式改用 io_uring 後端
+        else if (!strcmp(argv[i], "--max-conns") && i+1<argc) g_max_conns = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--max-children") && i+1<argc) {
+            g_max_children = atoi(argv[++i]);
+            if (g_max_children < 0) { fprintf(stderr, "--max-children must be >= 0\n"); return 2; }
+        }
+        else if (!strcmp(argv[i], "--adaptive-limit") && i+1<argc) {
+            long us = atol(argv[++i]);
+            if (us <= 0) { fprintf(stderr, "--adaptive-limit must be > 0 (p99 target in microseconds)\n"); return 2; }
+            g_adm_target_ns = (int64_t)us * 1000;
+        }
+        else if (!strcmp(argv[i], "--zerocopy") && i+1<argc) g_zerocopy_min = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "--comp-min") && i+1<argc) frame_set_comp_min((uint32_t)strtoul(argv[++i], NULL, 10));
+        else if (!strcmp(argv[i], "--zstd-level") && i+1<argc) frame_set_zstd_level(atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--sysinfo-refresh") && i+1<argc) g_sysinfo_refresh_ms = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--log-async")) log_set_async(1);
+        else if (!strcmp(argv[i], "--sockopt") && i+1<argc) {
+            if (sockopt_parse(argv[++i]) < 0) { fprintf(stderr, "bad --sockopt list: %s\n", argv[i]); return 2; }
+        }
+        else if (!strcmp(argv[i], "--backlog") && i+1<argc) g_sockopt.backlog = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--reuseport")) g_reuseport = 1;
+        else if (!strcmp(argv[i], "--no-stats")) g_stats = 0;
+        else if (!strcmp(argv[i], "--trace") && i+1<argc) trace_path = argv[++i];
+        else if (!strcmp(argv[i], "--plugin") && i+1<argc) {
+            if (plugin_add_path(argv[++i]) < 0) { fprintf(stderr, "--plugin %s: %s\n", argv[i], strerror(errno)); return 2; }
+            have_plugins = 1;
+        }
+        else if (!strcmp(argv[i], "--cpu-affinity")) g_cpu_affinity = 1;
+        else if (!strcmp(argv[i], "--bpf-steer")) { g_reuseport = 1; g_bpf_steer = 1; g_cpu_affinity = 1; } // 分派到 CPU i 的連線由綁在 CPU i 的 worker 處理
+        else if (!strcmp(argv[i], "--splice-echo") && i+1<argc) g_splice_echo_min = (uint32_t)strtoul(argv[++i], NULL, 10);
         else { usage(argv[0]); return 2; }
     }
 
+    frame_set_zerocopy_min(g_zerocopy_min);
+    if (io_uring && ev_set_backend(EV_BACKEND_URING) < 0)
+        LOGW("--io-uring ignored: %s", errno == ENOTSUP ? "built without IOURING=1" : strerror(errno));
+    register_handlers();   // 分派表在 fork 前建好，子行程直接繼承
+    dispatch_checkpoint(); // plugin 重新載入時退回只有內建 handler 的狀態
+    if (have_plugins) reload_plugins();
+    // sysinfo 快取必須在 fork 前建立，子行程才會共用同一塊共享記憶體
+    if (g_sysinfo_refresh_ms >= 0 && sysinfo_cache_init(g_sysinfo_refresh_ms) < 0)
+        LOGW("sysinfo cache disabled: %s", strerror(errno));
+    // 統計區同樣必須在 fork 前建立
+    if (g_stats && stats_init() < 0) LOGW("stats disabled: %s", strerror(errno));
+    // 追蹤檔同樣在 fork 前開啟，所有子行程附加到同一個檔案
+    if (trace_path && trace_start(trace_path) < 0) {
+        if (errno == ENOTSUP) LOGW("--trace ignored: built without TRACE=1");
+        else LOGW("trace %s: %s", trace_path, strerror(errno));
+    }
     set_signal_handler(SIGCHLD, sigchld_handler); // 設定 SIGCHLD handler
-    int lfd = tcp_listen(addr, port, 128);  // 建立監聽 socket
-    if (lfd < 0) { LOGE("listen failed: %s", strerror(errno)); return 1; }
-    LOGI("listening on %s:%s", addr?addr:"0.0.0.0", port);
-    
-    // 主迴圈不斷接受新連線
+    set_signal_handler(SIGHUP, sighup_handler);
+    if (g_sockopt.backlog <= 0) { fprintf(stderr, "--backlog must be > 0\n"); return 2; }
+    if ((g_event_mode || g_reuseport || g_cpu_affinity) && g_nworkers == 0) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);  // 事件/reuseport 模式一定搭配 prefork，預設每顆 CPU 一個 worker
+        g_nworkers = ncpu > 0 ? (ncpu < MAX_WORKERS ? (int)ncpu : MAX_WORKERS) : 1;
+    }
+    int lfd;
+    if (g_reuseport) {
+        // 依 slot 順序建立，群組內編號 = slot，BPF 回傳的編號才能對應到 worker
+        g_sockopt.reuseport = 1;
+        for (int i=0;i<g_nworkers;i++) {
+            g_listeners[i] = tcp_listen(addr, port, g_sockopt.backlog);
+            if (g_listeners[i] < 0) { LOGE("listen failed: %s", strerror(errno)); return 1; }
+        }
+        if (g_bpf_steer && reuseport_attach_cpu_bpf(g_listeners[0], g_nworkers) < 0)
+            LOGW("SO_ATTACH_REUSEPORT_CBPF: %s (falling back to hash distribution)", strerror(errno));
+        lfd = g_listeners[0];
+    } else {
+        lfd = tcp_listen(addr, port, g_sockopt.backlog);  // 建立監聽 socket
+        if (lfd < 0) { LOGE("listen failed: %s", strerror(errno)); return 1; }
+    }
+    LOGI("listening on %s:%s%s", addr?addr:"0.0.0.0", port, g_reuseport ? " (SO_REUSEPORT per worker)" : "");
+    if (g_unix_path) {
+        g_ufd = unix_listen(g_unix_path, g_sockopt.backlog);
+        if (g_ufd < 0) { LOGE("listen %s failed: %s", g_unix_path, strerror(errno)); return 1; }
+        LOGI("listening on unix:%s", g_unix_path);
+    }
+    if (g_nworkers > 0) {
+        if (g_max_children || g_adm_target_ns) LOGW("--max-children/--adaptive-limit only apply to fork-per-accept mode (use --max-conns)");
+        LOGI("prefork mode: %d workers%s", g_nworkers, g_event_mode ? " (event)" : "");
+        return run_prefork(lfd);
+    }
+
+    // 主迴圈：listener 改為 non-blocking，每次醒來以 accept4 一口氣把佇列取空 (每批最多
+    // ACCEPT_BATCH 條) 再逐一 fork，連線風暴時不會因為一次只接一條而讓 backlog 溢出
+    set_nonblock(lfd, 1);
+    if (g_ufd >= 0) set_nonblock(g_ufd, 1);
+    // SIGHUP 平時 block，只在 ppoll 期間解除；新 plugin 只影響之後 fork 的子行程，
+    // 既有子行程繼續用 fork 當時的 handler 直到連線結束。
+    // SIGCHLD 同樣只在 ppoll 期間處理：g_children 的遞增與 handler 的遞減不會交錯 (admission control 依此計數)
+    sigset_t hup;
+    sigemptyset(&hup); sigaddset(&hup, SIGHUP); sigaddset(&hup, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &hup, &g_base_mask);
+    struct accept_stats ast = {0};
+    int64_t last_warn = 0, last_rej_warn = 0; uint64_t rej_warned = 0;
+    zygote_prepare(1);
+    admission_init();
+    if (g_adm_target_ns && !g_stats) LOGW("--adaptive-limit needs stats (started with --no-stats): using a fixed limit");
     for (;;) {
-        struct sockaddr_storage ss; socklen_t slen = sizeof ss;
-        int cfd = accept(lfd, (struct sockaddr*)&ss, &slen); // 接受新連線
-        if (cfd < 0) { if (errno==EINTR) continue; LOGE("accept: %s", strerror(errno)); continue; }
-
-        pid_t pid = fork();
-        if (pid < 0) { LOGE("fork: %s", strerror(errno)); close(cfd); continue; }
-        if (pid == 0) {
-            // 子行程：負責處理單一 client
-            close(lfd);
-            if (g_robust.child_guard_secs>0) { set_signal_handler(SIGALRM, sigalrm_handler); alarm(g_robust.child_guard_secs); }
-            set_timeouts(cfd, g_robust.io_timeout_ms, g_robust.io_timeout_ms);
-            LOGI("child %d handling client", (int)getpid());
-            /* 每連線最大請求數：環境變數 MAX_REQS_PER_CONN 可覆寫，預設 16 */
-            int reqs = 0;
-            const int max_reqs = g_robust.max_reqs_per_conn; // 0 表示無上限
-            LOGD("child %d: max_reqs_per_conn=%d", (int)getpid(), max_reqs);
-            // 讀取 client 請求與回應邏輯
-            for (;;) {
-                struct msg_hdr h; void *pl=NULL; uint32_t len=0;
-                if (recv_frame(cfd, &h, &pl, &len, g_robust.io_timeout_ms) < 0) {
-                    if (errno == ECONNRESET) {
-                        LOGI("client closed connection");      // 正常離線
-                    } else {
-                        LOGW("client recv error: %s", strerror(errno));
-                    }
-                    break;
-                }
-                uint16_t t = ntohs(h.type);
-                if (t == REQ_PING) {
-                    char pong[64];
-                    snprintf(pong, sizeof(pong), "pong from pid %d", (int)getpid()); // 將目前子行程 PID 加入回應
-                    send_frame(cfd, RESP_PING, pong, (uint32_t)strlen(pong), g_robust.io_timeout_ms);
-                } else if (t == REQ_ECHO) {
-                    send_frame(cfd, RESP_ECHO, pl, len, g_robust.io_timeout_ms);
-                } else if (t == REQ_SYSINFO) {
-                    char *info = get_system_info();
-                    if (!info) {
-                        const char *err = "sysinfo failed";
-                        send_frame(cfd, RESP_ERROR, err, (uint32_t)strlen(err), g_robust.io_timeout_ms);
-                    } else {
-                        send_frame(cfd, RESP_SYSINFO, info, (uint32_t)strlen(info), g_robust.io_timeout_ms);
-                        free(info);
-                    }
-                } else {
-                    const char *err = "unknown request";
-                    send_frame(cfd, RESP_ERROR, err, (uint32_t)strlen(err), g_robust.io_timeout_ms);
-                }
-                free(pl);
-                /* 遞增次數並檢查是否達上限 */
-                if (max_reqs > 0) {
-                    if (++reqs >= max_reqs) {
-                        LOGI("child %d: reached max requests per connection (%d), closing",
-                            (int)getpid(), max_reqs);
-                        break;
-                    }
-                }
+        if (g_reload) { g_reload = 0; reload_plugins(); }
+        admission_tick();
+        int fds[ACCEPT_BATCH], n = 0;
+        if (g_adm_target_ns) g_accept_ns = mono_now_ns();
+        int lst[2] = { lfd, g_ufd };
+        for (int k=0;k<2 && n<ACCEPT_BATCH;k++) {   // TCP 與 AF_UNIX 共用一批
+            if (lst[k] < 0) continue;
+            int r = accept_batch(lst[k], fds+n, ACCEPT_BATCH-n, SOCK_CLOEXEC, &ast); // 子行程使用 blocking socket
+            if (r > 0) n += r;
+            else if (r < 0 && errno != EINTR) {
+                LOGE("accept: %s", strerror(errno));
+                if (errno == EMFILE || errno == ENFILE) sleep(1); // fd 用盡：等子行程結束釋放
+            }
+        }
+        if (n == 0) {
+            log_flush();
+            TRACE_FLUSH();
+            struct pollfd pfd[2] = { { .fd = lfd, .events = POLLIN }, { .fd = g_ufd, .events = POLLIN } };
+            struct timespec ts;
+            ppoll(pfd, 2, admission_wait(&ts), &g_base_mask);   // SIGCHLD/SIGHUP 會以 EINTR 打斷，直接重試即可
+            continue;
+        }
+        stats_note_accept(&ast);
+        if (ast.near_full && mono_now_ms() - last_warn >= 1000) {
+            LOGW("accept queue near full: depth=%u backlog=%u (seen %llu times; consider --backlog)",
+                ast.max_qlen, ast.backlog, (unsigned long long)ast.near_full);
+            ast.near_full = 0; last_warn = mono_now_ms();
+        }
+        if (g_adm_rejected != rej_warned && mono_now_ms() - last_rej_warn >= 1000) {
+            LOGW("admission: rejected %llu connection(s) as busy (active=%d limit=%d)",
+                (unsigned long long)(g_adm_rejected - rej_warned), (int)g_children, g_adm_limit);
+            rej_warned = g_adm_rejected; last_rej_warn = mono_now_ms();
+        }
+        for (int i=0;i<n;i++) {
+            int cfd = fds[i];
+            if (g_adm_limit && g_children >= g_adm_limit) {
+                reap_children();   // SIGCHLD 在 ppoll 外被 block：已結束的先回收再判斷
+                if (g_children >= g_adm_limit) { reject_busy(cfd); continue; }   // 不 fork，父行程直接回絕
+            }
+            pid_t pid = fork();
+            if (pid < 0) { LOGE("fork: %s", strerror(errno)); close(cfd); continue; }
+            if (pid == 0) {
+                // 子行程：負責處理單一 client (同一批中後面的連線屬於其他子行程)
+                close(lfd);
+                if (g_ufd >= 0) close(g_ufd);
+                for (int j=i+1;j<n;j++) close(fds[j]);
+                set_signal_handler(SIGHUP, SIG_IGN);
+                sigprocmask(SIG_SETMASK, &g_base_mask, NULL);
+                stats_attach(-1);
+                serve_client(cfd);
+                close(cfd);
+                LOGI("child %d done", (int)getpid());
+                // 不經過 exit()：跳過 atexit 與各 .so 的解構，log/trace 已自行寫出
+                log_flush();
+                TRACE_FLUSH();
+                _exit(0);
             }
-            close(cfd);
-            LOGI("child %d done", (int)getpid());
-            return 0;
-        } else {
             // parent
+            TRACE(FORK, pid, -1);
             g_children++;
+            if (g_children > g_adm_peak) g_adm_peak = (int)g_children;
             LOGI("forked child pid=%d (active=%d)", (int)pid, (int)g_children);
             close(cfd);
         }
+        LOGD("accept batch=%d (max batch=%u, max queue depth=%u/%u)", n, ast.max_batch, ast.max_qlen, ast.backlog);
     }
-}
\ No newline at end of file
+}
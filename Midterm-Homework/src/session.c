@@ -0,0 +1,442 @@
+// ============================================================
+// 這支檔案實作 libutils.so 中的 client session API (見 session.h)。
+// 每個 host:port 一個連線池，最多 SESS_MAX_CONNS 條 non-blocking 連線；
+// 請求 frame 保留一份在請求結構中，連線被 server 關閉時才能改送到新連線。
+// server 依序回應，所以每條連線只需要一個 FIFO 對應回應與請求。
+// 同步呼叫就是非同步呼叫 + 等待自己的 callback，兩者走同一條路徑。
+// ============================================================
+#include "session.h"
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+#define SESS_MAX_TRIES  2    // 新連線一個回應都沒給就斷線時，同一請求最多送幾次
+
+struct sess_req {
+    struct sess_req *next;
+    long id;
+    sess_cb cb;
+    void *arg;
+    int tries;
+    int64_t deadline;
+    uint32_t flen;
+    char frame[];            // header + payload
+};
+
+struct sess_conn {
+    int fd;                  // -1 = 空位
+    struct sess_pool *pool;
+    struct frame_reader rd;
+    char *out; size_t olen, ooff, ocap;   // 尚未寫進 kernel 的請求
+    struct sess_req *head, *tail;         // 在途請求 (依送出順序)
+    int ninflight;
+    int err;                 // 送出時的錯誤：不再寫入，讀完已到的回應後由 sess_poll 收尾
+    unsigned long nsent, ndone;
+};
+
+struct sess_pool {
+    char *host, *port;
+    struct addrinfo *ai;     // 解析結果快取
+    int64_t ai_expire;
+    struct sess_conn conns[SESS_MAX_CONNS];
+    struct sess_stats st;
+    struct sess_pool *next;
+};
+
+static struct sess_pool *g_pools;
+static int g_dns_ttl_ms = 60000;
+static uint16_t g_sess_flags;     // 每個請求都帶的旗標 (壓縮協商)
+static long g_next_id;
+static size_t g_pending;
+static uint64_t g_done;
+static int g_forked, g_atfork;
+static struct pollfd *g_pfd;      // sess_poll 的工作陣列
+static struct sess_conn **g_pc;
+static size_t g_pcap;
+
+void sess_set_dns_ttl(int ms) { g_dns_ttl_ms = ms < 0 ? 0 : ms; }
+void sess_set_compression(uint16_t codec) {
+    codec &= MSG_F_COMP;
+    g_sess_flags = codec ? (uint16_t)(codec | frame_comp_accept()) : 0;
+}
+
+// ===== 連線 =====
+static void conn_init(struct sess_pool *p, struct sess_conn *c) {
+    memset(c, 0, sizeof *c);
+    c->fd = -1;
+    c->pool = p;
+    frd_init(&c->rd);
+}
+
+static void conn_reset(struct sess_conn *c) {
+    if (c->fd >= 0) close(c->fd);
+    frd_free(&c->rd);
+    pool_put(c->out);
+    conn_init(c->pool, c);
+}
+
+static int pool_resolve(struct sess_pool *p) {
+    struct addrinfo hints = {0}, *res;
+    hints.ai_family = AF_UNSPEC; hints.ai_socktype = SOCK_STREAM;
+    p->st.resolves++;
+    int rc = getaddrinfo(p->host, p->port, &hints, &res);
+    if (rc) {
+        LOGE("getaddrinfo %s:%s: %s", p->host, p->port, gai_strerror(rc));
+        if (rc != EAI_SYSTEM) errno = EHOSTUNREACH;
+        return -1;
+    }
+    if (p->ai) freeaddrinfo(p->ai);
+    p->ai = res;
+    p->ai_expire = mono_now_ms() + g_dns_ttl_ms;
+    return 0;
+}
+
+// 以快取的位址連線；解析過期時重新解析 (失敗則沿用舊結果)，
+// 快取的位址全部連不上時再重新解析一次 (位址可能已改變)
+static int conn_open(struct sess_pool *p, struct sess_conn *c) {
+    int fresh = 0;
+    if (!strncmp(p->host, SESS_UNIX_PREFIX, sizeof SESS_UNIX_PREFIX - 1)) {   // 同主機：不需解析
+        int fd = unix_connect(p->host + sizeof SESS_UNIX_PREFIX - 1, g_robust.io_timeout_ms);
+        if (fd < 0) return -1;
+        set_nonblock(fd, 1);
+        c->fd = fd;
+        p->st.connects++;
+        return 0;
+    }
+    if (!p->ai || mono_now_ms() >= p->ai_expire) {
+        if (pool_resolve(p) == 0) fresh = 1;
+        else if (!p->ai) return -1;
+    }
+    for (;;) {
+        int fd = -1;
+        for (struct addrinfo *a = p->ai; a && fd < 0; a = a->ai_next)
+            fd = tcp_connect_addr(a->ai_addr, a->ai_addrlen, g_robust.io_timeout_ms);
+        if (fd >= 0) {
+            set_nonblock(fd, 1);
+            c->fd = fd;
+            p->st.connects++;
+            return 0;
+        }
+        int e = errno;
+        if (fresh || pool_resolve(p) < 0) { errno = e; return -1; }
+        fresh = 1;
+    }
+}
+
+static int conn_flush(struct sess_conn *c) {
+    while (c->ooff < c->olen) {
+        ssize_t w = send(c->fd, c->out + c->ooff, c->olen - c->ooff, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (w > 0) { c->ooff += (size_t)w; continue; }
+        if (w < 0 && errno == EINTR) continue;
+        if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+        return -1;
+    }
+    c->olen = c->ooff = 0;
+    return 0;
+}
+
+// 排入請求：連線上只有這個請求時直接送 (同步呼叫不多一次複製)；
+// 已有請求在途時先累積，由 sess_poll 在等待前一次寫出 (pipelined 請求合併成一次 send)。
+// 錯誤只記在 c->err (可能正在 callback 中，不能在這裡關閉連線)
+static void conn_send(struct sess_conn *c, struct sess_req *r) {
+    r->next = NULL;
+    if (c->tail) c->tail->next = r; else c->head = r;
+    c->tail = r;
+    c->ninflight++;
+    c->nsent++;
+    size_t off = 0;
+    if (c->ninflight == 1 && !c->err) {
+        c->olen = c->ooff = 0;
+        for (;;) {
+            ssize_t w = send(c->fd, r->frame, r->flen, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (w >= 0) { off = (size_t)w; break; }
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) { c->err = errno; return; }
+            break;
+        }
+    }
+    if (off == r->flen || c->err) return;
+    size_t rest = r->flen - off;
+    if (c->olen + rest > c->ocap) {
+        if (c->ooff) { memmove(c->out, c->out + c->ooff, c->olen - c->ooff); c->olen -= c->ooff; c->ooff = 0; }
+        if (c->olen + rest > c->ocap) {
+            char *nb = pool_grow(c->out, c->olen, c->olen + rest, &c->ocap);
+            if (!nb) { c->err = ENOMEM; return; }
+            c->out = nb;
+        }
+    }
+    memcpy(c->out + c->olen, r->frame + off, rest);
+    c->olen += rest;
+}
+
+// ===== 請求 =====
+static void req_done(struct sess_pool *p, struct sess_req *r, int err, const struct msg_hdr *h, const void *pl, uint32_t len) {
+    g_pending--;
+    g_done++;
+    if (err) p->st.failed++; else p->st.completed++;
+    if (r->cb) r->cb(r->arg, err, h, pl, len);
+    pool_put(r);
+}
+
+// 選連線：閒置的連線優先，其次開新連線，最後才疊在在途請求最少的連線上
+static struct sess_conn *pool_pick(struct sess_pool *p) {
+    struct sess_conn *best = NULL, *empty = NULL;
+    for (int i=0;i<SESS_MAX_CONNS;i++) {
+        struct sess_conn *c = &p->conns[i];
+        if (c->fd >= 0 && p->st.conn_cap && c->nsent >= p->st.conn_cap && !c->ninflight)
+            conn_reset(c);   // server 已經 (或即將) 關閉這條連線
+        if (c->fd < 0) { if (!empty) empty = c; continue; }
+        if (c->err || c->ninflight >= SESS_MAX_INFLIGHT) continue;
+        if (p->st.conn_cap && c->nsent >= p->st.conn_cap) continue;
+        if (!best || c->ninflight < best->ninflight) best = c;
+    }
+    if (best && !best->ninflight) return best;
+    if (empty && conn_open(p, empty) == 0) return empty;
+    if (!best && !empty) errno = EAGAIN;
+    return best;
+}
+
+static int req_assign(struct sess_pool *p, struct sess_req *r) {
+    struct sess_conn *c = pool_pick(p);
+    if (!c) return -1;
+    r->deadline = deadline_after(g_robust.io_timeout_ms);
+    conn_send(c, r);
+    return 0;
+}
+
+// 連線出錯或被關閉：尚未收到回應的請求依序改送到其他連線。
+// 這條連線已回應過請求 (server 正常地在 max_reqs_per_conn / 閒置逾時時關閉) 就一定重送；
+// 一個回應都沒給就斷線的連線，同一請求最多送 SESS_MAX_TRIES 次。
+static void conn_fail(struct sess_pool *p, struct sess_conn *c, int err) {
+    struct sess_req *q = c->head;
+    int reused = c->ndone > 0;
+    if (reused && q && (err == ECONNRESET || err == EPIPE) &&
+        (!p->st.conn_cap || c->ndone < p->st.conn_cap)) {
+        p->st.conn_cap = (uint32_t)c->ndone;   // 還有請求在途時被關閉：記下 server 的每連線上限
+        LOGD("session %s:%s: server closes connections after %lu requests", p->host, p->port, c->ndone);
+    }
+    c->head = c->tail = NULL;
+    conn_reset(c);
+    int64_t now = mono_now_ms();
+    while (q) {
+        struct sess_req *r = q; q = q->next;
+        int e = err;
+        if (e == ETIMEDOUT && (r->deadline < 0 || r->deadline > now)) e = ECONNRESET;   // 只是排在逾時的請求後面
+        if ((e == ECONNRESET || e == EPIPE) && (reused || r->tries < SESS_MAX_TRIES)) {
+            if (!reused) r->tries++;
+            p->st.retries++;
+            if (req_assign(p, r) == 0) continue;
+            e = errno;
+        }
+        req_done(p, r, e, NULL, NULL, 0);
+    }
+}
+
+static void conn_input(struct sess_pool *p, struct sess_conn *c) {
+    ssize_t n = frd_fill(&c->rd, c->fd, -1);
+    if (n == 0) { conn_fail(p, c, ECONNRESET); return; }
+    if (n < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) conn_fail(p, c, errno);
+        return;
+    }
+    struct msg_hdr h; const void *pl; uint32_t len; int fr;
+    while ((fr = frd_next(&c->rd, &h, &pl, &len)) == 1) {
+        struct sess_req *r = c->head;
+        if (!r) { fr = -1; break; }   // 沒有請求卻收到回應
+        c->head = r->next;
+        if (!c->head) c->tail = NULL;
+        c->ninflight--;
+        c->ndone++;
+        req_done(p, r, 0, &h, pl, len);
+    }
+    if (fr < 0) conn_fail(p, c, EPROTO);
+}
+
+// 子行程：繼承的連線與在途請求屬於父行程，直接丟棄 (不呼叫 callback)
+static void sess_atfork_child(void) { g_forked = 1; }
+static void sess_check_fork(void) {
+    if (!g_forked) return;
+    g_forked = 0;
+    for (struct sess_pool *p = g_pools; p; p = p->next)
+        for (int i=0;i<SESS_MAX_CONNS;i++) {
+            struct sess_conn *c = &p->conns[i];
+            while (c->head) { struct sess_req *r = c->head; c->head = r->next; pool_put(r); }
+            conn_reset(c);
+        }
+    g_pending = 0;
+}
+
+// ===== 對外介面 =====
+struct sess_pool *sess_pool_get(const char *host, const char *port) {
+    sess_check_fork();
+    struct sess_pool *p;
+    for (p = g_pools; p; p = p->next)
+        if (!strcmp(p->host, host) && !strcmp(p->port, port)) return p;
+    p = calloc(1, sizeof *p);
+    if (!p) return NULL;
+    p->host = strdup(host); p->port = strdup(port);
+    if (!p->host || !p->port) { free(p->host); free(p->port); free(p); errno = ENOMEM; return NULL; }
+    for (int i=0;i<SESS_MAX_CONNS;i++) conn_init(p, &p->conns[i]);
+    if (!g_atfork) { pthread_atfork(NULL, NULL, sess_atfork_child); g_atfork = 1; }
+    p->next = g_pools; g_pools = p;
+    return p;
+}
+
+void sess_close_all(void) {
+    sess_check_fork();
+    while (g_pools) {
+        struct sess_pool *p = g_pools;
+        g_pools = p->next;
+        for (int i=0;i<SESS_MAX_CONNS;i++) conn_fail(p, &p->conns[i], ECANCELED);
+        if (p->ai) freeaddrinfo(p->ai);
+        free(p->host); free(p->port); free(p);
+    }
+    free(g_pfd); free(g_pc);
+    g_pfd = NULL; g_pc = NULL; g_pcap = 0;
+}
+
+long sess_call_async(struct sess_pool *p, uint16_t type, const void *payload, uint32_t len, sess_cb cb, void *arg) {
+    sess_check_fork();
+    if (len > FRAME_MAX_LEN) { errno = EMSGSIZE; return -1; }
+    uint16_t flags = g_sess_flags; void *zb = NULL;
+    if (flags & MSG_F_COMP) frame_compress(&flags, &payload, &len, &zb);   // 在途請求保存的是壓縮後的 frame，重送不必再壓
+    struct sess_req *r = pool_get(sizeof *r + sizeof(struct msg_hdr) + len, NULL);
+    if (!r) { pool_put(zb); return -1; }
+    struct msg_hdr h = { htonl(MSG_MAGIC), htons(type), htons(flags), htonl(len) };
+    memcpy(r->frame, &h, sizeof h);
+    if (len) memcpy(r->frame + sizeof h, payload, len);
+    pool_put(zb);
+    r->flen = (uint32_t)(sizeof h + len);
+    r->cb = cb; r->arg = arg;
+    r->tries = 1;
+    if (req_assign(p, r) < 0) { int e = errno; pool_put(r); errno = e; return -1; }
+    r->id = ++g_next_id;
+    p->st.calls++;
+    g_pending++;
+    TRACE(SEND, type, len);
+    return r->id;
+}
+
+int sess_poll(int timeout_ms) {
+    sess_check_fork();
+    int64_t until = timeout_ms >= 0 ? mono_now_ms() + timeout_ms : -1;
+    uint64_t done0 = g_done;
+    while (g_pending) {
+        // 先處理逾時與送出錯誤 (會把請求改送到其他連線)，再收集要等待的連線
+        int64_t now = mono_now_ms(), wake = until;
+        for (struct sess_pool *p = g_pools; p; p = p->next)
+            for (int i=0;i<SESS_MAX_CONNS;i++) {
+                struct sess_conn *c = &p->conns[i];
+                if (c->fd < 0 || !c->head) continue;
+                if (c->err && c->err != EPIPE && c->err != ECONNRESET) { conn_fail(p, c, c->err); continue; }
+                if (c->head->deadline >= 0 && c->head->deadline <= now) conn_fail(p, c, ETIMEDOUT);
+            }
+        size_t n = 0;
+        for (struct sess_pool *p = g_pools; p; p = p->next)
+            for (int i=0;i<SESS_MAX_CONNS;i++) {
+                struct sess_conn *c = &p->conns[i];
+                if (c->fd < 0 || !c->head) continue;
+                if (!c->err && c->ooff < c->olen && conn_flush(c) < 0) c->err = errno;
+                if (n == g_pcap) {
+                    size_t ncap = g_pcap ? g_pcap * 2 : 16;
+                    struct pollfd *np = realloc(g_pfd, ncap * sizeof *np);
+                    if (np) g_pfd = np;
+                    struct sess_conn **nc = np ? realloc(g_pc, ncap * sizeof *nc) : NULL;
+                    if (!nc) return -1;
+                    g_pc = nc; g_pcap = ncap;
+                }
+                g_pfd[n].fd = c->fd;
+                g_pfd[n].events = POLLIN | (!c->err && c->ooff < c->olen ? POLLOUT : 0);
+                g_pfd[n].revents = 0;
+                g_pc[n++] = c;
+                if (c->head->deadline >= 0 && (wake < 0 || c->head->deadline < wake)) wake = c->head->deadline;
+            }
+        if (g_done != done0 || !n) break;
+        int ms = wake < 0 ? -1 : wake > now ? (int)(wake - now) : 0;
+        int pr = poll(g_pfd, n, ms);
+        if (pr < 0) { if (errno == EINTR) continue; return -1; }
+        for (size_t k=0;k<n;k++) {
+            struct sess_conn *c = g_pc[k];
+            short ev = g_pfd[k].revents;
+            if (!ev || c->fd != g_pfd[k].fd) continue;   // 前面的 callback / 重送已改變這條連線
+            if ((ev & POLLOUT) && conn_flush(c) < 0) c->err = errno;
+            if (ev & (POLLIN | POLLERR | POLLHUP)) conn_input(c->pool, c);
+        }
+        if (g_done != done0) break;
+        if (until >= 0 && mono_now_ms() >= until) break;
+    }
+    return (int)(g_done - done0);
+}
+
+static int req_pending(long id) {
+    for (struct sess_pool *p = g_pools; p; p = p->next)
+        for (int i=0;i<SESS_MAX_CONNS;i++)
+            for (struct sess_req *r = p->conns[i].head; r; r = r->next)
+                if (r->id == id) return 1;
+    return 0;
+}
+
+int sess_wait(long id, int timeout_ms) {
+    int64_t until = timeout_ms >= 0 ? mono_now_ms() + timeout_ms : -1;
+    while (req_pending(id)) {
+        int left = -1;
+        if (until >= 0) {
+            int64_t d = until - mono_now_ms();
+            if (d <= 0) { errno = ETIMEDOUT; return -1; }
+            left = (int)d;
+        }
+        if (sess_poll(left) < 0) return -1;
+    }
+    return 0;
+}
+
+size_t sess_pending(void) { return g_pending; }
+
+void sess_get_stats(const struct sess_pool *p, struct sess_stats *st) { *st = p->st; }
+
+// ===== 同步呼叫 =====
+struct sync_res {
+    int done, err;
+    struct msg_hdr h;
+    void *pl;
+    uint32_t len;
+};
+
+static void sync_cb(void *arg, int err, const struct msg_hdr *h, const void *pl, uint32_t len) {
+    struct sync_res *s = arg;
+    s->done = 1;
+    s->err = err;
+    if (err) return;
+    s->h = *h;
+    s->len = len;
+    if (len) {
+        s->pl = pool_get(len, NULL);
+        if (!s->pl) { s->err = ENOMEM; return; }
+        memcpy(s->pl, pl, len);
+    }
+}
+
+int sess_call(struct sess_pool *p, uint16_t type, const void *payload, uint32_t len,
+              struct msg_hdr *h_out, void **payload_out, uint32_t *len_out) {
+    struct sync_res s = {0};
+    if (sess_call_async(p, type, payload, len, sync_cb, &s) < 0) return -1;
+    // callback 指向這個 stack frame：一定要等到完成 (啟用逾時時由請求的 deadline 保證結束)
+    while (!s.done) {
+        if (sess_poll(-1) >= 0 || errno == EINTR) continue;
+        // poll 失敗或工作陣列配置失敗：再等也不會有進展，讓這個 pool 在途的請求全部失敗。
+        // 請求一定掛在某條連線上，本次請求也在其中 (err 由 sync_cb 記下，離開迴圈後回傳 -1)
+        int err = errno;
+        for (int i=0;i<SESS_MAX_CONNS;i++) conn_fail(p, &p->conns[i], err);
+    }
+    if (s.err) { errno = s.err; return -1; }
+    if (h_out) *h_out = s.h;
+    if (len_out) *len_out = s.len;
+    if (payload_out) *payload_out = s.pl; else pool_put(s.pl);
+    return 0;
+}
@@ -0,0 +1,193 @@
+// ============================================================
+// 這支檔案實作 libutils.so 中的共享記憶體統計區。
+// 寫入端只做 relaxed atomic 累加 (每個 slot 對齊 cache line，避免
+// worker 之間互相干擾)；讀取端把所有 slot 加總，延遲分佈沿用 hist.h 的
+// bucket 配置，彙總後可直接用 hist_percentile 算百分位。
+// ============================================================
+#include "stats.h"
+#include "hist.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+struct stats_tstat {
+    uint64_t reqs, bytes_in;
+    uint64_t lat_sum_ns, lat_max_ns;
+    uint64_t lat[HIST_BUCKETS];
+};
+
+struct stats_slot {
+    uint64_t used;                   // 曾被寫入 (彙總時跳過空的 slot)
+    uint64_t conns_open, conns_closed;
+    uint64_t timeouts, errors, bytes_out;
+    struct stats_tstat t[ST_NTYPES];
+} __attribute__((aligned(64)));
+
+struct stats_shm {
+    int64_t  start_ms;
+    uint32_t acc_max_qlen, acc_backlog;
+    uint64_t acc_near_full;
+    uint64_t adm_rejected;           // admission control 拒絕的連線數
+    struct stats_tstat first;        // accept → 第一個回應 (bytes_in 不使用)
+    int64_t  last_query_ms;          // 上一次 REQ_STATS 的時間與當時的總請求數 (算近期 req/s)
+    uint64_t last_query_reqs;
+    struct stats_slot slot[STATS_SLOTS];
+};
+
+static struct stats_shm *g_st = NULL;
+static struct stats_slot *g_my = NULL;   // 目前行程寫入的 slot
+
+static const char *g_type_name[ST_NTYPES] = { "ping", "echo", "sysinfo", "sysinfo-bin", "stats", "other" };
+
+#define ADD(field, v) __atomic_fetch_add(&(field), (v), __ATOMIC_RELAXED)
+#define LOAD(field)   __atomic_load_n(&(field), __ATOMIC_RELAXED)
+
+int stats_init(void) {
+    if (g_st) return 0;
+    struct stats_shm *s = mmap(NULL, sizeof *s, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    if (s == MAP_FAILED) return -1;
+    // MAP_ANONYMOUS 已經是全零，不需 memset (未使用的 slot 不會佔用實體頁面)
+    s->start_ms = s->last_query_ms = mono_now_ms();
+    g_st = s;
+    return 0;
+}
+
+void stats_attach(int slot) {
+    if (!g_st) return;
+    if (slot < 0) slot = (int)getpid();
+    g_my = &g_st->slot[slot % STATS_SLOTS];
+    __atomic_store_n(&g_my->used, 1, __ATOMIC_RELAXED);
+}
+
+static int type_idx(uint16_t t) {
+    switch (t) {
+    case REQ_PING: return ST_PING;
+    case REQ_ECHO: return ST_ECHO;
+    case REQ_SYSINFO: return ST_SYSINFO;
+    case REQ_SYSINFO_BIN: return ST_SYSINFO_BIN;
+    case REQ_STATS: return ST_STATS;
+    default: return ST_OTHER;
+    }
+}
+
+void stats_conn_open(void)  { if (g_my) ADD(g_my->conns_open, 1); }
+void stats_conn_close(void) { if (g_my) ADD(g_my->conns_closed, 1); }
+void stats_timeout(void)    { if (g_my) ADD(g_my->timeouts, 1); }
+void stats_error(void)      { if (g_my) ADD(g_my->errors, 1); }
+void stats_bytes_out(uint32_t n) { if (g_my) ADD(g_my->bytes_out, n); }
+
+static void tstat_add(struct stats_tstat *t, uint32_t in_bytes, int64_t ns) {
+    uint64_t v = ns > 0 ? (uint64_t)ns : 0;
+    ADD(t->reqs, 1);
+    ADD(t->bytes_in, in_bytes);
+    ADD(t->lat_sum_ns, v);
+    ADD(t->lat[hist_bucket(v)], 1);
+    uint64_t mx = LOAD(t->lat_max_ns);
+    while (v > mx && !__atomic_compare_exchange_n(&t->lat_max_ns, &mx, v, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) { }
+}
+
+void stats_request(uint16_t type, uint32_t in_bytes, int64_t ns) {
+    if (g_my) tstat_add(&g_my->t[type_idx(type)], in_bytes, ns);
+}
+
+void stats_note_accept(const struct accept_stats *a) {
+    static uint64_t last_near_full;   // 每個行程自己的累計值，只把增量加進共享區
+    if (!g_st || !a) return;
+    uint32_t q = LOAD(g_st->acc_max_qlen);
+    while (a->max_qlen > q && !__atomic_compare_exchange_n(&g_st->acc_max_qlen, &q, a->max_qlen, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) { }
+    if (a->backlog) __atomic_store_n(&g_st->acc_backlog, a->backlog, __ATOMIC_RELAXED);
+    if (a->near_full < last_near_full) last_near_full = 0;   // 呼叫端清零過
+    if (a->near_full > last_near_full) { ADD(g_st->acc_near_full, a->near_full - last_near_full); last_near_full = a->near_full; }
+}
+
+void stats_note_reject(void) { if (g_st) ADD(g_st->adm_rejected, 1); }
+
+void stats_first_response(int64_t ns) { if (g_st) tstat_add(&g_st->first, 0, ns); }
+
+long stats_window_percentile(double p, uint64_t *ns_out) {
+    if (!g_st) { errno = ENOTSUP; return -1; }
+    static uint64_t prev[HIST_BUCKETS];   // 上一次的累計值
+    static struct hist win;               // 約 15KB，不放堆疊
+    hist_init(&win);
+    for (int b=0;b<HIST_BUCKETS;b++) {
+        uint64_t c = LOAD(g_st->first.lat[b]);
+        win.counts[b] = c - prev[b];
+        win.total += win.counts[b];
+        prev[b] = c;
+    }
+    win.max = LOAD(g_st->first.lat_max_ns);
+    *ns_out = hist_percentile(&win, p);
+    return (long)win.total;
+}
+
+// ===== 彙總 =====
+#define APPEND(...) do { \
+        int w_ = snprintf(buf + o, cap - o, __VA_ARGS__); \
+        if (w_ < 0 || (size_t)w_ >= cap - o) { errno = ENOSPC; return -1; } \
+        o += (size_t)w_; } while (0)
+
+int stats_format(char *buf, size_t cap) {
+    if (!g_st) { errno = ENOTSUP; return -1; }
+    static struct hist h[ST_NTYPES];   // 每個約 15KB，不放堆疊
+    uint64_t bytes_in[ST_NTYPES] = {0};
+    uint64_t opened = 0, closed = 0, timeouts = 0, errors = 0, bytes_out = 0, reqs = 0, bin = 0;
+    int used = 0;
+    for (int t=0;t<ST_NTYPES;t++) hist_init(&h[t]);
+    for (int i=0;i<STATS_SLOTS;i++) {
+        struct stats_slot *s = &g_st->slot[i];
+        if (!LOAD(s->used)) continue;
+        used++;
+        opened += LOAD(s->conns_open); closed += LOAD(s->conns_closed);
+        timeouts += LOAD(s->timeouts); errors += LOAD(s->errors); bytes_out += LOAD(s->bytes_out);
+        for (int t=0;t<ST_NTYPES;t++) {
+            struct stats_tstat *st = &s->t[t];
+            uint64_t n = LOAD(st->reqs);
+            if (!n) continue;
+            for (int b=0;b<HIST_BUCKETS;b++) h[t].counts[b] += LOAD(st->lat[b]);
+            h[t].total += n;
+            h[t].sum += (double)LOAD(st->lat_sum_ns);
+            uint64_t mx = LOAD(st->lat_max_ns);
+            if (mx > h[t].max) h[t].max = mx;
+            bytes_in[t] += LOAD(st->bytes_in);
+        }
+    }
+    for (int t=0;t<ST_NTYPES;t++) { reqs += h[t].total; bin += bytes_in[t]; }
+
+    int64_t now = mono_now_ms();
+    int64_t prev_ms = __atomic_exchange_n(&g_st->last_query_ms, now, __ATOMIC_RELAXED);
+    uint64_t prev_reqs = __atomic_exchange_n(&g_st->last_query_reqs, reqs, __ATOMIC_RELAXED);
+    double up = (double)(now - g_st->start_ms) / 1e3;
+    double win = (double)(now - prev_ms) / 1e3;
+
+    size_t o = 0;
+    APPEND("uptime=%.1fs slots=%d | conns accepted=%llu active=%llu | reqs=%llu avg=%.0f req/s recent=%.0f req/s (%.1fs)\n",
+        up, used, (unsigned long long)opened, (unsigned long long)(opened > closed ? opened - closed : 0),
+        (unsigned long long)reqs, up > 0 ? (double)reqs / up : 0.0,
+        win > 0 && reqs >= prev_reqs ? (double)(reqs - prev_reqs) / win : 0.0, win);
+    APPEND("bytes in=%llu out=%llu | errors=%llu timeouts=%llu rejected=%llu | accept queue max=%u/%u near_full=%llu\n",
+        (unsigned long long)bin, (unsigned long long)bytes_out, (unsigned long long)errors, (unsigned long long)timeouts,
+        (unsigned long long)LOAD(g_st->adm_rejected),
+        LOAD(g_st->acc_max_qlen), LOAD(g_st->acc_backlog), (unsigned long long)LOAD(g_st->acc_near_full));
+    APPEND("%-12s %10s %12s %9s %9s %9s %9s %9s (us)\n", "type", "reqs", "bytes_in", "mean", "p50", "p99", "p999", "max");
+    for (int t=0;t<ST_NTYPES;t++) {
+        if (!h[t].total) continue;
+        APPEND("%-12s %10llu %12llu %9.1f %9.1f %9.1f %9.1f %9.1f\n", g_type_name[t],
+            (unsigned long long)h[t].total, (unsigned long long)bytes_in[t], hist_mean(&h[t]) / 1e3,
+            (double)hist_percentile(&h[t], 50) / 1e3, (double)hist_percentile(&h[t], 99) / 1e3,
+            (double)hist_percentile(&h[t], 99.9) / 1e3, (double)h[t].max / 1e3);
+    }
+    uint64_t fn = LOAD(g_st->first.reqs);
+    if (fn) {   // accept → 第一個回應 (只有 fork-per-accept 且啟用 --adaptive-limit 時取樣)
+        static struct hist fh;
+        hist_init(&fh);
+        for (int b=0;b<HIST_BUCKETS;b++) fh.counts[b] = LOAD(g_st->first.lat[b]);
+        fh.total = fn; fh.sum = (double)LOAD(g_st->first.lat_sum_ns); fh.max = LOAD(g_st->first.lat_max_ns);
+        APPEND("%-12s %10llu %12s %9.1f %9.1f %9.1f %9.1f %9.1f\n", "first-resp", (unsigned long long)fn, "-",
+            hist_mean(&fh) / 1e3, (double)hist_percentile(&fh, 50) / 1e3, (double)hist_percentile(&fh, 99) / 1e3,
+            (double)hist_percentile(&fh, 99.9) / 1e3, (double)fh.max / 1e3);
+    }
+    if (o && buf[o-1] == '\n') buf[--o] = '\0';
+    return (int)o;
+}
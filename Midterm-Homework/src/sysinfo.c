@@ -0,0 +1,254 @@
+// ============================================================
+// 這支檔案實作 libutils.so 中的系統資訊擷取與快取。
+// 靜態欄位 (uname、DMI 機型) 在啟動時擷取一次；動態欄位
+// (記憶體、負載、uptime) 只用一次 sysinfo() 取得，並依
+// refresh_ms 節流。格式化好的文字放在 MAP_SHARED 區域，
+// fork 出的子行程以 seqlock 直接讀取，快取命中時不進 kernel。
+// 同時維護文字與二進位 (RESP_SYSINFO_BIN) 兩種編碼。
+// ============================================================
+#include "common.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <endian.h>
+#include <sys/mman.h>
+#include <sys/utsname.h>
+#include <sys/sysinfo.h>
+
+#define SYSINFO_TEXT_MAX 1024
+
+struct sysinfo_static {
+    struct utsname uts;
+    char model[128];
+    uint16_t ncpu;
+};
+
+struct sysinfo_dyn {
+    uint64_t mem_total, mem_free;   // bytes
+    double   load[3];
+    long     uptime;                // 秒
+};
+
+// 共享快取區 (fork 前建立)
+struct sysinfo_shm {
+    uint32_t seq;          // seqlock：奇數 = 寫入中
+    int64_t  lock_ms;      // 正在更新者取得鎖的時間 (0 = 無人更新)
+    int64_t  refreshed_ms; // 動態欄位上次更新時間
+    int      refresh_ms;
+    struct sysinfo_static st;
+    struct sysinfo_dyn dy;
+    uint32_t text_len;
+    char     text[SYSINFO_TEXT_MAX];
+    uint32_t bin_len;
+    unsigned char bin[SYSINFO_BIN_MAX];
+};
+
+static struct sysinfo_shm *g_si = NULL;
+static struct sysinfo_static g_st;   // 未啟用快取時的行程內靜態欄位
+static int g_st_ready = 0;
+
+static void read_first_line(const char *path, char *out, size_t cap) {
+    out[0] = '\0';
+    FILE *f = fopen(path, "r"); if (!f) return; // 讀取檔案第一行
+    if (fgets(out, (int)cap, f)) {
+        size_t n = strlen(out);
+        while (n>0 && (out[n-1]=='\n' || out[n-1]=='\r')) out[--n]='\0'; // trim
+    }
+    fclose(f);
+}
+
+static void collect_static(struct sysinfo_static *st) {
+    memset(st, 0, sizeof *st);
+    uname(&st->uts); // 取得系統識別（節點名、OS、版本、硬體）
+    read_first_line("/sys/devices/virtual/dmi/id/product_name", st->model, sizeof st->model); // 讀取機型
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    st->ncpu = n > 0 ? (uint16_t)(n > 0xffff ? 0xffff : n) : 0;
+}
+
+static int collect_dyn(struct sysinfo_dyn *dy) {
+    struct sysinfo si;
+    if (sysinfo(&si) < 0) return -1; // 記憶體、開機時間、負載一次取得，不需再讀 /proc/loadavg
+    uint64_t unit = si.mem_unit ? si.mem_unit : 1;
+    dy->mem_total = (uint64_t)si.totalram * unit;
+    dy->mem_free  = (uint64_t)si.freeram * unit;
+    for (int i=0;i<3;i++) dy->load[i] = (double)si.loads[i] / (double)(1 << SI_LOAD_SHIFT);
+    dy->uptime = si.uptime;
+    return 0;
+}
+
+static int format_text(char *buf, size_t cap, const struct sysinfo_static *st, const struct sysinfo_dyn *dy) {
+    int n = snprintf(buf, cap,
+        "node=%s sys=%s %s release=%s machine=%s | uptime=%.2fd | mem_total=%luMB free=%luMB | load=%.2f",
+        st->uts.nodename, st->uts.sysname, st->uts.version, st->uts.release, st->uts.machine,
+        dy->uptime / 86400.0, (unsigned long)(dy->mem_total/1024/1024), (unsigned long)(dy->mem_free/1024/1024), dy->load[0]);
+    if (n < 0) return -1;
+    return (size_t)n < cap ? n : (int)cap - 1;
+}
+
+// ===== 二進位編碼 =====
+static size_t put_str(unsigned char *p, size_t off, size_t cap, const char *str) {
+    size_t n = strnlen(str, 0xffff);
+    if (off + 2 + n > cap) return 0;
+    uint16_t be = htons((uint16_t)n);
+    memcpy(p + off, &be, 2); memcpy(p + off + 2, str, n);
+    return off + 2 + n;
+}
+
+static int encode_bin(unsigned char *buf, size_t cap, const struct sysinfo_static *st, const struct sysinfo_dyn *dy) {
+    struct sysinfo_bin_hdr h;
+    if (cap < sizeof h) return -1;
+    h.version = htons(SYSINFO_BIN_VERSION);
+    h.ncpu = htons(st->ncpu);
+    h.uptime_s = htonl((uint32_t)dy->uptime);
+    h.mem_total = htobe64(dy->mem_total);
+    h.mem_free = htobe64(dy->mem_free);
+    for (int i=0;i<3;i++) h.load_milli[i] = htonl((uint32_t)(dy->load[i] * 1000.0 + 0.5));
+    memcpy(buf, &h, sizeof h);
+    size_t off = sizeof h;
+    const char *strs[6] = { st->uts.nodename, st->uts.sysname, st->uts.release, st->uts.version, st->uts.machine, st->model };
+    for (int i=0;i<6 && off;i++) off = put_str(buf, off, cap, strs[i]);
+    return off ? (int)off : -1;
+}
+
+static size_t get_str(const unsigned char *p, size_t off, size_t len, char *out, size_t cap) {
+    if (off + 2 > len) return 0;
+    uint16_t be; memcpy(&be, p + off, 2);
+    size_t n = ntohs(be);
+    if (off + 2 + n > len) return 0;
+    size_t c = n < cap ? n : cap - 1;   // 過長的字串截斷
+    memcpy(out, p + off + 2, c); out[c] = '\0';
+    return off + 2 + n;
+}
+
+int sysinfo_decode_bin(const void *buf, size_t len, struct sysinfo_snapshot *out) {
+    const unsigned char *p = buf;
+    struct sysinfo_bin_hdr h;
+    if (!buf || len < sizeof h) { errno = EPROTO; return -1; }
+    memcpy(&h, p, sizeof h);
+    if (ntohs(h.version) != SYSINFO_BIN_VERSION) { errno = EPROTO; return -1; }
+    memset(out, 0, sizeof *out);
+    out->ncpu = ntohs(h.ncpu);
+    out->uptime_s = ntohl(h.uptime_s);
+    out->mem_total = be64toh(h.mem_total);
+    out->mem_free = be64toh(h.mem_free);
+    for (int i=0;i<3;i++) out->load[i] = ntohl(h.load_milli[i]) / 1000.0;
+    size_t off = sizeof h;
+    char *dst[6] = { out->nodename, out->sysname, out->release, out->version, out->machine, out->model };
+    size_t cap[6] = { sizeof out->nodename, sizeof out->sysname, sizeof out->release, sizeof out->version, sizeof out->machine, sizeof out->model };
+    for (int i=0;i<6;i++) {
+        off = get_str(p, off, len, dst[i], cap[i]);
+        if (!off) { errno = EPROTO; return -1; }
+    }
+    return 0;
+}
+
+int sysinfo_cache_init(int refresh_ms) {
+    if (g_si) return 0;
+    struct sysinfo_shm *si = mmap(NULL, sizeof *si, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    if (si == MAP_FAILED) return -1;
+    memset(si, 0, sizeof *si);
+    si->refresh_ms = refresh_ms < 0 ? 0 : refresh_ms;
+    collect_static(&si->st);
+    if (collect_dyn(&si->dy) < 0) { munmap(si, sizeof *si); return -1; }
+    int n = format_text(si->text, sizeof si->text, &si->st, &si->dy);
+    si->text_len = n < 0 ? 0 : (uint32_t)n;
+    n = encode_bin(si->bin, sizeof si->bin, &si->st, &si->dy);
+    si->bin_len = n < 0 ? 0 : (uint32_t)n;
+    si->refreshed_ms = mono_now_ms();
+    g_si = si;
+    return 0;
+}
+
+// 快取過期時由第一個搶到鎖的行程更新；鎖持有過久 (持有者可能被殺) 則可搶走
+static void cache_maybe_refresh(struct sysinfo_shm *si) {
+    int64_t now = mono_now_ms();
+    if (now - __atomic_load_n(&si->refreshed_ms, __ATOMIC_RELAXED) < si->refresh_ms) return;
+    int64_t owner = __atomic_load_n(&si->lock_ms, __ATOMIC_RELAXED);
+    if (owner && now - owner < 1000) return; // 別人正在更新，先用舊資料
+    if (!__atomic_compare_exchange_n(&si->lock_ms, &owner, now, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) return;
+    struct sysinfo_dyn dy; char text[SYSINFO_TEXT_MAX]; unsigned char bin[SYSINFO_BIN_MAX];
+    if (collect_dyn(&dy) == 0) {
+        int n = format_text(text, sizeof text, &si->st, &dy);
+        int nb = encode_bin(bin, sizeof bin, &si->st, &dy);
+        if (n >= 0 && nb >= 0) {   // 在鎖外準備好，臨界區只剩 memcpy
+            __atomic_fetch_add(&si->seq, 1, __ATOMIC_ACQ_REL);
+            si->dy = dy;
+            memcpy(si->text, text, (size_t)n + 1);
+            si->text_len = (uint32_t)n;
+            memcpy(si->bin, bin, (size_t)nb);
+            si->bin_len = (uint32_t)nb;
+            __atomic_fetch_add(&si->seq, 1, __ATOMIC_RELEASE);
+        }
+        __atomic_store_n(&si->refreshed_ms, now, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&si->lock_ms, 0, __ATOMIC_RELEASE);
+}
+
+// seqlock 讀取文字 (bin=0) 或二進位 (bin=1) 編碼；寫入者中途被殺導致 seq 卡在奇數時
+// 回傳 -1，由呼叫端改走非快取路徑
+static int cache_read(struct sysinfo_shm *si, int bin, char *buf, size_t cap) {
+    for (int spin = 0; spin < 10000; spin++) {
+        uint32_t s1 = __atomic_load_n(&si->seq, __ATOMIC_ACQUIRE);
+        if (s1 & 1) continue;
+        uint32_t n = bin ? si->bin_len : si->text_len;
+        size_t room = bin ? cap : cap - 1;   // 文字需保留結尾 NUL
+        if (n > room) { if (bin) { errno = ENOSPC; return -1; } n = (uint32_t)room; }
+        memcpy(buf, bin ? (const char*)si->bin : si->text, n);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&si->seq, __ATOMIC_RELAXED) != s1) continue;
+        if (!bin) buf[n] = '\0';
+        return (int)n;
+    }
+    return -1;
+}
+
+static const struct sysinfo_static *local_static(void) {
+    if (g_si) return &g_si->st;
+    if (!g_st_ready) { collect_static(&g_st); g_st_ready = 1; } // 靜態欄位每個行程只擷取一次
+    return &g_st;
+}
+
+void sysinfo_prepare(void) { (void)local_static(); }
+
+int sysinfo_format(char *buf, size_t cap) {
+    if (!buf || cap == 0) { errno = EINVAL; return -1; }
+    if (g_si) {
+        cache_maybe_refresh(g_si);
+        int n = cache_read(g_si, 0, buf, cap);
+        if (n >= 0) { TRACE(SYSINFO, 0, 1); return n; }
+    }
+    TRACE(SYSINFO, 0, 0);
+    struct sysinfo_dyn dy;
+    if (collect_dyn(&dy) < 0) return -1;
+    return format_text(buf, cap, local_static(), &dy);
+}
+
+int sysinfo_encode_bin(void *buf, size_t cap) {
+    if (!buf) { errno = EINVAL; return -1; }
+    if (g_si) {
+        cache_maybe_refresh(g_si);
+        int n = cache_read(g_si, 1, buf, cap);
+        if (n >= 0) { TRACE(SYSINFO, 1, 1); return n; }
+    }
+    TRACE(SYSINFO, 1, 0);
+    struct sysinfo_dyn dy;
+    if (collect_dyn(&dy) < 0) return -1;
+    int n = encode_bin(buf, cap, local_static(), &dy);
+    if (n < 0) errno = ENOSPC;
+    return n;
+}
+
+static char *system_info_dup(int pooled) {
+    char buf[SYSINFO_TEXT_MAX];
+    int n = sysinfo_format(buf, sizeof buf);
+    if (n < 0) return NULL;
+    char *out = pooled ? pool_get((size_t)n+1, NULL) : malloc((size_t)n+1);
+    if (!out) return NULL;
+    memcpy(out, buf, (size_t)n+1);
+    return out;
+}
+char *get_system_info(void) { return system_info_dup(0); }
+char *get_system_info_pooled(void) { return system_info_dup(1); }
@@ -0,0 +1,117 @@
+// ============================================================
+// 這支程式解讀 server --trace 產生的二進位追蹤檔 (bin/tracedump)。
+// 預設逐筆列出事件 (時間相對檔案中第一筆記錄，單位 us；其他行程較早的批次會是負值)；-s 改為輸出摘要：
+// 每種事件的筆數，以及依請求型別分類的各階段延遲：
+//   wait     = RECV (frame 解析完成) → DISPATCH (開始處理)
+//   handle   = DISPATCH → DISPATCH_END
+//   reply    = DISPATCH_END → 同一行程下一次 FLUSH (回應寫出；事件模式在處理途中就已送出，沒有此階段)
+// 各行程的記錄以批次寫入，檔案中不同 pid 的區段會交錯，階段以 pid 分開追蹤。
+// ============================================================
+#include "trace.h"
+#include "hist.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define MAX_TYPES 256
+#define MAX_PIDS  1024   // 同時追蹤階段的行程數 (open addressing)
+
+enum { PH_WAIT = 0, PH_HANDLE, PH_REPLY, PH_N };
+static const char *g_phase_name[PH_N] = { "wait", "handle", "reply" };
+
+struct pid_state {
+    uint32_t pid;
+    uint64_t recv_ts, disp_ts, end_ts;   // 0 = 尚未發生
+    uint16_t type;
+};
+
+static struct pid_state g_pids[MAX_PIDS];
+static struct hist *g_ph[MAX_TYPES][PH_N];   // 用到才配置 (每個約 15KB)
+static uint64_t g_count[TR_NEVENTS];
+
+static struct pid_state *pid_slot(uint32_t pid) {
+    unsigned i = (pid * 2654435761u) % MAX_PIDS;
+    for (unsigned k = 0; k < MAX_PIDS; k++, i = (i + 1) % MAX_PIDS) {
+        if (g_pids[i].pid == pid) return &g_pids[i];
+        if (!g_pids[i].pid) { g_pids[i].pid = pid; return &g_pids[i]; }
+    }
+    return NULL;   // 表滿：不追蹤這個行程的階段
+}
+
+static void record_phase(uint16_t type, int ph, uint64_t from, uint64_t to) {
+    if (!from || to < from) return;
+    struct hist **h = &g_ph[type % MAX_TYPES][ph];
+    if (!*h) {
+        if (!(*h = malloc(sizeof **h))) return;
+        hist_init(*h);
+    }
+    hist_record(*h, to - from);
+}
+
+static void account(const struct trace_rec *r) {
+    if (r->ev < TR_NEVENTS) g_count[r->ev]++;
+    struct pid_state *st = pid_slot(r->pid);
+    if (!st) return;
+    switch (r->ev) {
+    case TR_RECV: st->recv_ts = r->ts_ns; break;
+    case TR_DISPATCH:
+        st->type = (uint16_t)r->a; st->disp_ts = r->ts_ns; st->end_ts = 0;
+        record_phase(st->type, PH_WAIT, st->recv_ts, r->ts_ns);
+        st->recv_ts = 0;
+        break;
+    case TR_DISPATCH_END:
+        record_phase(st->type, PH_HANDLE, st->disp_ts, r->ts_ns);
+        st->end_ts = r->ts_ns;
+        break;
+    case TR_FLUSH:
+        record_phase(st->type, PH_REPLY, st->end_ts, r->ts_ns);
+        st->end_ts = 0;
+        break;
+    default: break;
+    }
+}
+
+static void print_summary(void) {
+    printf("%-14s %12s\n", "event", "count");
+    for (int e = 0; e < TR_NEVENTS; e++)
+        if (g_count[e]) printf("%-14s %12llu\n", trace_event_name(e), (unsigned long long)g_count[e]);
+    printf("\n%-6s %-7s %10s %9s %9s %9s %9s (us)\n", "type", "phase", "count", "mean", "p50", "p99", "max");
+    for (int t = 0; t < MAX_TYPES; t++) {
+        for (int ph = 0; ph < PH_N; ph++) {
+            const struct hist *h = g_ph[t][ph];
+            if (!h || !h->total) continue;
+            printf("%-6d %-7s %10llu %9.2f %9.2f %9.2f %9.2f\n", t, g_phase_name[ph], (unsigned long long)h->total,
+                hist_mean(h) / 1e3, (double)hist_percentile(h, 50) / 1e3, (double)hist_percentile(h, 99) / 1e3,
+                (double)h->max / 1e3);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    int summary = 0; const char *path = NULL;
+    for (int i=1;i<argc;i++) {
+        if (!strcmp(argv[i], "-s")) summary = 1;
+        else if (!path && argv[i][0] != '-') path = argv[i];
+        else { fprintf(stderr, "Usage: %s [-s] TRACE_FILE\n", argv[0]); return 2; }
+    }
+    if (!path) { fprintf(stderr, "Usage: %s [-s] TRACE_FILE\n", argv[0]); return 2; }
+    FILE *f = fopen(path, "rb");
+    if (!f) { fprintf(stderr, "%s: %s\n", path, strerror(errno)); return 1; }
+    struct trace_file_hdr h;
+    if (fread(&h, sizeof h, 1, f) != 1 || memcmp(h.magic, TRACE_MAGIC, sizeof TRACE_MAGIC) != 0 ||
+        h.rec_size != sizeof(struct trace_rec)) {
+        fprintf(stderr, "%s: not a trace file (or built with a different record layout)\n", path);
+        fclose(f); return 1;
+    }
+    struct trace_rec r; uint64_t t0 = 0;
+    while (fread(&r, sizeof r, 1, f) == 1) {
+        if (summary) { account(&r); continue; }
+        if (!t0) t0 = r.ts_ns;
+        long long a = (long long)r.a, b = (long long)r.b;   // FORK 的 slot 可能為 -1
+        printf("%14.3f %7u %-13s %lld %lld\n", (double)(int64_t)(r.ts_ns - t0) / 1e3, r.pid, trace_event_name(r.ev), a, b);
+    }
+    fclose(f);
+    if (summary) print_summary();
+    return 0;
+}
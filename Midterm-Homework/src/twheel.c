@@ -0,0 +1,109 @@
+// ============================================================
+// 這支檔案實作 libutils.so 中的階層式 timer wheel (見 twheel.h)。
+// 第 l 層第 i 格存放「到期 tick 的第 l 組 6 位元 = i」且距離在第 l 層範圍內的 timer；
+// now 每走到第 0 層的整圈邊界，就把上一層對應格的 timer 依剩餘時間重新分配到下層。
+// ============================================================
+#include "twheel.h"
+#include <string.h>
+
+static inline void list_init(struct tw_timer *h) { h->next = h->prev = h; }
+static inline void list_add(struct tw_timer *h, struct tw_timer *t) {
+    t->prev = h->prev; t->next = h;
+    h->prev->next = t; h->prev = t;
+}
+static inline void list_del(struct tw_timer *t) {
+    t->prev->next = t->next; t->next->prev = t->prev;
+    t->next = t->prev = NULL;
+}
+
+void tw_init(struct twheel *w, unsigned tick_ms, int64_t now_ms) {
+    memset(w, 0, sizeof *w);
+    w->tick_ms = tick_ms ? tick_ms : 1;
+    w->origin_ms = now_ms;
+    for (int l=0;l<TW_LEVELS;l++)
+        for (unsigned i=0;i<TW_SLOTS;i++) list_init(&w->slot[l][i]);
+}
+
+void tw_timer_init(struct tw_timer *t, void (*fn)(void *arg), void *arg) {
+    memset(t, 0, sizeof *t);
+    t->fn = fn; t->arg = arg;
+}
+
+// 依與 now 的距離選層，再以到期 tick 在該層的位元選格
+static void place(struct twheel *w, struct tw_timer *t) {
+    const uint64_t span = 1ull << (TW_BITS * TW_LEVELS);
+    if (t->expires < w->now) t->expires = w->now;
+    if (t->expires - w->now >= span) t->expires = w->now + span - 1;
+    uint64_t delta = t->expires - w->now;
+    int l = 0;
+    while (l < TW_LEVELS - 1 && delta >= (1ull << (TW_BITS * (l + 1)))) l++;
+    list_add(&w->slot[l][(t->expires >> (TW_BITS * l)) & (TW_SLOTS - 1)], t);
+}
+
+void tw_add(struct twheel *w, struct tw_timer *t, int64_t expire_ms) {
+    if (tw_pending(t)) tw_del(w, t);
+    int64_t rel = expire_ms - w->origin_ms;
+    t->expires = rel > 0 ? ((uint64_t)rel + w->tick_ms - 1) / w->tick_ms : 0;   // 無條件進位：不會提早觸發
+    place(w, t);
+    w->count++;
+}
+
+void tw_del(struct twheel *w, struct tw_timer *t) {
+    if (!tw_pending(t)) return;
+    list_del(t);
+    w->count--;
+}
+
+// 把第 l 層第 idx 格整串取下，依剩餘時間重新放回 (會落到較低的層)
+static void cascade(struct twheel *w, int l, unsigned idx) {
+    struct tw_timer tmp, *h = &w->slot[l][idx];
+    if (h->next == h) return;
+    tmp.next = h->next; tmp.prev = h->prev;
+    tmp.next->prev = &tmp; tmp.prev->next = &tmp;
+    list_init(h);
+    while (tmp.next != &tmp) {
+        struct tw_timer *t = tmp.next;
+        list_del(t);
+        place(w, t);
+    }
+}
+
+int tw_advance(struct twheel *w, int64_t now_ms) {
+    if (now_ms < w->origin_ms) return 0;
+    uint64_t target = (uint64_t)(now_ms - w->origin_ms) / w->tick_ms;
+    int fired = 0;
+    while (w->now <= target) {
+        if (!w->count) { w->now = target + 1; break; }   // 沒有 timer：直接跳到現在
+        unsigned idx = w->now & (TW_SLOTS - 1);
+        for (int l = 1; idx == 0 && l < TW_LEVELS; l++) {   // 下層轉完一圈，上層對應格往下搬
+            idx = (w->now >> (TW_BITS * l)) & (TW_SLOTS - 1);
+            cascade(w, l, idx);
+        }
+        // 先整串取下再逐一觸發：callback 刪除/重新排入其他 timer 也不會弄亂走訪
+        struct tw_timer due, *h = &w->slot[0][w->now & (TW_SLOTS - 1)];
+        w->now++;
+        if (h->next == h) continue;
+        due.next = h->next; due.prev = h->prev;
+        due.next->prev = &due; due.prev->next = &due;
+        list_init(h);
+        while (due.next != &due) {
+            struct tw_timer *t = due.next;
+            list_del(t);
+            w->count--;
+            t->fn(t->arg);
+            fired++;
+        }
+    }
+    return fired;
+}
+
+int tw_next_ms(const struct twheel *w, int64_t now_ms) {
+    if (!w->count) return -1;
+    // 第 0 層中最近的非空格；都空時醒在這一圈結束 (要做 cascade)
+    uint64_t t = w->now, end = (w->now | (TW_SLOTS - 1)) + 1;
+    while (t < end && w->slot[0][t & (TW_SLOTS - 1)].next == &w->slot[0][t & (TW_SLOTS - 1)]) t++;
+    int64_t at = w->origin_ms + (int64_t)(t * w->tick_ms);
+    if (at <= now_ms) return 0;
+    int64_t d = at - now_ms;
+    return d > 0x7fffffff ? 0x7fffffff : (int)d;
+}
@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+"""
+test_no_robust_comp.py
+回歸測試：關閉 header 驗證 (--no-robust) 時，壓縮 frame 的 type 超出型別表範圍不可讓 server 崩潰。
+協定：
+- magic: 'CSB1' -> 0x43534231 (network order)
+- type:  0xc000 (超出 MSG_TYPE_MAX)，flags: MSG_F_LZ4 = 0x0002
+- payload: 8 bytes (4 bytes 原始長度 + 4 bytes 垃圾)
+
+以事件模式啟動 server，壞 frame 與正常連線由同一個 worker 服務：
+    bin/server -p 9090 --no-robust --prefork 1 --event
+預期：壞 frame 的連線被關閉 (EOF)，worker 仍存活，先建立的連線與新連線的 PING 都收得到回應。
+(修正前 worker 在 libutils.so 內 segfault，所有連線一起斷線)
+"""
+import argparse
+import socket
+import struct
+import sys
+
+MAGIC = 0x43534231  # 'CSB1'
+REQ_PING = 1
+RESP_PING = 2
+MSG_F_LZ4 = 0x0002
+
+def pack_hdr(msg_type: int, flags: int, length: int) -> bytes:
+    # !IHHI -> magic(uint32), type(uint16), flags(uint16), length(uint32)
+    return struct.pack('!IHHI', MAGIC, msg_type, flags, length)
+
+def recv_exact(sock: socket.socket, n: int) -> bytes:
+    """精準讀 n bytes；回傳長度不足代表對端關閉。"""
+    buf = bytearray()
+    while len(buf) < n:
+        chunk = sock.recv(n - len(buf))
+        if not chunk:
+            return bytes(buf)
+        buf.extend(chunk)
+    return bytes(buf)
+
+def ping(sock: socket.socket) -> bool:
+    sock.sendall(pack_hdr(REQ_PING, 0, 4) + b'ping')
+    hdr = recv_exact(sock, 12)
+    if len(hdr) < 12:
+        return False
+    magic, typ, _flags, length = struct.unpack('!IHHI', hdr)
+    recv_exact(sock, length)
+    return magic == MAGIC and typ == RESP_PING
+
+def main() -> int:
+    p = argparse.ArgumentParser(description="Send a compressed frame with an out-of-range type to a --no-robust server.")
+    p.add_argument('--host', default='127.0.0.1')
+    p.add_argument('--port', type=int, default=9090)
+    p.add_argument('--timeout', type=float, default=5.0, help='recv timeout（秒）')
+    args = p.parse_args()
+
+    # 先建立一條正常連線：worker 若崩潰，這條連線也會斷
+    keep = socket.create_connection((args.host, args.port), timeout=args.timeout)
+    if not ping(keep):
+        print("[FAIL] initial ping failed")
+        return 1
+
+    with socket.create_connection((args.host, args.port), timeout=args.timeout) as s:
+        s.sendall(pack_hdr(0xc000, MSG_F_LZ4, 8) + struct.pack('!I', 4) + b'XXXX')
+        try:
+            rest = s.recv(64)
+        except ConnectionResetError:
+            rest = b''
+        print(f"[INFO] bad frame: server replied {len(rest)} bytes then closed" if rest else "[INFO] bad frame: connection closed")
+
+    try:
+        ok = ping(keep)
+    except (ConnectionResetError, BrokenPipeError, socket.timeout):
+        ok = False
+    keep.close()
+    if not ok:
+        print("[FAIL] existing connection lost: the worker crashed")
+        return 1
+    with socket.create_connection((args.host, args.port), timeout=args.timeout) as s:
+        if not ping(s):
+            print("[FAIL] new connection ping failed")
+            return 1
+    print("[PASS] server survived the out-of-range compressed frame")
+    return 0
+
+if __name__ == '__main__':
+    try:
+        sys.exit(main())
+    except KeyboardInterrupt:
+        sys.exit(130)